@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "chunk_cache.h"
+
+// open infile and set up an empty chunk for every chunk_size bytes of it, each to be released by replicas
+// return pointer to chunk cache on success, NULL on error
+struct chunk_cache *init_chunk_cache(const char *infile_path, u_int32_t chunk_size, u_int32_t replicas) {
+	if (chunk_size == 0) {
+		fprintf(stderr, "myclient ~ init_chunk_cache(): cannot split infile into 0 byte chunks.\n");
+		return NULL;
+	}
+
+	struct chunk_cache *cache = malloc(sizeof(struct chunk_cache));
+	if (cache == NULL) {
+		fprintf(stderr, "myclient ~ init_chunk_cache(): failed to allocate chunk cache.\n");
+		return NULL;
+	}
+
+	cache->fd = open(infile_path, O_RDONLY);
+	if (cache->fd < 0) {
+		fprintf(stderr, "myclient ~ init_chunk_cache(): failed to open file %s: %s\n", infile_path, strerror(errno));
+		free(cache);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(cache->fd, &st) < 0) {
+		fprintf(stderr, "myclient ~ init_chunk_cache(): encountered error getting infile size: %s\n", strerror(errno));
+		close(cache->fd);
+		free(cache);
+		return NULL;
+	}
+
+	cache->size = st.st_size;
+	cache->chunk_size = chunk_size;
+	cache->chunk_count = (st.st_size + chunk_size - 1) / chunk_size;
+	cache->cached_bytes = 0;
+	cache->loads = 0;
+	cache->misses = 0;
+
+	cache->chunks = calloc(cache->chunk_count == 0 ? 1 : cache->chunk_count, sizeof(struct chunk));
+	if (cache->chunks == NULL) {
+		fprintf(stderr, "myclient ~ init_chunk_cache(): failed to allocate %u chunks.\n", cache->chunk_count);
+		close(cache->fd);
+		free(cache);
+		return NULL;
+	}
+
+	for (u_int32_t i = 0; i < cache->chunk_count; i++) {
+		cache->chunks[i].data = NULL;
+		cache->chunks[i].pending = replicas;
+	}
+
+	pthread_mutex_init(&cache->lock, NULL);
+
+	return cache;
+}
+
+// free every chunk still cached, close infile and free the cache itself
+void free_chunk_cache(struct chunk_cache **cache) {
+	for (u_int32_t i = 0; i < (*cache)->chunk_count; i++) {
+		free((*cache)->chunks[i].data);
+	}
+
+	free((*cache)->chunks);
+	close((*cache)->fd);
+	pthread_mutex_destroy(&(*cache)->lock);
+
+	free(*cache);
+
+	*cache = NULL;
+}
+
+// read chunk from infile, cache lock must be held
+// return 0 on success, -1 on error
+int load_chunk(struct chunk_cache *cache, u_int32_t idx) {
+	off_t off = (off_t)idx * cache->chunk_size;
+	size_t len = cache->size - off < cache->chunk_size ? (size_t)(cache->size - off) : cache->chunk_size;
+
+	char *data = malloc(len);
+	if (data == NULL) {
+		fprintf(stderr, "myclient ~ load_chunk(): failed to allocate %zu byte chunk.\n", len);
+		return -1;
+	}
+
+	size_t done = 0;
+	while (done < len) {
+		ssize_t res = pread(cache->fd, data + done, len - done, off + done);
+		if (res <= 0) {
+			if (res < 0 && errno == EINTR) continue;
+
+			fprintf(stderr, "myclient ~ load_chunk(): encountered error reading chunk %u from infile.\n", idx);
+			free(data);
+			return -1;
+		}
+
+		done += res;
+	}
+
+	cache->chunks[idx].data = data;
+	cache->cached_bytes += len;
+	cache->loads ++;
+
+	return 0;
+}
+
+// find len bytes of infile at off, reading their chunk if no replica has yet
+// return ptr into the chunk, NULL if the cache is full or on error
+char *chunk_cache_get(struct chunk_cache *cache, off_t off, u_int32_t len) {
+	u_int32_t idx = off / cache->chunk_size;
+
+	if (idx >= cache->chunk_count || off - (off_t)idx * cache->chunk_size + len > cache->chunk_size) {
+		fprintf(stderr, "myclient ~ chunk_cache_get(): %u bytes at %lld are not inside one chunk.\n", len, (long long)off);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+
+	struct chunk *chunk = &cache->chunks[idx];
+
+	// the first replica to get here reads the chunk for all of them
+	if (chunk->data == NULL) {
+		if (cache->cached_bytes + cache->chunk_size > CHUNK_CACHE_MAX_BYTES || load_chunk(cache, idx) < 0) {
+			cache->misses ++;
+			pthread_mutex_unlock(&cache->lock);
+			return NULL;
+		}
+	}
+
+	char *ptr = chunk->data + (off - (off_t)idx * cache->chunk_size);
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return ptr;
+}
+
+// calling replica is done with chunks [first, last), chunks no replica still needs are freed
+void chunk_cache_release(struct chunk_cache *cache, u_int32_t first, u_int32_t last) {
+	if (last > cache->chunk_count) last = cache->chunk_count;
+
+	pthread_mutex_lock(&cache->lock);
+
+	for (u_int32_t i = first; i < last; i++) {
+		struct chunk *chunk = &cache->chunks[i];
+
+		if (chunk->pending > 0) chunk->pending --;
+
+		if (chunk->pending == 0 && chunk->data != NULL) {
+			off_t off = (off_t)i * cache->chunk_size;
+			cache->cached_bytes -= cache->size - off < cache->chunk_size ? (size_t)(cache->size - off) : cache->chunk_size;
+
+			free(chunk->data);
+			chunk->data = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,50 @@
+#ifndef CHUNK_CACHE_INCLUDE
+#define CHUNK_CACHE_INCLUDE
+
+#include <sys/types.h>
+#include <pthread.h>
+
+#define CHUNK_PKTS 64												// payloads per chunk, so a payload never straddles two chunks
+#define CHUNK_CACHE_MAX_BYTES (64ul << 20)							// past this replicas read uncached chunks themselves
+
+// one infile segment, read by whichever replica needs it first
+struct chunk {
+	char *data;				// NULL until loaded, freed once every replica has it acked
+	u_int32_t pending;		// replicas that haven't released the chunk yet
+};
+
+// infile segments shared by every replica thread, each byte is read from disk once
+// a chunk stays cached until the slowest replica's server has acked all of it
+struct chunk_cache {
+	pthread_mutex_t lock;
+	int fd;
+	off_t size;
+	u_int32_t chunk_size;
+	u_int32_t chunk_count;
+	struct chunk *chunks;
+	size_t cached_bytes;
+	u_int64_t loads;		// chunks read from infile
+	u_int64_t misses;		// lookups refused because the cache was full
+};
+
+// open infile and set up an empty chunk for every chunk_size bytes of it, each to be released by replicas
+// chunk_size should be a multiple of the payload size
+// return pointer to chunk cache on success, NULL on error
+struct chunk_cache *init_chunk_cache(const char *infile_path, u_int32_t chunk_size, u_int32_t replicas);
+
+// free every chunk still cached, close infile and free the cache itself
+void free_chunk_cache(struct chunk_cache **cache);
+
+// read chunk from infile, cache lock must be held
+// return 0 on success, -1 on error
+int load_chunk(struct chunk_cache *cache, u_int32_t idx);
+
+// find len bytes of infile at off, reading their chunk if no replica has yet
+// ptr stays valid until the calling replica releases the chunk
+// return ptr into the chunk, NULL if the cache is full or on error
+char *chunk_cache_get(struct chunk_cache *cache, off_t off, u_int32_t len);
+
+// calling replica is done with chunks [first, last), chunks no replica still needs are freed
+void chunk_cache_release(struct chunk_cache *cache, u_int32_t first, u_int32_t last);
+
+#endif
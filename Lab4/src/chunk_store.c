@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "chunk_store.h"
+#include "sha256.h"
+#include "utils.h"
+
+// gear hash, every byte shifts the hash left so only the last 64 bytes decide a boundary
+u_int64_t gear[256];
+pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+// fill the gear table the chunk boundaries are found with, run once per process
+void init_gear(void) {
+	// splitmix64, the same table on every host
+	u_int64_t x = 0;
+
+	for (int i = 0; i < 256; i++) {
+		x += 0x9e3779b97f4a7c15ull;
+
+		u_int64_t z = x;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+// length of the content defined chunk at the start of left bytes at buf
+u_int32_t cdc_chunk_len(const u_int8_t *buf, off_t left) {
+	if (left <= CDC_MIN_CHUNK) return (u_int32_t)left;
+
+	u_int32_t max = left < CDC_MAX_CHUNK ? (u_int32_t)left : CDC_MAX_CHUNK;
+	u_int64_t h = 0;
+
+	// no cut before the minimum, so its bytes aren't even hashed
+	for (u_int32_t i = CDC_MIN_CHUNK; i < max; i++) {
+		h = (h << 1) + gear[buf[i]];
+
+		// top bits depend on the most bytes
+		if ((h >> (64 - CDC_AVG_BITS)) == 0) return i + 1;
+	}
+
+	return max;
+}
+
+// hash of len bytes at buf, put in hash
+void chunk_hash(const u_int8_t *buf, u_int32_t len, u_int8_t *hash) {
+	sha256(buf, len, hash);
+}
+
+// split size bytes at buf into content defined chunks, *chunks is allocated and freed by the caller
+// return 0 on success, -1 on error
+int split_chunks(const u_int8_t *buf, off_t size, struct chunk_ref **chunks, u_int32_t *count) {
+	pthread_once(&gear_once, init_gear);
+
+	// every chunk but the last is at least the minimum
+	u_int32_t cap = (u_int32_t)(size / CDC_MIN_CHUNK + 1);
+
+	*chunks = malloc(cap * sizeof(struct chunk_ref));
+	*count = 0;
+
+	if (*chunks == NULL) {
+		fprintf(stderr, "myclient ~ split_chunks(): failed to allocate %u chunk refs.\n", cap);
+		return -1;
+	}
+
+	for (off_t off = 0; off < size; ) {
+		struct chunk_ref *chunk = &(*chunks)[(*count)++];
+
+		chunk->off = off;
+		chunk->len = cdc_chunk_len(buf + off, size - off);
+		chunk_hash(buf + off, chunk->len, chunk->hash);
+
+		off += chunk->len;
+	}
+
+	return 0;
+}
+
+// open chunk store under root_folder_path, creating its directory
+// return pointer to store on success, NULL on error
+struct chunk_store *init_chunk_store(const char *root_folder_path) {
+	struct chunk_store *store = malloc(sizeof(struct chunk_store));
+	if (store == NULL) {
+		fprintf(stderr, "myserver ~ init_chunk_store(): failed to allocate chunk store.\n");
+		return NULL;
+	}
+
+	store->dir = malloc(strlen(root_folder_path) + strlen(CHUNK_STORE_DIR) + 1);
+	if (store->dir == NULL) {
+		fprintf(stderr, "myserver ~ init_chunk_store(): failed to allocate chunk store path.\n");
+		free(store);
+		return NULL;
+	}
+
+	sprintf(store->dir, "%s%s", root_folder_path, CHUNK_STORE_DIR);
+
+	if (create_file_directory(store->dir) < 0) {
+		fprintf(stderr, "myserver ~ init_chunk_store(): failed to create chunk store directory %s.\n", store->dir);
+		free(store->dir);
+		free(store);
+		return NULL;
+	}
+
+	pthread_once(&gear_once, init_gear);
+
+	return store;
+}
+
+// free store
+void free_chunk_store(struct chunk_store **store) {
+	free((*store)->dir);
+	free(*store);
+
+	*store = NULL;
+}
+
+// path of the chunk with hash in store, written into buf
+void chunk_file_path(struct chunk_store *store, const u_int8_t *hash, char *buf, size_t buf_sz) {
+	int n = snprintf(buf, buf_sz, "%s", store->dir);
+
+	for (int i = 0; i < CHUNK_HASH_SIZE && n + 2 < (int)buf_sz; i++) {
+		n += snprintf(buf + n, buf_sz - n, "%02x", hash[i]);
+	}
+}
+
+// return true if store holds the chunk with hash
+bool chunk_store_has(struct chunk_store *store, const u_int8_t *hash) {
+	char path[strlen(store->dir) + 2 * CHUNK_HASH_SIZE + 1];
+	chunk_file_path(store, hash, path, sizeof(path));
+
+	struct stat st;
+
+	return stat(path, &st) == 0;
+}
+
+// add len byte chunk with hash to store, written to a temp file and renamed into place so readers never see part of it
+// return 0 on success, -1 on error
+int chunk_store_put(struct chunk_store *store, const u_int8_t *hash, const u_int8_t *data, u_int32_t len) {
+	char path[strlen(store->dir) + 2 * CHUNK_HASH_SIZE + 1];
+	chunk_file_path(store, hash, path, sizeof(path));
+
+	// workers ingesting the same chunk each write their own temp file, whichever rename lands last wins with the same bytes
+	char tmp_path[sizeof(path) + 32];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp-%lx", path, (unsigned long)pthread_self());
+
+	int fd = open(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, 0664);
+	if (fd < 0) {
+		fprintf(stderr, "myserver ~ chunk_store_put(): failed to open %s: %s\n", tmp_path, strerror(errno));
+		return -1;
+	}
+
+	if (len > 0 && pwrite_n_bytes(fd, (char *)data, len, 0) < 0) {
+		fprintf(stderr, "myserver ~ chunk_store_put(): encountered error writing %s.\n", tmp_path);
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+
+	close(fd);
+
+	if (rename(tmp_path, path) < 0) {
+		fprintf(stderr, "myserver ~ chunk_store_put(): failed to move %s into place: %s\n", tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+// split the file open on fd into chunks and add those store doesn't hold yet
+// bytes of new chunks are put in *new_bytes
+// return number of new chunks, -1 on error
+int chunk_store_ingest(struct chunk_store *store, int fd, off_t *new_bytes) {
+	*new_bytes = 0;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "myserver ~ chunk_store_ingest(): encountered error getting outfile size: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (st.st_size == 0) return 0;
+
+	u_int8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "myserver ~ chunk_store_ingest(): encountered error mapping outfile: %s\n", strerror(errno));
+		return -1;
+	}
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	int added = 0;
+	u_int8_t hash[CHUNK_HASH_SIZE];
+
+	for (off_t off = 0; off < st.st_size; ) {
+		u_int32_t len = cdc_chunk_len(map + off, st.st_size - off);
+		chunk_hash(map + off, len, hash);
+
+		if (!chunk_store_has(store, hash)) {
+			if (chunk_store_put(store, hash, map + off, len) < 0) {
+				fprintf(stderr, "myserver ~ chunk_store_ingest(): encountered error storing chunk at %lld.\n", (long long)off);
+				munmap(map, st.st_size);
+				return -1;
+			}
+
+			added ++;
+			*new_bytes += len;
+		}
+
+		off += len;
+	}
+
+	munmap(map, st.st_size);
+
+	return added;
+}
+
+// copy len byte chunk with hash from store to out_off of out_fd
+// return 0 on success, -1 if store doesn't hold it or on error
+int chunk_store_copy(struct chunk_store *store, const u_int8_t *hash, u_int32_t len, int out_fd, off_t out_off) {
+	char path[strlen(store->dir) + 2 * CHUNK_HASH_SIZE + 1];
+	chunk_file_path(store, hash, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "myserver ~ chunk_store_copy(): chunk store doesn't hold %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size != (off_t)len) {
+		fprintf(stderr, "myserver ~ chunk_store_copy(): chunk %s isn't the %u bytes asked for.\n", path, len);
+		close(fd);
+		return -1;
+	}
+
+	int res = copy_fd_range(fd, 0, out_fd, out_off, len);
+
+	close(fd);
+
+	return res;
+}
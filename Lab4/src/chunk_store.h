@@ -0,0 +1,68 @@
+#ifndef CHUNK_STORE_INCLUDE
+#define CHUNK_STORE_INCLUDE
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+#include "sha256.h"
+
+#define CHUNK_HASH_SIZE SHA256_SIZE									// chunks are named by their SHA-256, so clients can't forge or collide ids
+#define CDC_MIN_CHUNK 2048											// content defined chunks, boundaries move with the data so an insert only changes the chunks around it
+#define CDC_AVG_BITS 13												// a boundary every 2^this bytes past the minimum on average
+#define CDC_MAX_CHUNK (64 << 10)
+#define CHUNK_STORE_DIR ".chunks/"									// under the server's root folder
+
+// one content defined chunk of a file
+struct chunk_ref {
+	off_t off;
+	u_int32_t len;
+	u_int8_t hash[CHUNK_HASH_SIZE];
+};
+
+// unique chunks of every finished outfile, one file per chunk named by its hash
+// a copy kept beside the outfiles to cut the bytes later transfers send, not the disk they use
+// the directory is the index, so every worker can share it without a lock
+struct chunk_store {
+	char *dir;
+};
+
+// fill the gear table the chunk boundaries are found with, run once per process
+void init_gear(void);
+
+// length of the content defined chunk at the start of left bytes at buf
+u_int32_t cdc_chunk_len(const u_int8_t *buf, off_t left);
+
+// hash of len bytes at buf, put in hash
+void chunk_hash(const u_int8_t *buf, u_int32_t len, u_int8_t *hash);
+
+// split size bytes at buf into content defined chunks, *chunks is allocated and freed by the caller
+// return 0 on success, -1 on error
+int split_chunks(const u_int8_t *buf, off_t size, struct chunk_ref **chunks, u_int32_t *count);
+
+// open chunk store under root_folder_path, creating its directory
+// return pointer to store on success, NULL on error
+struct chunk_store *init_chunk_store(const char *root_folder_path);
+
+// free store
+void free_chunk_store(struct chunk_store **store);
+
+// path of the chunk with hash in store, written into buf
+void chunk_file_path(struct chunk_store *store, const u_int8_t *hash, char *buf, size_t buf_sz);
+
+// return true if store holds the chunk with hash
+bool chunk_store_has(struct chunk_store *store, const u_int8_t *hash);
+
+// add len byte chunk with hash to store, written to a temp file and renamed into place so readers never see part of it
+// return 0 on success, -1 on error
+int chunk_store_put(struct chunk_store *store, const u_int8_t *hash, const u_int8_t *data, u_int32_t len);
+
+// split the file open on fd into chunks and add those store doesn't hold yet
+// bytes of new chunks are put in *new_bytes
+// return number of new chunks, -1 on error
+int chunk_store_ingest(struct chunk_store *store, int fd, off_t *new_bytes);
+
+// copy len byte chunk with hash from store to out_off of out_fd
+// return 0 on success, -1 if store doesn't hold it or on error
+int chunk_store_copy(struct chunk_store *store, const u_int8_t *hash, u_int32_t len, int out_fd, off_t out_off);
+
+#endif
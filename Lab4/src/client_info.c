@@ -9,60 +9,129 @@
 #include "client_info.h"
 #include "utils.h"
 
-// initialize client array and set default values for client_info entries
-// return pointer to client array of length max_client_count, or NULL on error
-struct client_info *init_clients(u_int32_t max_client_count) {
-	struct client_info *clients = calloc(sizeof(struct client_info), max_client_count);
+// initialize empty client table for worker shard
+// return pointer to client table, or NULL on error
+struct client_table *init_client_table(int shard) {
+	struct client_table *table = malloc(sizeof(struct client_table));
+	if (table == NULL) {
+		fprintf(stderr, "myserver ~ init_client_table(): encountered an error allocating client table.\n");
+		return NULL;
+	}
 
-	if (clients == NULL) {
-		fprintf(stderr, "myserver ~ init_clients(): encountered an error initializing client array.\n");
+	table->segments = calloc(START_CLIENT_SEGMENTS, sizeof(struct client_info *));
+	if (table->segments == NULL) {
+		fprintf(stderr, "myserver ~ init_client_table(): encountered an error allocating client segment array.\n");
+		free(table);
 		return NULL;
 	}
 
-	for (u_int32_t i = 0; i < max_client_count; i++) {
-		struct client_info *client = &(clients[i]);
-		client->is_active = false;
-		client->outfile_path = NULL;
+	table->segment_count = 0;
+	table->segment_cap = START_CLIENT_SEGMENTS;
+	table->slot_count = 0;
+	table->free_head = 0;
+	table->shard = shard;
+
+	return table;
+}
+
+// free every segment and the table itself, clients must already be terminated
+void free_client_table(struct client_table **table) {
+	for (u_int32_t i = 0; i < (*table)->segment_count; i++) {
+		free((*table)->segments[i]);
+	}
+
+	free((*table)->segments);
+	free(*table);
+
+	*table = NULL;
+}
+
+// find client_info for slot_id, regardless of whether slot is in use
+// return client_info ptr, NULL if slot_id is out of range
+struct client_info *client_table_slot(struct client_table *table, u_int32_t slot_id) {
+	if (slot_id < 1 || slot_id > table->slot_count) {
+		return NULL;
 	}
 
-	return clients;
+	return &table->segments[(slot_id - 1) / CLIENT_SEGMENT_SIZE][(slot_id - 1) % CLIENT_SEGMENT_SIZE];
 }
 
-// reallocate client array with inc additional entries, initialize new entries
-// set new value of max_client_count, and set *clients to new ptr
+// add one segment of free slots to the table
 // return 0 on success, -1 on error
-int increase_client_cap(struct client_info **clients, u_int32_t *max_client_count, u_int32_t inc) {
-	if (clients == NULL || *clients == NULL) {
-		fprintf(stderr, "myserver ~ increase_client_cap(): invalid ptr passed to clients parameter.\n");
+int add_client_segment(struct client_table *table) {
+	if (table->slot_count + CLIENT_SEGMENT_SIZE > MAX_CLIENT_SLOTS) {
+		fprintf(stderr, "myserver ~ add_client_segment(): client table is full at %u slots.\n", table->slot_count);
 		return -1;
 	}
 
-	if (max_client_count == NULL) {
-		fprintf(stderr, "myserver ~ increase_client_cap(): null ptr passed to max_client_count.\n");
-		return -1;
+	// only the segment ptr array is ever reallocated, segments themselves stay put
+	if (table->segment_count == table->segment_cap) {
+		struct client_info **segments = realloc(table->segments, 2 * table->segment_cap * sizeof(struct client_info *));
+		if (segments == NULL) {
+			fprintf(stderr, "myserver ~ add_client_segment(): encountered an error growing segment array to %u.\n", 2 * table->segment_cap);
+			return -1;
+		}
+
+		table->segments = segments;
+		table->segment_cap *= 2;
 	}
 
-	u_int32_t new_client_count = *max_client_count + inc;
-	struct client_info *new_clients = realloc(*clients, new_client_count);
-	
-	if (new_clients == NULL) {
-		fprintf(stderr, "myserver ~ increase_client_cap(): encountered an error reallocating client array to size %u.\n", new_client_count);
+	struct client_info *segment = calloc(CLIENT_SEGMENT_SIZE, sizeof(struct client_info));
+	if (segment == NULL) {
+		fprintf(stderr, "myserver ~ add_client_segment(): encountered an error allocating client segment.\n");
 		return -1;
 	}
 
-	// init new client spaces
-	for (u_int32_t i = *max_client_count; i < new_client_count; i++) {
-		struct client_info *client = &(*clients)[i];
+	table->segments[table->segment_count++] = segment;
+
+	// push new slots so the lowest slot id is handed out first
+	u_int32_t first_slot_id = table->slot_count + 1;
+	table->slot_count += CLIENT_SEGMENT_SIZE;
+
+	for (u_int32_t i = CLIENT_SEGMENT_SIZE; i > 0; i--) {
+		struct client_info *client = &segment[i - 1];
 		client->is_active = false;
 		client->outfile_path = NULL;
+		client->in_use = false;
+		client->next_free = table->free_head;
+		table->free_head = first_slot_id + i - 1;
 	}
 
-	*max_client_count = new_client_count;
-	*clients = new_clients;
-
 	return 0;
 }
 
+// take slot from free list, adding a segment if the list is empty, and assign client id with a new generation
+// return client_info ptr with id set, NULL on error
+struct client_info *alloc_client(struct client_table *table) {
+	if (table->free_head == 0 && add_client_segment(table) < 0) {
+		fprintf(stderr, "myserver ~ alloc_client(): encountered an error adding client segment.\n");
+		return NULL;
+	}
+
+	u_int32_t slot_id = table->free_head;
+	struct client_info *client = client_table_slot(table, slot_id);
+
+	table->free_head = client->next_free;
+
+	client->next_free = 0;
+	client->in_use = true;
+	client->generation ++;
+	client->id = CLIENT_ID(client->generation, slot_id, table->shard);
+
+	return client;
+}
+
+// return client's slot to the front of the free list
+void release_client(struct client_table *table, struct client_info *client) {
+	if (!client->in_use) return;
+
+	client->in_use = false;
+	client->is_active = false;
+	client->handshaking = false;
+	client->next_free = table->free_head;
+	table->free_head = CLIENT_ID_SLOT(client->id);
+}
+
 // accept new client with id client_id writing to file outfile_path
 // open outfile and add client to clients with outfd
 // return 0 on success, -1 on failure
@@ -133,9 +202,9 @@ int client_info_init(struct client_info *client, u_int32_t client_id, char *outf
 	// set client_info values
 	client->is_active = false;
 	client->id = client_id;
-	client->expected_sn = client_id;
 	client->outfd = -1;
 	client->outfile_path = outfile_path;
+	client->path_holder = NULL;
 	client->sockaddr = sockaddr;
 	client->sockaddr_size = sizeof(client->sockaddr);
 	client->winsz = winsz;
@@ -143,7 +212,10 @@ int client_info_init(struct client_info *client, u_int32_t client_id, char *outf
 	client->ack_sent = false;
 	client->terminating = false;
 	client->handshaking = true;
-	client->waiting = false;
+
+	// timers are armed by the server, they were stopped when the slot was last released
+	init_timer(&client->ack_timer, client);
+	init_timer(&client->silence_timer, client);
 
 	// allocate s_pkt_info buffer
 	client->pkt_info = calloc(sizeof(struct s_pkt_info), client->pkt_count);
@@ -155,12 +227,64 @@ int client_info_init(struct client_info *client, u_int32_t client_id, char *outf
 	for (u_int32_t sn = 0; sn < client->pkt_count; sn++) {
 		struct s_pkt_info *pkt_info = &client->pkt_info[sn];
 
-		pkt_info->written = false;
-		pkt_info->file_idx = 0;
 		pkt_info->ackd = false;
+		pkt_info->received = false;
+		pkt_info->off = 0;
+		pkt_info->pyld_sz = 0;
 	}
 
-	client->expected_start_sn = 0;
+	// first DATA sn follows the handshake ACK, which carries the client id
+	client->expected_start_sn = (client_id + 1) % client->pkt_count;
+	client->expected_sn = client->expected_start_sn;
+	client->stream_idx = 0;
+	client->write_idx = 0;
+	client->pyld_fd = -1;
+
+	client->write_batch.count = 0;
+	client->write_batch.off = 0;
+	client->write_batch.bytes = 0;
+	client->write_batch.stage = NULL;
+	client->write_batch.stage_used = 0;
+	client->write_calls = 0;
+	client->write_pylds = 0;
+	client->writer = NULL;
+	client->writes_inflight = 0;
+	client->ack_deferred = false;
+	client->ack_ready = false;
+
+	// whole file until the WR says otherwise
+	client->range_tag = 0;
+	client->range_off = 0;
+	client->range_last = false;
+	client->file_size = 0;
+
+	client->resume_asked = false;
+	client->resuming = false;
+	client->in_mtime = 0;
+	client->in_crc = 0;
+	client->synced_idx = 0;
+	client->manifest_fd = -1;
+
+	client->delta = false;
+	client->basis_fd = -1;
+	client->spool_fd = -1;
+	client->applied_idx = 0;
+	client->basis_size = 0;
+	client->block_sz = 0;
+	client->delta_hdr_len = 0;
+	client->literal_left = 0;
+	client->delta_broken = false;
+
+	client->compress = false;
+
+	client->digest = 0;
+	client->peer_digest = 0;
+	client->peer_digest_known = false;
+	client->digest_mismatch = false;
+
+	client->dedup = false;
+	client->store = NULL;
+	client->pool = NULL;
 
 	return 0;
 }
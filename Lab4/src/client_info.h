@@ -1,44 +1,158 @@
 #ifndef CLIENT_INFO_INCLUDE
 #define CLIENT_INFO_INCLUDE
 
-#define MAX_CLIENTS_INCREASE 5
+#include <sys/uio.h>
+
+#include "timer_wheel.h"
+#include "delta.h"
+
+#define CLIENT_SEGMENT_SIZE 64										// client slots per table segment, segments never move once allocated
+#define START_CLIENT_SEGMENTS 4										// segment ptrs allocated up front, grown by doubling
+
+// client id layout, high to low: generation | slot id | shard
+#define SHARD_BITS 6												// server worker that owns the client
+#define GENERATION_BITS 8											// bumped each time a slot is reused, so stale ids are rejected
+#define SLOT_BITS (32 - GENERATION_BITS - SHARD_BITS)
+#define MAX_WORKERS (1 << SHARD_BITS)
+#define MAX_CLIENT_SLOTS ((1u << SLOT_BITS) - 1)					// slot ids start at 1 so client id 0 stays invalid
+#define CLIENT_ID(generation, slot_id, shard) (((u_int32_t)(generation) << (SLOT_BITS + SHARD_BITS)) | ((u_int32_t)(slot_id) << SHARD_BITS) | (u_int32_t)(shard))
+#define CLIENT_ID_SLOT(client_id) (((client_id) >> SHARD_BITS) & MAX_CLIENT_SLOTS)
+#define CLIENT_ID_SHARD(client_id) ((client_id) & (MAX_WORKERS - 1))
+
+#define WRITE_BATCH_PKTS 64											// contiguous payloads gathered into one pwritev() call, well under IOV_MAX
+#define WRITE_BATCH_BYTES (256 << 10)								// bytes gathered before the batch is written regardless
 
 struct s_pkt_info {
-	off_t file_idx;
-	bool written;
 	bool ackd;
+	bool received;		// payload was handed to the write batch at its offset, the prefix may not have reached it yet
+	u_int64_t off;		// offset of the payload in the client's stream
+	u_int32_t pyld_sz;
+};
+
+// payloads not yet written, contiguous in pyld_fd from off
+struct write_batch {
+	struct iovec iovs[WRITE_BATCH_PKTS];
+	struct pkt_buf *bufs[WRITE_BATCH_PKTS];	// receive buffer each payload pins, NULL if it was copied to stage
+	int count;
+	off_t off;
+	size_t bytes;
+	char *stage;				// WRITE_BATCH_BYTES for payloads that aren't in a receive buffer, allocated on first use
+	size_t stage_used;
 };
 
+struct path_holder;
+struct pkt_pool;
+struct disk_writer;
+
 struct client_info {
 	u_int32_t id;
 
 	char *outfile_path;	// only saving this so it can be freed
 	int outfd;
+	struct path_holder *path_holder;	// entry in the server path table, released on terminate
 
 	u_int32_t winsz;
 	u_int32_t pkt_count;
 	struct s_pkt_info *pkt_info;
-	u_int32_t expected_sn;
-	u_int32_t expected_start_sn;
+	u_int32_t expected_sn;			// first pkt not yet received, end of the contiguous prefix
+	u_int32_t expected_start_sn;	// first pkt not yet acked, start of the receive window
+	off_t stream_idx;				// bytes of the payload stream before expected_sn
+	off_t write_idx;				// bytes of the range the prefix covers, the last write_batch.bytes of them may still be batched
+	int pyld_fd;					// payloads land here at their offsets, outfd or a delta's spool
+	struct write_batch write_batch;	// written with one pwritev() before an ACK, checkpoint or terminate covers them
+	u_int64_t write_calls;			// pwritev() calls and payloads they wrote, reported on terminate
+	u_int64_t write_pylds;
+	struct disk_writer *writer;		// writer thread outfile's batches are handed to, NULL if the worker writes them itself
+	u_int32_t writes_inflight;		// batches handed to writer and not yet reaped
+	bool ack_deferred;				// ACK waits for the batches in flight, it's sent once they are all written
+	bool ack_ready;					// on the server's list of deferred ACKs to send
+
+	// range of the outfile this client writes, the whole file unless it is one stream of a split transfer
+	u_int32_t range_tag;			// shared by every stream of the transfer, 0 if not split
+	off_t range_off;				// outfile offset of the first payload byte
+	bool range_last;				// range ends at the end of the file, outfile is truncated there on terminate
+	off_t file_size;				// size of the whole file the client advertised, outfile is preallocated to it, 0 if unknown
+
+	// resume, progress of the range is checkpointed to a manifest next to outfile
+	bool resume_asked;				// WR set RANGE_FLAG_RESUME, honored once the client owns its path
+	bool resuming;					// picked up after bytes an earlier transfer left, handshake ACK says how many
+	u_int64_t in_mtime;				// infile the client sends from, with file_size, checked against the manifest before resuming
+	u_int32_t in_crc;				// crc32c of the first INFILE_PREFIX_BYTES of that infile
+	off_t synced_idx;				// write_idx as of the last checkpoint
+	int manifest_fd;				// opened at the first checkpoint, -1 until then
+
+	// delta, outfile is rebuilt in a temp file from its old contents and the client's delta stream, then renamed over it
+	bool delta;
+	int basis_fd;					// old outfile, -1 if there wasn't one
+	int spool_fd;					// unlinked file the delta stream is written to as it arrives, applied from in order, -1 if not a delta
+	off_t applied_idx;				// bytes of the delta stream applied from the spool, only moved by whoever writes the client's files
+	off_t basis_size;
+	u_int32_t block_sz;				// signature block size of the old outfile
+	u_int8_t delta_hdr[DELTA_MAX_HEADER_SIZE];	// header of the op being parsed, ops can span pkts
+	u_int32_t delta_hdr_len;
+	u_int32_t literal_left;			// bytes of the current literal still to come
+	bool delta_broken;				// stream referenced blocks the old outfile doesn't have, it is kept as it was
+
+	bool compress;					// client asked to compress payloads, accepted in the handshake ACK
+
+	u_int32_t digest;				// crc32c of the client's range of the finished outfile
+	u_int32_t peer_digest;			// client's digest of its range of infile, from its final DATA pkt
+	bool peer_digest_known;
+	bool digest_mismatch;			// outfile didn't end up as the client's infile, so it's never ingested
+
+	bool dedup;						// delta stream copies chunks from store rather than blocks of the old outfile
+	struct chunk_store *store;		// server's chunk store, NULL if it has none
+	struct pkt_pool *pool;			// receive buffers of the client's worker, batched payloads may pin them
 
 	struct sockaddr sockaddr;
 	socklen_t sockaddr_size;
+
+	u_int64_t last_recv_ms;			// when the last pkt from this client arrived
+	struct timer ack_timer;			// armed while new data is waiting to be acked
+	struct timer silence_timer;		// armed for the whole life of the client
 	
+	u_int8_t generation;
+	u_int32_t next_free;	// slot id of next free slot while on the free list, 0 ends the list
+	bool in_use;
+
 	bool ack_sent;
 	bool is_active;
 	bool terminating;
 	bool handshaking;
-	bool waiting;
 };
 
-// initialize client array and set default values for client_info entries
-// return pointer to client array of length *max_client_count, or NULL on error
-struct client_info *init_clients(u_int32_t max_client_count);
+// client slots split into fixed size segments, so client_info ptrs stay valid as the table grows
+// free slots are kept on a list threaded through client_info.next_free
+struct client_table {
+	struct client_info **segments;
+	u_int32_t segment_count;
+	u_int32_t segment_cap;
+	u_int32_t slot_count;
+	u_int32_t free_head;
+	int shard;
+};
+
+// initialize empty client table for worker shard
+// return pointer to client table, or NULL on error
+struct client_table *init_client_table(int shard);
+
+// free every segment and the table itself, clients must already be terminated
+void free_client_table(struct client_table **table);
+
+// find client_info for slot_id, regardless of whether slot is in use
+// return client_info ptr, NULL if slot_id is out of range
+struct client_info *client_table_slot(struct client_table *table, u_int32_t slot_id);
+
+// take slot from free list, adding a segment if the list is empty, and assign client id with a new generation
+// return client_info ptr with id set, NULL on error
+struct client_info *alloc_client(struct client_table *table);
+
+// return client's slot to the front of the free list
+void release_client(struct client_table *table, struct client_info *client);
 
-// reallocate client array with inc additional entries, initialize new entries
-// set new value of max_client_count, and set *clients to new ptr
+// add one segment of free slots to the table
 // return 0 on success, -1 on error
-int increase_client_cap(struct client_info **clients, u_int32_t *max_client_count, u_int32_t inc);
+int add_client_segment(struct client_table *table);
 
 // accept new client with id client_id writing to file outfile_path
 // return 0 on success, -1 on error
@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "protocol.h"
+#include "client_loop.h"
+#include "myclient.h"
+#include "utils.h"
+
+// open the socket every client of the loop sends from, bound to any port
+// return socket fd on success, -1 on error
+int init_loop_socket(void) {
+	struct sockaddr_in addr;
+
+	int sockfd = init_socket(&addr, NULL, 0, AF_INET, SOCK_DGRAM, IPPROTO_UDP, true);
+	if (sockfd < 0) {
+		fprintf(stderr, "myclient ~ init_loop_socket(): failed to initialize shared socket.\n");
+		return -1;
+	}
+
+	// best effort, the kernel caps these at its rmem/wmem max
+	int buf_size = LOOP_SOCK_BUF_SIZE;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+	setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+
+	return sockfd;
+}
+
+// hash of server ip and port
+u_int32_t hash_server_addr(struct sockaddr_in *addr) {
+	u_int32_t hash = addr->sin_addr.s_addr ^ ((u_int32_t)addr->sin_port << 16);
+
+	// murmur3 finalizer, neighbouring ips and ports spread over every bucket
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+// find client talking to the server at addr
+// return client ptr, NULL if no client talks to addr
+struct client *find_loop_client(struct client_loop *loop, struct sockaddr_in *addr) {
+	u_int32_t mask = loop->bucket_count - 1;
+
+	for (u_int32_t i = hash_server_addr(addr) & mask; loop->buckets[i] != NULL; i = (i + 1) & mask) {
+		struct sockaddr_in *serveraddr = (struct sockaddr_in *)&loop->buckets[i]->serveraddr;
+
+		if (serveraddr->sin_addr.s_addr == addr->sin_addr.s_addr && serveraddr->sin_port == addr->sin_port) {
+			return loop->buckets[i];
+		}
+	}
+
+	return NULL;
+}
+
+// add client to the address buckets, growing them past half full
+// return 0 on success, -1 on error or if another client already talks to the same server
+int add_loop_client(struct client_loop *loop, struct client *client) {
+	struct sockaddr_in *addr = (struct sockaddr_in *)&client->serveraddr;
+
+	if (find_loop_client(loop, addr) != NULL) {
+		fprintf(stderr, "myclient ~ add_loop_client(): server %s:%d is listed more than once, responses can't be told apart.\n", client->server.ip, client->server.port);
+		return -1;
+	}
+
+	if (2 * (loop->running + 1) > loop->bucket_count) {
+		u_int32_t new_count = loop->bucket_count * 2;
+
+		struct client **buckets = calloc(new_count, sizeof(struct client *));
+		if (buckets == NULL) {
+			fprintf(stderr, "myclient ~ add_loop_client(): failed to allocate %u client buckets.\n", new_count);
+			return -1;
+		}
+
+		for (u_int32_t i = 0; i < loop->bucket_count; i++) {
+			if (loop->buckets[i] == NULL) continue;
+
+			u_int32_t j = hash_server_addr((struct sockaddr_in *)&loop->buckets[i]->serveraddr) & (new_count - 1);
+			while (buckets[j] != NULL) j = (j + 1) & (new_count - 1);
+
+			buckets[j] = loop->buckets[i];
+		}
+
+		free(loop->buckets);
+		loop->buckets = buckets;
+		loop->bucket_count = new_count;
+	}
+
+	u_int32_t mask = loop->bucket_count - 1;
+	u_int32_t i = hash_server_addr(addr) & mask;
+	while (loop->buckets[i] != NULL) i = (i + 1) & mask;
+
+	loop->buckets[i] = client;
+	loop->running ++;
+
+	return 0;
+}
+
+// arm client's timer one rto from now
+void arm_rto_timer(struct client_loop *loop, struct client *client) {
+	timer_add(&loop->timers, &client->loop_timer, loop->now_ms + (client->rto_us + 999) / 1000);
+}
+
+// mark client done with exit code, stop its timer and give up its chunks if it failed
+void finish_loop_client(struct client_loop *loop, struct client *client, int exit_code) {
+	if (client->state == STATE_DONE) return;
+
+	client->state = STATE_DONE;
+	client->exit_code = exit_code;
+
+	timer_del(&loop->timers, &client->loop_timer);
+
+	if (exit_code == 0) {
+		report_cwnd(client);
+		report_checksum(client);
+		report_gso(client);
+	} else {
+		release_chunks(client, client->in_size);
+	}
+
+	loop->running --;
+}
+
+// (re)send client's WR, failing it once it's been resent too often
+// return 0 on success, -1 on error
+int send_loop_wr(struct client_loop *loop, struct client *client) {
+	if (client->wr_retransmits > 3) {
+		fprintf(stderr, "Reached max re-transmission limit IP %s\n", client->server.ip);
+		finish_loop_client(loop, client, 4);
+		return 0;
+	}
+
+	if (send_wr_pkt(client) < 0) {
+		fprintf(stderr, "myclient ~ send_loop_wr(): failed to send WR pkt to server.\n");
+		finish_loop_client(loop, client, 1);
+		return 0;
+	}
+
+	// only the first WR can be timed, a response to a resent one is ambiguous
+	if (client->wr_retransmits == 0) start_rtt_sample(client);
+
+	client->wr_retransmits ++;
+
+	fprintf(stderr, "Initial write request packet sent.\n");
+
+	client->state = STATE_HANDSHAKE;
+	arm_rto_timer(loop, client);
+
+	return 0;
+}
+
+// server accepted client's WR, ACK it and send the first window
+void start_loop_transfer(struct client_loop *loop, struct client *client) {
+	int res;
+	if ((res = complete_handshake(client)) != 0 || (res = send_window(client)) != 0) {
+		fprintf(stderr, "myclient ~ start_loop_transfer(): failed to start transfer to server %s:%d.\n", client->server.ip, client->server.port);
+		finish_loop_client(loop, client, res);
+		return;
+	}
+
+	client->state = STATE_SENDING;
+	arm_rto_timer(loop, client);
+}
+
+// drive client's state machine with res from process_server_response() or response_timeout()
+void step_loop_client(struct client_loop *loop, struct client *client, int res) {
+	if (res < 0) {
+		finish_loop_client(loop, client, 1);
+		return;
+	}
+
+	switch (client->state) {
+		case STATE_HANDSHAKE:
+		case STATE_BUSY:
+			if (res == 0) {
+				start_loop_transfer(loop, client);
+			} else if (res == 2) {
+				// accepting ACK comes whenever the path frees up
+				if (client->state != STATE_BUSY) fprintf(stderr, "Waiting for server to re-initiate handshake\n");
+
+				// WR gets 3 more tries once the server gets back to us, none of them timed
+				client->wr_retransmits = 1;
+				client->state = STATE_BUSY;
+				timer_add(&loop->timers, &client->loop_timer, loop->now_ms + TIMEOUT_SECS * 1000);
+			} else {
+				send_loop_wr(loop, client);
+			}
+			break;
+		case STATE_SENDING: {
+			bool done;
+			int step_res = send_file_step(client, res, &done);
+
+			if (step_res != 0) {
+				fprintf(stderr, "myclient ~ step_loop_client(): failed to send or receive file to/from server %s:%d.\n", client->server.ip, client->server.port);
+				finish_loop_client(loop, client, step_res);
+			} else if (done) {
+				finish_loop_client(loop, client, 0);
+			} else {
+				arm_rto_timer(loop, client);
+			}
+			break;
+		}
+		case STATE_DONE:
+			break;
+	}
+}
+
+// client's timer expired, either its rto or its wait for a BUSY server
+// return 0 on success, -1 on error
+int fire_loop_timer(struct timer *timer, void *arg) {
+	struct client_loop *loop = (struct client_loop *)arg;
+	struct client *client = (struct client *)timer->data;
+
+	if (client->state == STATE_BUSY) {
+		fprintf(stderr, "Never heard back from server.\n");
+		finish_loop_client(loop, client, 1);
+		return 0;
+	}
+
+	step_loop_client(loop, client, response_timeout(client));
+
+	return 0;
+}
+
+// drain the shared socket and hand each response to the client talking to its sender
+// return 0 on success, -1 on error
+int recv_loop_batch(struct client_loop *loop) {
+	struct loop_batch *lb = &loop->batch;
+
+	while (true) {
+		for (int i = 0; i < LOOP_BATCH_SIZE; i++) {
+			lb->msgs[i].msg_hdr.msg_namelen = sizeof(lb->addrs[i]);
+		}
+
+		int recv_res = recvmmsg(loop->sockfd, lb->msgs, LOOP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (recv_res < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+			if (errno == EINTR) continue;
+
+			fprintf(stderr, "myclient ~ recv_loop_batch(): encountered error with recvmmsg() call: %s\n", strerror(errno));
+			return -1;
+		}
+
+		loop->now_ms = monotonic_ms();
+
+		for (int i = 0; i < recv_res; i++) {
+			struct client *client = find_loop_client(loop, &lb->addrs[i]);
+
+			// stray pkt, or a late response to a client that has already finished
+			if (client == NULL || client->state == STATE_DONE) continue;
+
+			step_loop_client(loop, client, process_server_response(client, lb->bufs[i], lb->msgs[i].msg_len));
+		}
+
+		if (recv_res < LOOP_BATCH_SIZE) return 0;
+	}
+}
+
+// run every client to completion from this thread, clients must share sockfd
+// return exit code of the first client, or 6 if clients exited with different codes, -1 on error
+int run_client_loop(int sockfd, struct client **clients, u_int32_t client_count) {
+	struct client_loop *loop = malloc(sizeof(struct client_loop));
+	if (loop == NULL) {
+		fprintf(stderr, "myclient ~ run_client_loop(): failed to allocate client loop.\n");
+		return -1;
+	}
+
+	loop->sockfd = sockfd;
+	loop->running = 0;
+	loop->now_ms = monotonic_ms();
+	init_timer_wheel(&loop->timers, loop->now_ms);
+
+	loop->bucket_count = START_LOOP_BUCKETS;
+	loop->buckets = calloc(loop->bucket_count, sizeof(struct client *));
+	if (loop->buckets == NULL) {
+		fprintf(stderr, "myclient ~ run_client_loop(): failed to allocate client buckets.\n");
+		free(loop);
+		return -1;
+	}
+
+	for (int i = 0; i < LOOP_BATCH_SIZE; i++) {
+		loop->batch.iovecs[i].iov_base = loop->batch.bufs[i];
+		loop->batch.iovecs[i].iov_len = MAX_SRVR_RES_SIZE;
+
+		memset(&loop->batch.msgs[i], 0, sizeof(loop->batch.msgs[i]));
+		loop->batch.msgs[i].msg_hdr.msg_iov = &loop->batch.iovecs[i];
+		loop->batch.msgs[i].msg_hdr.msg_iovlen = 1;
+		loop->batch.msgs[i].msg_hdr.msg_name = &loop->batch.addrs[i];
+	}
+
+	loop->epfd = epoll_create1(0);
+	struct epoll_event event = { EPOLLIN, { .fd = sockfd } };
+
+	if (loop->epfd < 0 || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sockfd, &event) < 0) {
+		fprintf(stderr, "myclient ~ run_client_loop(): failed to set up epoll on shared socket: %s\n", strerror(errno));
+		if (loop->epfd >= 0) close(loop->epfd);
+		free(loop->buckets);
+		free(loop);
+		return -1;
+	}
+
+	int res = 0;
+
+	for (u_int32_t i = 0; i < client_count; i++) {
+		init_timer(&clients[i]->loop_timer, clients[i]);
+		clients[i]->wr_retransmits = 0;
+		clients[i]->state = STATE_HANDSHAKE;
+		clients[i]->exit_code = 0;
+
+		if (add_loop_client(loop, clients[i]) < 0) {
+			res = -1;
+			break;
+		}
+	}
+
+	// every client starts with its WR, the rest is driven by responses and timers
+	for (u_int32_t i = 0; res == 0 && i < client_count; i++) {
+		send_loop_wr(loop, clients[i]);
+	}
+
+	while (res == 0 && loop->running > 0) {
+		struct epoll_event events[1];
+
+		int epoll_res = epoll_wait(loop->epfd, events, 1, timer_wheel_next_timeout(&loop->timers, monotonic_ms()));
+		if (epoll_res < 0 && errno != EINTR) {
+			fprintf(stderr, "myclient ~ run_client_loop(): encountered error waiting on shared socket: %s\n", strerror(errno));
+			res = -1;
+			break;
+		}
+
+		if (epoll_res > 0 && recv_loop_batch(loop) < 0) {
+			res = -1;
+			break;
+		}
+
+		loop->now_ms = monotonic_ms();
+
+		if (timer_wheel_advance(&loop->timers, loop->now_ms, fire_loop_timer, loop) < 0) {
+			res = -1;
+			break;
+		}
+	}
+
+	// same exit code rules as joining one thread per server
+	if (res == 0) {
+		for (u_int32_t i = 0; i < client_count; i++) {
+			if (i == 0) {
+				res = clients[i]->exit_code;
+			} else if (res != clients[i]->exit_code) {
+				res = 6;
+			}
+		}
+	}
+
+	close(loop->epfd);
+	free(loop->buckets);
+	free(loop);
+
+	return res;
+}
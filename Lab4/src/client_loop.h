@@ -0,0 +1,87 @@
+#ifndef CLIENT_LOOP_INCLUDE
+#define CLIENT_LOOP_INCLUDE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "timer_wheel.h"
+
+#define LOOP_BATCH_SIZE 64											// responses drained from the shared socket per recvmmsg() call
+#define LOOP_SOCK_BUF_SIZE (8 << 20)								// every server's responses queue on one socket
+#define START_LOOP_BUCKETS 64
+
+struct client;
+
+// where a client is in its transfer, the loop only ever waits on the socket or the client's timer
+enum client_state {
+	STATE_HANDSHAKE,		// WR sent, waiting for the server to accept it
+	STATE_BUSY,				// server has another client on our path, waiting up to TIMEOUT_SECS for it to accept
+	STATE_SENDING,			// window sent, waiting for an ACK
+	STATE_DONE				// terminated or failed, exit_code says which
+};
+
+// datagrams received by one recvmmsg() call
+struct loop_batch {
+	struct mmsghdr msgs[LOOP_BATCH_SIZE];
+	struct iovec iovecs[LOOP_BATCH_SIZE];
+	struct sockaddr_in addrs[LOOP_BATCH_SIZE];
+	char bufs[LOOP_BATCH_SIZE][MAX_SRVR_RES_SIZE];
+};
+
+// every client driven by one thread over one socket, responses are matched to clients by server address
+struct client_loop {
+	int sockfd;
+	int epfd;
+	struct client **buckets;		// open addressed by server address
+	u_int32_t bucket_count;
+	u_int32_t running;				// clients not yet done
+	struct timer_wheel timers;
+	u_int64_t now_ms;
+	struct loop_batch batch;
+};
+
+// open the socket every client of the loop sends from, bound to any port
+// return socket fd on success, -1 on error
+int init_loop_socket(void);
+
+// hash of server ip and port
+u_int32_t hash_server_addr(struct sockaddr_in *addr);
+
+// find client talking to the server at addr
+// return client ptr, NULL if no client talks to addr
+struct client *find_loop_client(struct client_loop *loop, struct sockaddr_in *addr);
+
+// add client to the address buckets, growing them past half full
+// return 0 on success, -1 on error or if another client already talks to the same server
+int add_loop_client(struct client_loop *loop, struct client *client);
+
+// arm client's timer one rto from now
+void arm_rto_timer(struct client_loop *loop, struct client *client);
+
+// mark client done with exit code, stop its timer and give up its chunks if it failed
+void finish_loop_client(struct client_loop *loop, struct client *client, int exit_code);
+
+// (re)send client's WR, failing it once it's been resent too often
+// return 0 on success, -1 on error
+int send_loop_wr(struct client_loop *loop, struct client *client);
+
+// server accepted client's WR, ACK it and send the first window
+void start_loop_transfer(struct client_loop *loop, struct client *client);
+
+// drive client's state machine with res from process_server_response() or response_timeout()
+void step_loop_client(struct client_loop *loop, struct client *client, int res);
+
+// client's timer expired, either its rto or its wait for a BUSY server
+// return 0 on success, -1 on error
+int fire_loop_timer(struct timer *timer, void *arg);
+
+// drain the shared socket and hand each response to the client talking to its sender
+// return 0 on success, -1 on error
+int recv_loop_batch(struct client_loop *loop);
+
+// run every client to completion from this thread, clients must share sockfd
+// return exit code of the first client, or 6 if clients exited with different codes, -1 on error
+int run_client_loop(int sockfd, struct client **clients, u_int32_t client_count);
+
+#endif
@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "compress.h"
+
+// hash of the 4 bytes at the start of a candidate match
+u_int32_t lz_hash(u_int32_t seq) {
+	return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 4 bytes at p, as a native endian integer
+u_int32_t lz_read32(const u_int8_t *p) {
+	u_int32_t v;
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+// append one sequence to dst, literals followed by a match, match_len 0 for the last sequence which has none
+// return 0 on success, -1 if it doesn't fit in cap bytes
+int lz_emit(u_int8_t *dst, u_int32_t cap, u_int32_t *out, const u_int8_t *lit, u_int32_t lit_len, u_int32_t offset, u_int32_t match_len) {
+	// token, both length extensions, literals and offset at their largest
+	if ((u_int64_t)*out + 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1 > cap) return -1;
+
+	u_int32_t o = *out;
+	u_int8_t *token = &dst[o++];
+
+	// lengths of 15 and up spill into 255 valued bytes after the token
+	*token = (lit_len >= 15 ? 15 : lit_len) << 4;
+	if (lit_len >= 15) {
+		u_int32_t l = lit_len - 15;
+		for (; l >= 255; l -= 255) dst[o++] = 255;
+		dst[o++] = l;
+	}
+
+	memcpy(dst + o, lit, lit_len);
+	o += lit_len;
+
+	if (match_len > 0) {
+		dst[o++] = offset & 0xff;
+		dst[o++] = offset >> 8;
+
+		u_int32_t l = match_len - LZ_MIN_MATCH;
+		*token |= l >= 15 ? 15 : l;
+		if (l >= 15) {
+			for (l -= 15; l >= 255; l -= 255) dst[o++] = 255;
+			dst[o++] = l;
+		}
+	}
+
+	*out = o;
+
+	return 0;
+}
+
+// compress n bytes of src into at most cap bytes of dst
+// return compressed size, 0 if it doesn't fit, so the payload should go out as is
+u_int32_t lz_compress(const u_int8_t *src, u_int32_t n, u_int8_t *dst, u_int32_t cap) {
+	// last position each hashed sequence was seen at, a stale or colliding entry is caught by comparing the bytes
+	u_int32_t table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	u_int32_t anchor = 0;		// start of the literals not yet emitted
+	u_int32_t out = 0;
+	u_int32_t pos = 1;			// nothing before the first byte to match against
+	u_int32_t misses = 0;
+
+	u_int32_t start_limit = n > LZ_MATCH_LIMIT ? n - LZ_MATCH_LIMIT : 0;
+	u_int32_t end_limit = n > LZ_LAST_LITERALS ? n - LZ_LAST_LITERALS : 0;
+
+	while (pos < start_limit) {
+		u_int32_t seq = lz_read32(src + pos);
+		u_int32_t h = lz_hash(seq);
+		u_int32_t ref = table[h];
+		table[h] = pos;
+
+		if (pos - ref > LZ_MAX_OFFSET || lz_read32(src + ref) != seq) {
+			pos += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+
+			// pending literals alone already overflow dst
+			if (out + pos - anchor > cap) return 0;
+
+			continue;
+		}
+
+		misses = 0;
+
+		// grow the match forwards, then backwards over literals that match too
+		u_int32_t len = LZ_MIN_MATCH;
+		while (pos + len < end_limit && src[ref + len] == src[pos + len]) len ++;
+
+		while (pos > anchor && ref > 0 && src[pos - 1] == src[ref - 1]) {
+			pos --;
+			ref --;
+			len ++;
+		}
+
+		if (lz_emit(dst, cap, &out, src + anchor, pos - anchor, pos - ref, len) < 0) return 0;
+
+		pos += len;
+		anchor = pos;
+	}
+
+	if (lz_emit(dst, cap, &out, src + anchor, n - anchor, 0, 0) < 0) return 0;
+
+	return out;
+}
+
+// decompress n bytes of src into at most cap bytes of dst, every offset and length is checked against both buffers
+// return decompressed size, -1 if the block is malformed or doesn't fit
+int lz_decompress(const u_int8_t *src, u_int32_t n, u_int8_t *dst, u_int32_t cap) {
+	u_int32_t in = 0;
+	u_int32_t out = 0;
+
+	while (in < n) {
+		u_int8_t token = src[in++];
+
+		u_int32_t lit_len = token >> 4;
+		if (lit_len == 15) {
+			u_int8_t b;
+			do {
+				if (in >= n) return -1;
+				b = src[in++];
+				lit_len += b;
+			} while (b == 255);
+		}
+
+		if (lit_len > n - in || lit_len > cap - out) return -1;
+
+		memcpy(dst + out, src + in, lit_len);
+		in += lit_len;
+		out += lit_len;
+
+		// last sequence is literals only
+		if (in == n) break;
+
+		if (n - in < 2) return -1;
+
+		u_int32_t offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+
+		if (offset == 0 || offset > out) return -1;
+
+		u_int32_t match_len = token & 15;
+		if (match_len == 15) {
+			u_int8_t b;
+			do {
+				if (in >= n) return -1;
+				b = src[in++];
+				match_len += b;
+			} while (b == 255);
+		}
+		match_len += LZ_MIN_MATCH;
+
+		if (match_len > cap - out) return -1;
+
+		// a match can overlap the bytes it produces, so it's copied a byte at a time
+		for (u_int32_t i = 0; i < match_len; i++) dst[out + i] = dst[out - offset + i];
+		out += match_len;
+	}
+
+	return out;
+}
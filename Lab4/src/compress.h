@@ -0,0 +1,32 @@
+#ifndef COMPRESS_INCLUDE
+#define COMPRESS_INCLUDE
+
+#include <sys/types.h>
+
+// LZ4 block format, every DATA payload is compressed on its own so a lost pkt never holds up the ones after it
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5											// a block always ends in at least this many literals
+#define LZ_MATCH_LIMIT 12											// no match starts this close to the end of a block
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_SKIP_TRIGGER 5											// after 2^this misses in a row the scan starts skipping ahead, so random data passes quickly
+
+// hash of the 4 bytes at the start of a candidate match
+u_int32_t lz_hash(u_int32_t seq);
+
+// 4 bytes at p, as a native endian integer
+u_int32_t lz_read32(const u_int8_t *p);
+
+// append one sequence to dst, literals followed by a match, match_len 0 for the last sequence which has none
+// return 0 on success, -1 if it doesn't fit in cap bytes
+int lz_emit(u_int8_t *dst, u_int32_t cap, u_int32_t *out, const u_int8_t *lit, u_int32_t lit_len, u_int32_t offset, u_int32_t match_len);
+
+// compress n bytes of src into at most cap bytes of dst
+// return compressed size, 0 if it doesn't fit, so the payload should go out as is
+u_int32_t lz_compress(const u_int8_t *src, u_int32_t n, u_int8_t *dst, u_int32_t cap);
+
+// decompress n bytes of src into at most cap bytes of dst, every offset and length is checked against both buffers
+// return decompressed size, -1 if the block is malformed or doesn't fit
+int lz_decompress(const u_int8_t *src, u_int32_t n, u_int8_t *dst, u_int32_t cap);
+
+#endif
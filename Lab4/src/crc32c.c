@@ -0,0 +1,93 @@
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#include "crc32c.h"
+
+// slicing by 8, table k is the crc of a byte followed by k zero bytes
+u_int32_t crc32c_table[8][256];
+pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+// whichever of crc32c_hw() and crc32c_sw() this cpu runs
+u_int32_t (*crc32c_impl)(u_int32_t, const u_int8_t *, size_t) = crc32c_sw;
+
+// fill the lookup tables of the portable crc32c and pick the hardware one if the cpu has it, run once per process
+void init_crc32c(void) {
+	for (u_int32_t i = 0; i < 256; i++) {
+		u_int32_t crc = i;
+		for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+
+		crc32c_table[0][i] = crc;
+	}
+
+	for (u_int32_t i = 0; i < 256; i++) {
+		for (int k = 1; k < 8; k++) {
+			u_int32_t prev = crc32c_table[k - 1][i];
+			crc32c_table[k][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xff];
+		}
+	}
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) crc32c_impl = crc32c_hw;
+#endif
+}
+
+// crc32c of len bytes at buf without the crc32 instruction, eight bytes per step
+u_int32_t crc32c_sw(u_int32_t crc, const u_int8_t *buf, size_t len) {
+	crc = ~crc;
+
+	for (; len >= 8; len -= 8, buf += 8) {
+		u_int32_t lo;
+		u_int32_t hi;
+		memcpy(&lo, buf, 4);
+		memcpy(&hi, buf + 4, 4);
+
+		// tables are indexed by bytes in stream order, so the words are read little endian
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		lo = __builtin_bswap32(lo);
+		hi = __builtin_bswap32(hi);
+#endif
+		lo ^= crc;
+
+		crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^ crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+				crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^ crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+	}
+
+	for (; len > 0; len--, buf++) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *buf) & 0xff];
+
+	return ~crc;
+}
+
+#if defined(__x86_64__)
+// crc32c of len bytes at buf with SSE4.2's crc32 instruction
+__attribute__((target("sse4.2")))
+u_int32_t crc32c_hw(u_int32_t crc, const u_int8_t *buf, size_t len) {
+	// the build has no -O, so without register the crc round trips through the stack on every step; x86 loads unaligned words fine
+	register u_int64_t c = ~crc;
+	register const u_int8_t *end = buf + (len & ~(size_t)7);
+
+	for (; buf < end; buf += 8) c = _mm_crc32_u64(c, *(const u_int64_t *)buf);
+	len &= 7;
+
+	u_int32_t c32 = (u_int32_t)c;
+	for (; len > 0; len--, buf++) c32 = _mm_crc32_u8(c32, *buf);
+
+	return ~c32;
+}
+#else
+// crc32c of len bytes at buf with SSE4.2's crc32 instruction, which only x86-64 has, so the portable one stands in
+u_int32_t crc32c_hw(u_int32_t crc, const u_int8_t *buf, size_t len) {
+	return crc32c_sw(crc, buf, len);
+}
+#endif
+
+// crc32c of len bytes at buf, continuing crc, which is 0 for the first bytes
+u_int32_t crc32c(u_int32_t crc, const void *buf, size_t len) {
+	pthread_once(&crc32c_once, init_crc32c);
+
+	return crc32c_impl(crc, (const u_int8_t *)buf, len);
+}
@@ -0,0 +1,22 @@
+#ifndef CRC32C_INCLUDE
+#define CRC32C_INCLUDE
+
+#include <sys/types.h>
+#include <stddef.h>
+
+// Castagnoli polynomial, reflected, the one SSE4.2's crc32 instruction computes
+#define CRC32C_POLY 0x82f63b78
+
+// fill the lookup tables of the portable crc32c and pick the hardware one if the cpu has it, run once per process
+void init_crc32c(void);
+
+// crc32c of len bytes at buf without the crc32 instruction, eight bytes per step
+u_int32_t crc32c_sw(u_int32_t crc, const u_int8_t *buf, size_t len);
+
+// crc32c of len bytes at buf with SSE4.2's crc32 instruction
+u_int32_t crc32c_hw(u_int32_t crc, const u_int8_t *buf, size_t len);
+
+// crc32c of len bytes at buf, continuing crc, which is 0 for the first bytes
+u_int32_t crc32c(u_int32_t crc, const void *buf, size_t len);
+
+#endif
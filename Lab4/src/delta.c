@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "delta.h"
+
+#define STRONG_PRIME1 0x9e3779b185ebca87ull
+#define STRONG_PRIME2 0xc2b2ae3d27d4eb4full
+#define STRONG_PRIME3 0x165667b19e3779f9ull
+
+// rolling checksum of len bytes, low half is the byte sum and high half the weighted sum, both mod 2^16
+u_int32_t weak_sum(const u_int8_t *buf, u_int32_t len) {
+	u_int32_t a = 0, b = 0;
+
+	for (u_int32_t i = 0; i < len; i++) {
+		a += buf[i];
+		b += (len - i) * buf[i];
+	}
+
+	return (a & 0xffff) | (b << 16);
+}
+
+// slide weak checksum sum of a len byte window one byte, dropping out and taking in
+u_int32_t roll_weak_sum(u_int32_t sum, u_int8_t out, u_int8_t in, u_int32_t len) {
+	u_int32_t a = (sum & 0xffff) - out + in;
+	u_int32_t b = (sum >> 16) - len * out + a;
+
+	return (a & 0xffff) | (b << 16);
+}
+
+// rotate x left by r bits
+u_int64_t rotl64(u_int64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+// 64 bit hash of len bytes, confirms a weak checksum match
+// words are read little endian so client and server agree whatever their byte order
+u_int64_t strong_sum(const u_int8_t *buf, u_int32_t len) {
+	u_int64_t h = STRONG_PRIME3 ^ ((u_int64_t)len * STRONG_PRIME1);
+	u_int32_t i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		u_int64_t v = 0;
+		for (int j = 7; j >= 0; j--) v = (v << 8) | buf[i + j];
+
+		h ^= rotl64(v * STRONG_PRIME2, 31) * STRONG_PRIME1;
+		h = rotl64(h, 27) * STRONG_PRIME1 + STRONG_PRIME3;
+	}
+
+	for (; i < len; i++) {
+		h ^= buf[i] * STRONG_PRIME3;
+		h = rotl64(h, 11) * STRONG_PRIME1;
+	}
+
+	// final mix so every input bit reaches every output bit
+	h ^= h >> 33;
+	h *= STRONG_PRIME2;
+	h ^= h >> 29;
+	h *= STRONG_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+// signature block size for an old outfile of basis_size bytes
+u_int32_t delta_block_size(off_t basis_size) {
+	u_int32_t block_sz = DELTA_MIN_BLOCK;
+
+	// about sqrt(basis_size), balancing signature bytes against bytes resent around each change
+	while (block_sz < DELTA_MAX_BLOCK && (off_t)block_sz * block_sz < basis_size) block_sz <<= 1;
+
+	return block_sz;
+}
+
+// number of full blocks in basis_size bytes, a short last block is never matched
+u_int32_t delta_block_count(off_t basis_size, u_int32_t block_sz) {
+	if (block_sz == 0 || basis_size <= 0) return 0;
+
+	return (u_int32_t)(basis_size / block_sz);
+}
+
+// set up delta of in_size bytes at in against sig_count block signatures, delta takes ownership of sigs
+// return pointer to delta on success, NULL on error
+struct delta *init_delta(const u_int8_t *in, off_t in_size, struct block_sig *sigs, u_int32_t sig_count, u_int32_t block_sz) {
+	struct delta *delta = calloc(1, sizeof(struct delta));
+	if (delta == NULL) {
+		fprintf(stderr, "myclient ~ init_delta(): failed to allocate delta.\n");
+		return NULL;
+	}
+
+	delta->in = in;
+	delta->in_size = in_size;
+	delta->sigs = sigs;
+	delta->sig_count = sig_count;
+	delta->block_sz = block_sz;
+
+	// twice as many buckets as blocks keeps chains short
+	delta->bucket_bits = 4;
+	while (delta->bucket_bits < 30 && (1u << delta->bucket_bits) < 2 * sig_count) delta->bucket_bits ++;
+
+	delta->buckets = malloc(sizeof(int32_t) << delta->bucket_bits);
+	delta->chain = malloc(sizeof(int32_t) * (sig_count > 0 ? sig_count : 1));
+	if (delta->buckets == NULL || delta->chain == NULL) {
+		fprintf(stderr, "myclient ~ init_delta(): failed to allocate signature hash table for %u blocks.\n", sig_count);
+		free_delta(&delta);
+		return NULL;
+	}
+
+	memset(delta->buckets, 0xff, sizeof(int32_t) << delta->bucket_bits);
+
+	// pushed back to front, so each chain lists blocks in file order
+	for (u_int32_t i = sig_count; i > 0; i--) {
+		u_int32_t bucket = (sigs[i - 1].weak * 2654435761u) >> (32 - delta->bucket_bits);
+
+		delta->chain[i - 1] = delta->buckets[bucket];
+		delta->buckets[bucket] = (int32_t)(i - 1);
+	}
+
+	return delta;
+}
+
+// set up delta of in_size bytes at in against a chunk store, chunks the store holds (held[i]) become chunk ops and the rest literals
+// the whole stream is generated up front, delta takes ownership of chunks, which are freed on error too
+// return pointer to delta on success, NULL on error
+struct delta *init_dedup(const u_int8_t *in, off_t in_size, struct chunk_ref *chunks, u_int32_t chunk_count, const bool *held) {
+	struct delta *delta = init_delta(in, in_size, NULL, 0, DELTA_MIN_BLOCK);
+	if (delta == NULL) {
+		fprintf(stderr, "myclient ~ init_dedup(): failed to initialize delta.\n");
+		free(chunks);
+		return NULL;
+	}
+
+	delta->chunks = chunks;
+	delta->chunk_count = chunk_count;
+
+	// chunks the store lacks run together into literals
+	for (u_int32_t i = 0; i < chunk_count; i++) {
+		if (!held[i]) continue;
+
+		if (close_literal(delta, chunks[i].off) < 0 || add_delta_op(delta, DELTA_OP_CHUNK, chunks[i].off, chunks[i].len, i) < 0) {
+			fprintf(stderr, "myclient ~ init_dedup(): encountered error adding chunk op %u.\n", i);
+			free_delta(&delta);
+			return NULL;
+		}
+
+		delta->lit_start = chunks[i].off + chunks[i].len;
+	}
+
+	if (close_literal(delta, in_size) < 0) {
+		fprintf(stderr, "myclient ~ init_dedup(): encountered error closing the last literal.\n");
+		free_delta(&delta);
+		return NULL;
+	}
+
+	delta->scan_pos = in_size;
+	delta->done = true;
+
+	return delta;
+}
+
+// free delta, its ops and signatures
+void free_delta(struct delta **delta) {
+	free((*delta)->sigs);
+	free((*delta)->chunks);
+	free((*delta)->buckets);
+	free((*delta)->chain);
+	free((*delta)->ops);
+	free(*delta);
+
+	*delta = NULL;
+}
+
+// scan infile until at least want bytes of the delta stream can be sent, or the scan is done
+// return 0 on success, -1 on error
+int extend_delta(struct delta *delta, off_t want) {
+	u_int32_t block_sz = delta->block_sz;
+
+	while (!delta->done && delta->size < want) {
+		off_t pos = delta->scan_pos;
+
+		// no full window left to match, the rest of infile is literal
+		if (delta->sig_count == 0 || pos + block_sz > delta->in_size) {
+			if (close_copy_run(delta) < 0 || close_literal(delta, delta->in_size) < 0) {
+				fprintf(stderr, "myclient ~ extend_delta(): encountered error closing the last ops.\n");
+				return -1;
+			}
+
+			delta->scan_pos = delta->in_size;
+			delta->done = true;
+			break;
+		}
+
+		if (!delta->weak_valid) {
+			delta->weak = weak_sum(delta->in + pos, block_sz);
+			delta->weak_valid = true;
+		}
+
+		int64_t block = find_block(delta);
+
+		if (block >= 0) {
+			if (close_literal(delta, pos) < 0) {
+				fprintf(stderr, "myclient ~ extend_delta(): encountered error closing literal before block %lld.\n", (long long)block);
+				return -1;
+			}
+
+			bool joins = delta->run_open && (u_int32_t)block == delta->run_block + delta->run_count && (off_t)(delta->run_count + 1) * block_sz <= DELTA_MAX_RUN;
+
+			if (joins) {
+				delta->run_count ++;
+			} else {
+				if (close_copy_run(delta) < 0) {
+					fprintf(stderr, "myclient ~ extend_delta(): encountered error closing copy run.\n");
+					return -1;
+				}
+
+				delta->run_open = true;
+				delta->run_block = (u_int32_t)block;
+				delta->run_count = 1;
+			}
+
+			// matched window is skipped whole, the next one is summed from scratch
+			delta->scan_pos = pos + block_sz;
+			delta->lit_start = delta->scan_pos;
+			delta->weak_valid = false;
+			continue;
+		}
+
+		// byte at pos joins the literal
+		if (close_copy_run(delta) < 0) {
+			fprintf(stderr, "myclient ~ extend_delta(): encountered error closing copy run.\n");
+			return -1;
+		}
+
+		if (pos + 1 - delta->lit_start >= DELTA_MAX_LITERAL && close_literal(delta, pos + 1) < 0) {
+			fprintf(stderr, "myclient ~ extend_delta(): encountered error closing full literal.\n");
+			return -1;
+		}
+
+		if (pos + block_sz < delta->in_size) {
+			delta->weak = roll_weak_sum(delta->weak, delta->in[pos], delta->in[pos + block_sz], block_sz);
+		} else {
+			delta->weak_valid = false;
+		}
+
+		delta->scan_pos = pos + 1;
+	}
+
+	return 0;
+}
+
+// copy n bytes of the delta stream at pos into buf, every byte must already be within delta->size
+// return 0 on success, -1 on error
+int read_delta(struct delta *delta, off_t pos, char *buf, u_int32_t n) {
+	if (pos < 0 || pos + n > delta->size) {
+		fprintf(stderr, "myclient ~ read_delta(): %u bytes at %lld are past the %lld bytes of delta generated.\n", n, (long long)pos, (long long)delta->size);
+		return -1;
+	}
+
+	// last op starting at or before pos
+	u_int32_t lo = 0, hi = delta->op_count;
+	while (hi - lo > 1) {
+		u_int32_t mid = (lo + hi) / 2;
+
+		if (delta->ops[mid].stream_off <= pos) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	u_int8_t hdr[DELTA_MAX_HEADER_SIZE];
+
+	for (u_int32_t i = lo; n > 0; i++) {
+		struct delta_op *op = &delta->ops[i];
+
+		u_int32_t hdr_sz = encode_delta_op(delta, op, hdr);
+		off_t at = pos - op->stream_off;
+
+		// header bytes first, then a literal's bytes straight from infile
+		if (at < hdr_sz) {
+			u_int32_t len = hdr_sz - at < n ? hdr_sz - (u_int32_t)at : n;
+
+			memcpy(buf, hdr + at, len);
+			buf += len;
+			pos += len;
+			n -= len;
+			at += len;
+		}
+
+		if (op->type == DELTA_OP_LITERAL && n > 0) {
+			off_t lit_at = at - hdr_sz;
+			u_int32_t len = op->len - lit_at < n ? op->len - (u_int32_t)lit_at : n;
+
+			memcpy(buf, delta->in + op->in_off + lit_at, len);
+			buf += len;
+			pos += len;
+			n -= len;
+		}
+	}
+
+	return 0;
+}
+
+// weak checksum of the window at scan_pos belongs to a signature block, matched by its strong checksum as well
+// the block right after an open copy run is preferred, so the run keeps growing
+// return block index, -1 if no block matches
+int64_t find_block(struct delta *delta) {
+	u_int32_t bucket = (delta->weak * 2654435761u) >> (32 - delta->bucket_bits);
+
+	bool strong_done = false;
+	u_int64_t strong = 0;
+	int64_t found = -1;
+
+	for (int32_t i = delta->buckets[bucket]; i >= 0; i = delta->chain[i]) {
+		if (delta->sigs[i].weak != delta->weak) continue;
+
+		// only hashed once a weak checksum matches, most windows never get this far
+		if (!strong_done) {
+			strong = strong_sum(delta->in + delta->scan_pos, delta->block_sz);
+			strong_done = true;
+		}
+
+		if (delta->sigs[i].strong != strong) continue;
+
+		if (delta->run_open && (u_int32_t)i == delta->run_block + delta->run_count) return i;
+
+		if (found < 0) found = i;
+	}
+
+	return found;
+}
+
+// append closed op to the delta stream
+// return 0 on success, -1 on error
+int add_delta_op(struct delta *delta, u_int8_t type, off_t in_off, u_int32_t len, u_int32_t block) {
+	if (delta->op_count == delta->op_cap) {
+		u_int32_t cap = delta->op_cap == 0 ? 64 : 2 * delta->op_cap;
+
+		struct delta_op *ops = realloc(delta->ops, cap * sizeof(struct delta_op));
+		if (ops == NULL) {
+			fprintf(stderr, "myclient ~ add_delta_op(): failed to grow delta to %u ops.\n", cap);
+			return -1;
+		}
+
+		delta->ops = ops;
+		delta->op_cap = cap;
+	}
+
+	struct delta_op *op = &delta->ops[delta->op_count++];
+
+	op->type = type;
+	op->stream_off = delta->size;
+	op->in_off = in_off;
+	op->len = len;
+	op->block = block;
+
+	if (type == DELTA_OP_LITERAL) {
+		delta->size += DELTA_LITERAL_HEADER_SIZE + len;
+		delta->literal_bytes += len;
+	} else if (type == DELTA_OP_CHUNK) {
+		delta->size += DELTA_CHUNK_HEADER_SIZE;
+		delta->copied_bytes += len;
+	} else {
+		delta->size += DELTA_COPY_HEADER_SIZE;
+		delta->copied_bytes += (off_t)len * delta->block_sz;
+	}
+
+	return 0;
+}
+
+// close the open literal at end, in pieces of at most DELTA_MAX_LITERAL
+// return 0 on success, -1 on error
+int close_literal(struct delta *delta, off_t end) {
+	while (delta->lit_start < end) {
+		u_int32_t len = end - delta->lit_start < DELTA_MAX_LITERAL ? (u_int32_t)(end - delta->lit_start) : DELTA_MAX_LITERAL;
+
+		if (add_delta_op(delta, DELTA_OP_LITERAL, delta->lit_start, len, 0) < 0) {
+			fprintf(stderr, "myclient ~ close_literal(): encountered error adding literal op.\n");
+			return -1;
+		}
+
+		delta->lit_start += len;
+	}
+
+	return 0;
+}
+
+// close the open copy run, if there is one
+// return 0 on success, -1 on error
+int close_copy_run(struct delta *delta) {
+	if (!delta->run_open) return 0;
+
+	delta->run_open = false;
+
+	if (add_delta_op(delta, DELTA_OP_COPY, 0, delta->run_count, delta->run_block) < 0) {
+		fprintf(stderr, "myclient ~ close_copy_run(): encountered error adding copy op.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+// encode header of op of delta into hdr
+// return header size
+u_int32_t encode_delta_op(struct delta *delta, struct delta_op *op, u_int8_t *hdr) {
+	hdr[0] = op->type;
+
+	if (op->type == DELTA_OP_CHUNK) {
+		hdr[1] = (u_int8_t)(op->len >> 24);
+		hdr[2] = (u_int8_t)(op->len >> 16);
+		hdr[3] = (u_int8_t)(op->len >> 8);
+		hdr[4] = (u_int8_t)op->len;
+		memcpy(hdr + 5, delta->chunks[op->block].hash, CHUNK_HASH_SIZE);
+
+		return DELTA_CHUNK_HEADER_SIZE;
+	}
+
+	u_int32_t vals[2] = { op->type == DELTA_OP_COPY ? op->block : op->len, op->len };
+	u_int32_t fields = op->type == DELTA_OP_COPY ? 2 : 1;
+
+	for (u_int32_t i = 0; i < fields; i++) {
+		hdr[1 + 4 * i] = (u_int8_t)(vals[i] >> 24);
+		hdr[2 + 4 * i] = (u_int8_t)(vals[i] >> 16);
+		hdr[3 + 4 * i] = (u_int8_t)(vals[i] >> 8);
+		hdr[4 + 4 * i] = (u_int8_t)vals[i];
+	}
+
+	return op->type == DELTA_OP_COPY ? DELTA_COPY_HEADER_SIZE : DELTA_LITERAL_HEADER_SIZE;
+}
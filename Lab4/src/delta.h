@@ -0,0 +1,134 @@
+#ifndef DELTA_INCLUDE
+#define DELTA_INCLUDE
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+#include "chunk_store.h"
+
+// delta stream, sent as the DATA payload of a delta transfer in place of infile
+#define DELTA_OP_LITERAL 1											// length(4), then that many bytes of infile
+#define DELTA_OP_COPY 2												// first block(4), block count(4), copied from the server's old outfile
+#define DELTA_OP_CHUNK 3											// length(4), hash(16), copied from the server's chunk store
+#define DELTA_LITERAL_HEADER_SIZE 5
+#define DELTA_COPY_HEADER_SIZE 9
+#define DELTA_CHUNK_HEADER_SIZE (5 + CHUNK_HASH_SIZE)
+#define DELTA_MAX_HEADER_SIZE DELTA_CHUNK_HEADER_SIZE
+
+#define DELTA_MIN_BLOCK 2048										// block size is about the square root of the old outfile, clamped to these
+#define DELTA_MAX_BLOCK (128 << 10)
+#define DELTA_MAX_LITERAL (64 << 10)								// ops are cut at these sizes so the stream keeps growing while infile is scanned
+#define DELTA_MAX_RUN (64 << 20)
+
+// signature of one block of the server's old outfile
+struct block_sig {
+	u_int32_t weak;				// rolling checksum, cheap to slide along infile a byte at a time
+	u_int64_t strong;			// checked only when the weak checksum matches
+};
+
+// one op of the delta stream, its header is encoded when the bytes are sent
+struct delta_op {
+	u_int8_t type;				// DELTA_OP_LITERAL or DELTA_OP_COPY
+	off_t stream_off;			// offset of the op header in the delta stream
+	off_t in_off;				// literal, offset of its bytes in infile
+	u_int32_t len;				// literal or chunk bytes, or blocks copied
+	u_int32_t block;			// copy, first block, or chunk, its index in chunks
+};
+
+// delta of infile against the server's old outfile, generated as far ahead as the sender needs
+// the last literal or copy run is held open until nothing more can join it, only closed ops count towards size
+struct delta {
+	const u_int8_t *in;			// infile mapping
+	off_t in_size;
+
+	struct block_sig *sigs;
+	u_int32_t sig_count;
+	u_int32_t block_sz;
+
+	struct chunk_ref *chunks;	// content defined chunks of infile when deduplicating against a chunk store, NULL otherwise
+	u_int32_t chunk_count;
+
+	// weak checksum hash table, chained through block indexes
+	int32_t *buckets;
+	int32_t *chain;
+	u_int32_t bucket_bits;
+
+	struct delta_op *ops;
+	u_int32_t op_count;
+	u_int32_t op_cap;
+	off_t size;					// bytes of the delta stream that can be sent
+	bool done;					// whole infile has been scanned and every op closed
+
+	// scan state
+	off_t scan_pos;				// start of the window being matched
+	off_t lit_start;			// start of the open literal, scan_pos if there is none
+	u_int32_t weak;				// weak checksum of the window
+	bool weak_valid;
+	bool run_open;				// copy run waiting for more blocks
+	u_int32_t run_block;
+	u_int32_t run_count;
+
+	off_t literal_bytes;
+	off_t copied_bytes;
+};
+
+// rolling checksum of len bytes, low half is the byte sum and high half the weighted sum, both mod 2^16
+u_int32_t weak_sum(const u_int8_t *buf, u_int32_t len);
+
+// slide weak checksum sum of a len byte window one byte, dropping out and taking in
+u_int32_t roll_weak_sum(u_int32_t sum, u_int8_t out, u_int8_t in, u_int32_t len);
+
+// rotate x left by r bits
+u_int64_t rotl64(u_int64_t x, int r);
+
+// 64 bit hash of len bytes, confirms a weak checksum match
+u_int64_t strong_sum(const u_int8_t *buf, u_int32_t len);
+
+// signature block size for an old outfile of basis_size bytes
+u_int32_t delta_block_size(off_t basis_size);
+
+// number of full blocks in basis_size bytes, a short last block is never matched
+u_int32_t delta_block_count(off_t basis_size, u_int32_t block_sz);
+
+// set up delta of in_size bytes at in against sig_count block signatures, delta takes ownership of sigs
+// return pointer to delta on success, NULL on error
+struct delta *init_delta(const u_int8_t *in, off_t in_size, struct block_sig *sigs, u_int32_t sig_count, u_int32_t block_sz);
+
+// set up delta of in_size bytes at in against a chunk store, chunks the store holds (held[i]) become chunk ops and the rest literals
+// the whole stream is generated up front, delta takes ownership of chunks, which are freed on error too
+// return pointer to delta on success, NULL on error
+struct delta *init_dedup(const u_int8_t *in, off_t in_size, struct chunk_ref *chunks, u_int32_t chunk_count, const bool *held);
+
+// free delta, its ops and signatures
+void free_delta(struct delta **delta);
+
+// scan infile until at least want bytes of the delta stream can be sent, or the scan is done
+// return 0 on success, -1 on error
+int extend_delta(struct delta *delta, off_t want);
+
+// copy n bytes of the delta stream at pos into buf, every byte must already be within delta->size
+// return 0 on success, -1 on error
+int read_delta(struct delta *delta, off_t pos, char *buf, u_int32_t n);
+
+// weak checksum of the window at scan_pos belongs to a signature block, matched by its strong checksum as well
+// the block right after an open copy run is preferred, so the run keeps growing
+// return block index, -1 if no block matches
+int64_t find_block(struct delta *delta);
+
+// append closed op to the delta stream
+// return 0 on success, -1 on error
+int add_delta_op(struct delta *delta, u_int8_t type, off_t in_off, u_int32_t len, u_int32_t block);
+
+// close the open literal at end, in pieces of at most DELTA_MAX_LITERAL
+// return 0 on success, -1 on error
+int close_literal(struct delta *delta, off_t end);
+
+// close the open copy run, if there is one
+// return 0 on success, -1 on error
+int close_copy_run(struct delta *delta);
+
+// encode header of op of delta into hdr
+// return header size
+u_int32_t encode_delta_op(struct delta *delta, struct delta_op *op, u_int8_t *hdr);
+
+#endif
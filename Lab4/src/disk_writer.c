@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "disk_writer.h"
+#include "utils.h"
+
+// start count writer threads, completed jobs are handed to reap with reap_arg as they are reaped
+// return pointer to writer pool on success, NULL on error
+struct writer_pool *init_writer_pool(int count, write_job_fn reap, void *reap_arg) {
+	if (count < 1 || count > MAX_DISK_WRITERS) {
+		fprintf(stderr, "myserver ~ init_writer_pool(): writer count must be between 1 and %d.\n", MAX_DISK_WRITERS);
+		return NULL;
+	}
+
+	struct writer_pool *pool = malloc(sizeof(struct writer_pool));
+	if (pool == NULL) {
+		fprintf(stderr, "myserver ~ init_writer_pool(): failed to allocate writer pool.\n");
+		return NULL;
+	}
+
+	pool->writers = calloc(count, sizeof(struct disk_writer));
+	if (pool->writers == NULL) {
+		fprintf(stderr, "myserver ~ init_writer_pool(): failed to allocate %d writers.\n", count);
+		free(pool);
+		return NULL;
+	}
+
+	pool->count = 0;
+	pool->reap = reap;
+	pool->reap_arg = reap_arg;
+
+	// worker polls it, so it must never block
+	pool->done_fd = eventfd(0, EFD_NONBLOCK);
+	if (pool->done_fd < 0) {
+		fprintf(stderr, "myserver ~ init_writer_pool(): failed to create completion eventfd: %s\n", strerror(errno));
+		free(pool->writers);
+		free(pool);
+		return NULL;
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct disk_writer *writer = &pool->writers[i];
+
+		atomic_init(&writer->submitted, 0);
+		atomic_init(&writer->done, 0);
+		atomic_init(&writer->stop, false);
+		writer->reaped = 0;
+		writer->pool = pool;
+
+		// writer sleeps in read() on it while its ring is empty
+		writer->wake_fd = eventfd(0, 0);
+		if (writer->wake_fd < 0) {
+			fprintf(stderr, "myserver ~ init_writer_pool(): failed to create wakeup eventfd: %s\n", strerror(errno));
+			free_writer_pool(&pool);
+			return NULL;
+		}
+
+		if (pthread_create(&writer->thread, NULL, &run_disk_writer, writer) != 0) {
+			fprintf(stderr, "myserver ~ init_writer_pool(): failed to spawn writer thread %d.\n", i);
+			close(writer->wake_fd);
+			free_writer_pool(&pool);
+			return NULL;
+		}
+
+		pool->count ++;
+	}
+
+	return pool;
+}
+
+// stop every writer once its ring is empty and free the pool, every job must already be reaped
+void free_writer_pool(struct writer_pool **pool) {
+	for (int i = 0; i < (*pool)->count; i++) {
+		struct disk_writer *writer = &(*pool)->writers[i];
+		u_int64_t kick = 1;
+
+		atomic_store(&writer->stop, true);
+		if (write(writer->wake_fd, &kick, sizeof(kick)) < 0) {
+			fprintf(stderr, "myserver ~ free_writer_pool(): failed to wake writer %d: %s\n", i, strerror(errno));
+		}
+
+		pthread_join(writer->thread, NULL);
+		close(writer->wake_fd);
+	}
+
+	close((*pool)->done_fd);
+	free((*pool)->writers);
+	free(*pool);
+
+	*pool = NULL;
+}
+
+// write, and sync for a checkpoint, one job's batch, then run its task
+// runs on the writer thread, so it only touches the job's fds and buffers, and the client state its task owns
+void run_write_job(struct write_job *job) {
+	job->res = 0;
+	job->sync_res = 0;
+	job->task_res = 0;
+	job->reply_sz = 0;
+
+	if (job->count > 0 && pwritev_n_bytes(job->fd, job->iovs, job->count, job->off) < 0) {
+		fprintf(stderr, "myserver ~ run_write_job(): encountered error writing %zu bytes at %lld: %s\n", job->bytes, (long long)job->off, strerror(errno));
+		job->res = -1;
+		return;
+	}
+
+	// bytes have to be on disk before the record claims them
+	if (job->record_fd >= 0 && (fdatasync(job->fd) < 0 || (job->seal != NULL && job->seal(job->fd, job->record) < 0) || pwrite_n_bytes(job->record_fd, job->record, job->record_sz, 0) < 0 || fdatasync(job->record_fd) < 0)) {
+		fprintf(stderr, "myserver ~ run_write_job(): encountered error checkpointing: %s\n", strerror(errno));
+		job->sync_res = -1;
+	}
+
+	if (job->task != NULL && job->task(job) < 0) {
+		fprintf(stderr, "myserver ~ run_write_job(): encountered error running task after %zu byte write.\n", job->bytes);
+		job->task_res = -1;
+	}
+}
+
+// writer thread, runs jobs in the order they were submitted until the pool is freed
+void *run_disk_writer(void *writer_arg) {
+	struct disk_writer *writer = writer_arg;
+
+	while (1) {
+		u_int32_t done = atomic_load_explicit(&writer->done, memory_order_relaxed);
+
+		// ring empty, a kick that arrived since the last check leaves the eventfd readable
+		if (done == atomic_load_explicit(&writer->submitted, memory_order_acquire)) {
+			if (atomic_load(&writer->stop)) break;
+
+			u_int64_t kicks;
+			if (read(writer->wake_fd, &kicks, sizeof(kicks)) < 0 && errno != EINTR) {
+				fprintf(stderr, "myserver ~ run_disk_writer(): encountered error waiting for jobs: %s\n", strerror(errno));
+				exit(1);
+			}
+
+			continue;
+		}
+
+		run_write_job(&writer->jobs[done % WRITER_RING_SIZE]);
+
+		atomic_store_explicit(&writer->done, done + 1, memory_order_release);
+
+		u_int64_t kick = 1;
+		if (write(writer->pool->done_fd, &kick, sizeof(kick)) < 0) {
+			fprintf(stderr, "myserver ~ run_disk_writer(): encountered error signalling completed job: %s\n", strerror(errno));
+			exit(1);
+		}
+	}
+
+	return NULL;
+}
+
+// next free job of writer's ring, to be filled in and then submitted
+// return job ptr, NULL if the ring is full
+struct write_job *writer_job_slot(struct disk_writer *writer) {
+	u_int32_t submitted = atomic_load_explicit(&writer->submitted, memory_order_relaxed);
+	if (submitted - writer->reaped == WRITER_RING_SIZE) return NULL;
+
+	return &writer->jobs[submitted % WRITER_RING_SIZE];
+}
+
+// hand the job filled in from writer_job_slot() to the writer thread
+// return 0 on success, -1 on error
+int writer_submit(struct disk_writer *writer) {
+	atomic_fetch_add_explicit(&writer->submitted, 1, memory_order_release);
+
+	u_int64_t kick = 1;
+	if (write(writer->wake_fd, &kick, sizeof(kick)) < 0) {
+		fprintf(stderr, "myserver ~ writer_submit(): failed to wake writer: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+// reap every job the pool's writers have completed, in order per writer
+// return jobs reaped
+int writer_pool_reap(struct writer_pool *pool) {
+	int reaped = 0;
+
+	for (int i = 0; i < pool->count; i++) {
+		struct disk_writer *writer = &pool->writers[i];
+		u_int32_t done = atomic_load_explicit(&writer->done, memory_order_acquire);
+
+		// slot only goes back to the ring once reap is done with it
+		while (writer->reaped != done) {
+			pool->reap(&writer->jobs[writer->reaped % WRITER_RING_SIZE], pool->reap_arg);
+			writer->reaped ++;
+			reaped ++;
+		}
+	}
+
+	return reaped;
+}
+
+// sleep until a writer completes another job
+// return 0 on success, -1 on error
+int writer_pool_wait(struct writer_pool *pool) {
+	struct pollfd fds[1] = { { pool->done_fd, POLLIN, 0 } };
+
+	while (poll(fds, 1, -1) < 0) {
+		if (errno == EINTR) continue;
+
+		fprintf(stderr, "myserver ~ writer_pool_wait(): encountered error waiting for writers: %s\n", strerror(errno));
+		return -1;
+	}
+
+	writer_pool_clear(pool);
+
+	return 0;
+}
+
+// reset done_fd once poll() has seen it, the jobs themselves are reaped with writer_pool_reap()
+void writer_pool_clear(struct writer_pool *pool) {
+	u_int64_t kicks;
+
+	// nonblocking, nothing to read just means another call got there first
+	if (read(pool->done_fd, &kicks, sizeof(kicks)) < 0 && errno != EAGAIN) {
+		fprintf(stderr, "myserver ~ writer_pool_clear(): encountered error reading completion eventfd: %s\n", strerror(errno));
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef DISK_WRITER_INCLUDE
+#define DISK_WRITER_INCLUDE
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "client_info.h"
+
+#define MAX_DISK_WRITERS 16											// writer threads per server worker
+#define WRITER_RING_SIZE 32											// jobs a writer can have queued or waiting to be reaped, power of two
+#define WRITE_JOB_RECORD_SIZE 48									// max bytes of the record a checkpoint job rewrites
+#define WRITE_JOB_REPLY_SIZE 1029									// max bytes of the pkt a job builds, a whole server response
+
+// called on the writer once a checkpoint job's fd is synced, to finish the record before it's written
+// return 0 on success, -1 on error
+typedef int (*write_record_fn)(int fd, char *record);
+
+struct write_job;
+
+// called on the writer once a job's batch is written, and synced for a checkpoint, with the job's client its to use
+// return 0 on success, -1 on error
+typedef int (*write_task_fn)(struct write_job *job);
+
+// one write batch handed to a writer thread, and how it went
+struct write_job {
+	int fd;
+	off_t off;
+	struct iovec iovs[WRITE_BATCH_PKTS];
+	int count;
+	size_t bytes;
+
+	// checkpoint, fd is synced after the write and record then rewritten at the start of record_fd
+	int record_fd;					// -1 if the job is only a write
+	char record[WRITE_JOB_RECORD_SIZE];
+	size_t record_sz;
+	write_record_fn seal;			// NULL if the record is written as is
+
+	write_task_fn task;				// NULL if the job is only a write or a checkpoint
+	u_int64_t task_arg;				// what the task works up to or on, a stream offset or a SIG index
+
+	// pkt the task built, sent to the job's client once it is reaped
+	char reply[WRITE_JOB_REPLY_SIZE];
+	int reply_sz;					// 0 if there's nothing to send
+
+	int res;						// -1 if the write failed
+	int sync_res;					// -1 if the checkpoint failed
+	int task_res;					// -1 if the task failed
+
+	// only touched by the worker, before the job is submitted and once it is reaped
+	struct client_info *client;
+	struct pkt_buf *bufs[WRITE_BATCH_PKTS];
+	char *stage;					// batch stage handed over with the job, NULL if none of its payloads were copied
+};
+
+struct writer_pool;
+
+// single producer single consumer ring between a server worker and one writer thread
+// the worker fills jobs[submitted], the writer completes jobs[done], and the worker reaps jobs[reaped]
+// indices only ever grow, a slot is free again once it's reaped
+struct disk_writer {
+	struct write_job jobs[WRITER_RING_SIZE];
+	_Atomic u_int32_t submitted;
+	_Atomic u_int32_t done;
+	u_int32_t reaped;				// worker only
+	int wake_fd;					// eventfd the worker kicks after submitting
+	atomic_bool stop;
+	struct writer_pool *pool;
+	pthread_t thread;
+};
+
+// called on the worker for each completed job as it is reaped
+typedef void (*write_job_fn)(struct write_job *job, void *arg);
+
+// writer threads of one server worker, each client's outfile is only ever written by one of them
+struct writer_pool {
+	struct disk_writer *writers;
+	int count;
+	int done_fd;					// eventfd kicked after every completed job, polled by the worker next to its socket
+	write_job_fn reap;
+	void *reap_arg;
+};
+
+// start count writer threads, completed jobs are handed to reap with reap_arg as they are reaped
+// return pointer to writer pool on success, NULL on error
+struct writer_pool *init_writer_pool(int count, write_job_fn reap, void *reap_arg);
+
+// stop every writer once its ring is empty and free the pool, every job must already be reaped
+void free_writer_pool(struct writer_pool **pool);
+
+// write, and sync for a checkpoint, one job's batch, then run its task
+// runs on the writer thread, so it only touches the job's fds and buffers, and the client state its task owns
+void run_write_job(struct write_job *job);
+
+// writer thread, runs jobs in the order they were submitted until the pool is freed
+void *run_disk_writer(void *writer);
+
+// next free job of writer's ring, to be filled in and then submitted
+// return job ptr, NULL if the ring is full
+struct write_job *writer_job_slot(struct disk_writer *writer);
+
+// hand the job filled in from writer_job_slot() to the writer thread
+// return 0 on success, -1 on error
+int writer_submit(struct disk_writer *writer);
+
+// reap every job the pool's writers have completed, in order per writer
+// return jobs reaped
+int writer_pool_reap(struct writer_pool *pool);
+
+// sleep until a writer completes another job
+// return 0 on success, -1 on error
+int writer_pool_wait(struct writer_pool *pool);
+
+// reset done_fd once poll() has seen it, the jobs themselves are reaped with writer_pool_reap()
+void writer_pool_clear(struct writer_pool *pool);
+
+#endif
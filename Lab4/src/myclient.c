@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <sys/socket.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,20 +16,118 @@
 #include <time.h>
 #include <pthread.h>
 #include <poll.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/net_tstamp.h>
+#include <netinet/udp.h>
 
 #include "myclient.h"
+#include "chunk_cache.h"
 #include "utils.h"
 #include "protocol.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "client_loop.h"
 
-#define MIN_MSS_SIZE MAX_HEADER_SIZE + 1
+#define MIN_MSS_SIZE (MAX_HEADER_SIZE + DIGEST_BYTES)
 
 int main(int argc, char **argv) {
+	// handle command line options
+	struct client_opts opts = { NULL, PACING_SLEEP, false, false, NULL, false, -1, 1, false, false, false, false, false };
+
+	int opt;
+	while ((opt = getopt(argc, argv, "c:p:mfes:rdzkg")) != -1) {
+		switch (opt) {
+			case 'g':
+				opts.gso = true;
+				break;
+			case 'k':
+				opts.dedup = true;
+				break;
+			case 'z':
+				opts.compress = true;
+				break;
+			case 'd':
+				opts.delta = true;
+				break;
+			case 'r':
+				opts.resume = true;
+				break;
+			case 's':
+				opts.streams = atoi(optarg);
+				if (opts.streams < 1 || opts.streams > MAX_RANGE_STREAMS) {
+					printf("Invalid stream count provided. Please provide a stream count between 1-%d.\n", MAX_RANGE_STREAMS);
+					exit(1);
+				}
+				break;
+			case 'e':
+				opts.event_loop = true;
+				break;
+			case 'm':
+				opts.mmap_infile = true;
+				break;
+			case 'f':
+				opts.fan_out = true;
+				break;
+			case 'c':
+				opts.cwnd_log = fopen(optarg, "w");
+				if (opts.cwnd_log == NULL) {
+					printf("Failed to open cwnd log file %s: %s\n", optarg, strerror(errno));
+					exit(1);
+				}
+				break;
+			case 'p':
+				if (strcmp(optarg, "burst") == 0) {
+					opts.pacing = PACING_BURST;
+				} else if (strcmp(optarg, "paced") == 0) {
+					opts.pacing = PACING_SLEEP;
+				} else if (strcmp(optarg, "txtime") == 0) {
+					opts.pacing = PACING_TXTIME;
+				} else {
+					printf("Invalid pacing mode provided. Please provide one of burst, paced or txtime.\n");
+					exit(1);
+				}
+				break;
+			default:
+				printf("Usage: %s [-c cwnd_log] [-p burst|paced|txtime] [-m | -f] [-e | -s streams] [-r | -d | -k] [-z] [-g] servn servaddr_conf mss winsz infile_path outfile_path\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (opts.mmap_infile && opts.fan_out) {
+		printf("Only one of -m (mmap infile) and -f (fan out shared chunks) can be used.\n");
+		exit(1);
+	}
+
+	// the event loop tells clients apart by server address, which every stream to one server shares
+	if (opts.event_loop && opts.streams > 1) {
+		printf("Only one of -e (event loop) and -s (streams per server) can be used.\n");
+		exit(1);
+	}
+
+	// a delta is one stream rebuilt from the start into a fresh file, scanned from a mapping of infile
+	if (opts.delta && (opts.event_loop || opts.streams > 1 || opts.resume || opts.fan_out)) {
+		printf("-d (delta) can't be used with -e, -s, -r or -f.\n");
+		exit(1);
+	}
+
+	// a dedup is a delta against the server's chunk store instead of its old outfile
+	if (opts.dedup && (opts.event_loop || opts.streams > 1 || opts.resume || opts.fan_out || opts.delta)) {
+		printf("-k (dedup) can't be used with -e, -s, -r, -f or -d.\n");
+		exit(1);
+	}
+
+	if (opts.delta || opts.dedup) opts.mmap_infile = true;
+
 	// handle command line args
-	if (argc != 7) {
-		printf("Invalid number of options provided.\nThis is where I will print the usage of the program.\n");
+	if (argc - optind != 6) {
+		printf("Invalid number of options provided.\n");
 		exit(1);
 	}
 
+	argv += optind - 1;
+
 	int servn = atoi(argv[1]);																// servn
 	if (servn <= 0 || servn > 65535) {
 		printf("Invalid servn provided. Please provide a server count between 1-65535.\n");
@@ -60,8 +160,10 @@ int main(int argc, char **argv) {
 	char *infile_path = argv[5];															// infile path
 	char *outfile_path = argv[6];															// outfile path
 
-	if (strlen(outfile_path) > (size_t)(mss - MAX_HEADER_SIZE) - 1) {
-		printf("MSS argument is too small for desired output file path. MSS value specified is %d bytes and header length is %d bytes. Please specify an outfile path that is less than or equal to %d - %d - 1 = %d bytes long, or provide a larger MSS\n", mss, WR_HEADER_SIZE, mss, WR_HEADER_SIZE, mss - (WR_HEADER_SIZE + 1));
+	// WR carries the path, its null terminator and the range extension, signed so an MSS too small for even an empty path can't wrap
+	long max_path_len = (long)mss - (MAX_HEADER_SIZE + WR_RANGE_SIZE + WR_INFILE_ID_SIZE) - 1;
+	if ((long)strlen(outfile_path) > max_path_len) {
+		printf("MSS argument is too small for desired output file path. MSS value specified is %d bytes and header length is %d bytes. Please specify an outfile path that is less than or equal to %d - %d - 1 = %ld bytes long, or provide a larger MSS\n", mss, MAX_HEADER_SIZE + WR_RANGE_SIZE + WR_INFILE_ID_SIZE, mss, MAX_HEADER_SIZE + WR_RANGE_SIZE + WR_INFILE_ID_SIZE, max_path_len);
 		exit(1);
 	}
 
@@ -70,8 +172,26 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
-	// struct client *clients[servn];
-	pthread_t threads[servn];
+	// split infile into one range per stream, a small file may not need every stream
+	// resuming, deltas, dedups and compression need the WR range extension too, a single stream just covers the whole file
+	off_t span = 0;
+	u_int32_t range_tag = 0;
+
+	if (opts.streams > 1 || opts.resume || opts.delta || opts.dedup || opts.compress) {
+		struct stat st;
+		if (stat(infile_path, &st) < 0) {
+			fprintf(stderr, "myclient ~ main(): failed to stat infile %s: %s\n", infile_path, strerror(errno));
+			exit(1);
+		}
+
+		span = stream_span(st.st_size, &opts.streams, mss);
+
+		// streams of one transfer find each other on the server by tag, never 0 since that's a WR without a range
+		range_tag = (u_int32_t)(monotonic_us() ^ ((u_int64_t)getpid() << 16));
+		if (range_tag == 0) range_tag = 1;
+	}
+
+	pthread_t threads[servn * opts.streams];
 	struct server_info *servers = parse_serv_conf(servaddr_conf, servn);
 	if (servers == NULL) {
 		fprintf(stderr, "myclient ~ main(): failed to parse servaddr_conf file: %s.\n", servaddr_conf);
@@ -81,25 +201,47 @@ int main(int argc, char **argv) {
 	// pthread_mutex_t mut;
 	// pthread_mutex_init(&mut, NULL);
 
-	struct client *clients[servn];
+	if (opts.event_loop) {
+		// one thread can't sleep between pkts for every client, and shouldn't hold an infile fd per client either
+		if (opts.pacing == PACING_SLEEP) opts.pacing = PACING_BURST;
+		if (!opts.mmap_infile) opts.fan_out = true;
 
-	for (int i = 0; i < servn; i++) {
-		if (servers[i].ip == NULL || servers[i].port < 0) break;
+		if ((opts.sockfd = init_loop_socket()) < 0) {
+			fprintf(stderr, "myclient ~ main(): failed to open shared socket for event loop.\n");
+			exit(1);
+		}
+	}
+
+	if (opts.fan_out) {
+		u_int32_t replicas = 0;
+		while ((int)replicas < servn && servers[replicas].ip != NULL && servers[replicas].port >= 0) replicas ++;
+
+		// every replica releases every chunk, mss is shared so payloads line up with chunk boundaries
+		opts.cache = init_chunk_cache(infile_path, CHUNK_PKTS * (mss - DATA_HEADER_SIZE), replicas);
+		if (opts.cache == NULL) {
+			fprintf(stderr, "myclient ~ main(): failed to set up shared chunk cache for %s.\n", infile_path);
+			exit(1);
+		}
+	}
+
+	struct client *clients[servn * opts.streams];
+	int client_count = 0;
+
+	for (int i = 0; i < servn * opts.streams; i++) {
+		int server_idx = i / opts.streams;
+		if (servers[server_idx].ip == NULL || servers[server_idx].port < 0) break;
 
 		// printf("server %i:\n\tip: %s\n\tport: %d\n", i, servers[i].ip, servers[i].port);
 
-		struct client *client = init_client(infile_path, outfile_path, servers[i], mss, winsz);
+		struct client *client = init_client(infile_path, outfile_path, servers[server_idx], mss, winsz, &opts);
 
 		if (client == NULL) {
 			fprintf(stderr, "myclient ~ main(): encountered error initializing client\n");
 			// exit(1); // TODO: different for multiple threads? etc.
 			
-			for (int i = 0; i < servn; i++) {
-				if (clients[i] != NULL) {
-					free_client(&clients[i]);
-				} else {
-					break;
-				}
+			// clients with threads already running are left to exit with the process
+			for (int i = 0; opts.event_loop && i < client_count; i++) {
+				free_client(&clients[i]);
 			}
 	
 			free(servers);
@@ -108,9 +250,18 @@ int main(int argc, char **argv) {
 			break;
 		}
 
+		if (range_tag != 0) {
+			int stream = i % opts.streams;
+			set_client_range(client, range_tag, stream * span, stream == opts.streams - 1 ? -1 : (stream + 1) * span);
+		}
+
 		clients[i] = client;
+		client_count ++;
 
 		client->thread = i; // TODO: temp?
+
+		// the event loop runs every client once they're all set up
+		if (opts.event_loop) continue;
 		
 		if (pthread_create(&threads[i], NULL, &run_client, (void *)client) < 0) {
 			fprintf(stderr, "myclient ~ main(): failed to spawn thread for client %d\n", i);
@@ -128,7 +279,21 @@ int main(int argc, char **argv) {
 
 	int exit_code = 0;
 
-	for (int i = 0; i < servn; i++) {
+	if (opts.event_loop) {
+		exit_code = run_client_loop(opts.sockfd, clients, client_count);
+		if (exit_code < 0) {
+			fprintf(stderr, "myclient ~ main(): encountered error running event loop.\n");
+			exit_code = 1;
+		}
+
+		for (int i = 0; i < client_count; i++) {
+			free_client(&clients[i]);
+		}
+
+		close(opts.sockfd);
+	}
+
+	for (int i = 0; !opts.event_loop && i < client_count; i++) {
 		void *ret = NULL;
 		if (pthread_join(threads[i], (void **)&ret) < 0) {
 			fprintf(stderr, "myclient ~ main(): encountered error waiting for thread %d to join.\n", i);
@@ -146,7 +311,9 @@ int main(int argc, char **argv) {
 		} else if (exit_code != ret_code) {
 			exit_code = 6;
 		}
+	}
 
+	for (int i = 0; i < servn; i++) {
 		if (servers[i].ip != NULL) {
 			free(servers[i].ip);
 		}
@@ -154,6 +321,16 @@ int main(int argc, char **argv) {
 
 	// pthread_mutex_destroy(&mut);
 
+	if (opts.cwnd_log != NULL) fclose(opts.cwnd_log);
+
+	if (opts.cache != NULL) {
+		fprintf(stderr, "Chunk cache: %u chunks, %llu read from infile, %llu lookups past the %lu MB cap read directly\n", 	opts.cache->chunk_count,
+																																(unsigned long long)opts.cache->loads,
+																																(unsigned long long)opts.cache->misses,
+																																CHUNK_CACHE_MAX_BYTES >> 20);
+		free_chunk_cache(&opts.cache);
+	}
+
 	free(servers);
 
 	// printf("exiting with code %d\n", exit_code);
@@ -187,19 +364,40 @@ void *run_client(void *client) {
 	// u_int32_t winsz = (u_int32_t)((uintptr_t)(((void **)args)[4]));
 	// pthread_mutex_t *mut = (pthread_mutex_t *)((void **)args)[5];
 
+	// nanosleep() would otherwise round every pacing gap up by the default 50us of timer slack
+	if (((struct client *)client)->pacing == PACING_SLEEP) prctl(PR_SET_TIMERSLACK, 1ul);
+
 	// initiate handshake with WR and outfile path
 	int res;
 	if ((res = start_handshake((struct client *)client)) != 0) {
 		fprintf(stderr, "myclient ~ run_client(): encountered an error while performing handshake with server.\n");
+		release_chunks((struct client *)client, ((struct client *)client)->in_end);
+		return (void *)((intptr_t)res);
+	}
+
+	if (((struct client *)client)->opts->delta && (res = start_delta((struct client *)client)) != 0) {
+		fprintf(stderr, "myclient ~ run_client(): failed to start delta against server's outfile.\n");
+		return (void *)((intptr_t)res);
+	}
+
+	if (((struct client *)client)->opts->dedup && (res = start_dedup((struct client *)client)) != 0) {
+		fprintf(stderr, "myclient ~ run_client(): failed to start dedup against server's chunk store.\n");
 		return (void *)((intptr_t)res);
 	}
 
 	if ((res = send_file(client)) != 0) {
 		fprintf(stderr, "myclient ~ run_client(): failed to send or receive file to/from server.\n");
+		release_chunks((struct client *)client, ((struct client *)client)->in_end);
 		// exit(1);
 		return (void *)((intptr_t)res);
 	}
 
+	report_cwnd((struct client *)client);
+	report_delta((struct client *)client);
+	report_compression((struct client *)client);
+	report_checksum((struct client *)client);
+	report_gso((struct client *)client);
+
 	free_client((struct client **)&client);
 
 	return NULL;
@@ -207,7 +405,7 @@ void *run_client(void *client) {
 
 // initialize client with relevant information, perform handshake with server
 // return pointer to client struct on success, NULL on failure
-struct client *init_client(const char *infile_path, const char *outfile_path, struct server_info server, int mss, u_int32_t winsz) {
+struct client *init_client(const char *infile_path, const char *outfile_path, struct server_info server, int mss, u_int32_t winsz, const struct client_opts *opts) {
 	// check for NULL args
 	if (infile_path == NULL) {
 		fprintf(stderr, "myclient ~ init_client(): cannot initialize client with NULL infile_path ptr.\n");
@@ -232,10 +430,60 @@ struct client *init_client(const char *infile_path, const char *outfile_path, st
 		return NULL;
 	}
 
-	// open infile
-	client->infd = open(infile_path, O_RDONLY, 0664);
-	if (client->infd < 0) {
-		fprintf(stderr, "myclient ~ init_client(): failed to open file %s\n", infile_path);
+	client->in_map = NULL;
+	client->in_size = 0;
+	client->in_pos = 0;
+	client->cache = NULL;
+	client->chunks_released = 0;
+
+	if (opts != NULL && opts->cache != NULL) {
+		// fan out, payloads come from the chunks shared with the other replicas, which only ever pread infile
+		client->cache = opts->cache;
+		client->in_size = opts->cache->size;
+		client->infd = opts->cache->fd;
+	} else {
+		// open infile
+		client->infd = open(infile_path, O_RDONLY, 0664);
+		if (client->infd < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to open file %s\n", infile_path);
+			return NULL;
+		}
+
+		struct stat st;
+		if (fstat(client->infd, &st) < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to get size of file %s: %s\n", infile_path, strerror(errno));
+			return NULL;
+		}
+
+		client->in_size = st.st_size;
+
+		if (opts != NULL && opts->mmap_infile && map_infile(client) < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to map file %s, reading it instead.\n", infile_path);
+		}
+	}
+
+	// whole file, unless set_client_range() makes this one stream of a split transfer
+	client->in_end = client->in_size;
+	client->range_tag = 0;
+	client->range_off = 0;
+	client->range_last = false;
+	client->resume_off = 0;
+	client->in_mtime = 0;
+	client->in_crc = 0;
+	client->delta = NULL;
+	client->compress = false;
+	client->raw_bytes = 0;
+	client->wire_bytes = 0;
+	client->compress_us = 0;
+	client->digest = 0;
+	client->server_digest = 0;
+	client->server_digest_known = false;
+	client->crc_bytes = 0;
+	client->crc_us = 0;
+
+	// a server only resumes a manifest left by the same infile
+	if (opts != NULL && opts->resume && identify_infile(client) < 0) {
+		fprintf(stderr, "myclient ~ init_client(): failed to identify infile %s.\n", infile_path);
 		return NULL;
 	}
 
@@ -247,28 +495,37 @@ struct client *init_client(const char *infile_path, const char *outfile_path, st
 
 	// init socket info
 	client->serveraddr_size = sizeof(client->serveraddr);
-	
-	client->sockfd = init_socket((struct sockaddr_in *)&client->serveraddr, server.ip, server.port, AF_INET, SOCK_DGRAM, IPPROTO_UDP, false);
-	if (client->sockfd < 0) {
-		fprintf(stderr, "myclient ~ init_client(): failed to initialize socket.\n");
-		return NULL;
-	}
-
-	
 	client->clientaddr_size = sizeof(client->clientaddr);
-	
-	if (init_sockaddr(client->sockfd, (struct sockaddr_in *)&client->clientaddr, NULL, 0, AF_INET) < 0) {
-		fprintf(stderr, "myclient ~ init_client(): failed to initialize/bind client sockaddr.\n");
-		return NULL;
-	}
+	client->shared_sockfd = opts != NULL && opts->sockfd >= 0;
 
-	// printf("binding client to port %d\n", htons(((struct sockaddr_in *)(&client->clientaddr))->sin_port));
+	if (client->shared_sockfd) {
+		// event loop sends for every client from its own bound socket, only the server address is ours
+		client->sockfd = opts->sockfd;
 
-	// set socket timeout
-	struct timeval server_timeout = { TIMEOUT_SECS, 0 };
-	if (setsockopt(client->sockfd, SOL_SOCKET, SO_RCVTIMEO, &server_timeout, sizeof(server_timeout)) < 0) {
-		fprintf(stderr, "myclient ~ init_client(): encountered error trying to set socket timeout: %s\n", strerror(errno));
-		return NULL;
+		if (init_sockaddr(-1, (struct sockaddr_in *)&client->serveraddr, server.ip, server.port, AF_INET) < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to initialize server sockaddr.\n");
+			return NULL;
+		}
+	} else {
+		client->sockfd = init_socket((struct sockaddr_in *)&client->serveraddr, server.ip, server.port, AF_INET, SOCK_DGRAM, IPPROTO_UDP, false);
+		if (client->sockfd < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to initialize socket.\n");
+			return NULL;
+		}
+
+		if (init_sockaddr(client->sockfd, (struct sockaddr_in *)&client->clientaddr, NULL, 0, AF_INET) < 0) {
+			fprintf(stderr, "myclient ~ init_client(): failed to initialize/bind client sockaddr.\n");
+			return NULL;
+		}
+
+		// printf("binding client to port %d\n", htons(((struct sockaddr_in *)(&client->clientaddr))->sin_port));
+
+		// set socket timeout
+		struct timeval server_timeout = { TIMEOUT_SECS, 0 };
+		if (setsockopt(client->sockfd, SOL_SOCKET, SO_RCVTIMEO, &server_timeout, sizeof(server_timeout)) < 0) {
+			fprintf(stderr, "myclient ~ init_client(): encountered error trying to set socket timeout: %s\n", strerror(errno));
+			return NULL;
+		}
 	}
 
 	client->mss = mss;
@@ -293,11 +550,49 @@ struct client *init_client(const char *infile_path, const char *outfile_path, st
 		pkt = &client->pkt_info[sn];
 
 		pkt->active = false;
-		pkt->retransmits = 0;
 		pkt->ackd = false;
+		pkt->sackd = false;
 		pkt->file_idx = 0;
+		pkt->pyld_sz = 0;
+	}
+
+	client->eof_sent = false;
+	client->opts = opts;
+
+	// slow start from a small window up to winsz, the ring never holds more than that in flight
+	client->cwnd = winsz < CWND_INITIAL ? winsz : CWND_INITIAL;
+	client->ssthresh = winsz;
+	client->cwnd_acc = 0;
+	client->in_recovery = false;
+	client->recover_sn = 0;
+	client->cwnd_start_us = monotonic_us();
+	client->cwnd_rounds = 0;
+	client->cwnd_sum = 0;
+	client->cwnd_max = client->cwnd;
+	client->cwnd_cuts = 0;
+	client->cwnd_timeouts = 0;
+
+	init_pacing(client, opts == NULL ? PACING_BURST : opts->pacing);
+
+	client->gso = opts != NULL && opts->gso;
+	client->gso_batch = NULL;
+	client->gso_sends = 0;
+	client->gso_pkts = 0;
+
+	if (init_gso(client) < 0) {
+		fprintf(stderr, "myclient ~ init_client(): failed to set up segmentation offload.\n");
+		return NULL;
 	}
 
+	// no samples yet, wait the full loss timeout until the first response
+	client->srtt_us = 0;
+	client->rttvar_us = 0;
+	client->rto_us = RTO_INITIAL_US;
+	client->rtt_sampled = false;
+	client->rtt_start_us = 0;
+	client->rtt_pending = false;
+	client->stalled_rtos = 0;
+
 	// prepare for handshake
 	client->handshake_confirmed = false;
 	client->handshake_retransmits = 0;
@@ -313,10 +608,18 @@ struct client *init_client(const char *infile_path, const char *outfile_path, st
 
 // free all memory allocated in client and close infd and sockfd
 void free_client(struct client **client) {
-	close((*client)->infd);
-	close((*client)->sockfd);
+	if ((*client)->in_map != NULL) munmap((*client)->in_map, (*client)->in_size);
+
+	// chunks this replica never got acked don't need to wait for it
+	release_chunks(*client, (*client)->in_end);
+
+	if ((*client)->cache == NULL) close((*client)->infd);
+	if (!(*client)->shared_sockfd) close((*client)->sockfd);
 
 	free((*client)->pkt_info);
+	free((*client)->gso_batch);
+
+	if ((*client)->delta != NULL) free_delta(&(*client)->delta);
 
 	free(*client);
 
@@ -352,6 +655,9 @@ int start_handshake(struct client *client) {
 			return 1;
 		}
 
+		// only the first WR can be timed, a response to a resent one is ambiguous
+		if (retransmits == 0) start_rtt_sample(client);
+
 		fprintf(stderr, "Initial write request packet sent.\n");
 	} while ((recv_res = recv_server_response(client)) == 1);
 
@@ -388,23 +694,35 @@ int start_handshake(struct client *client) {
 		}
 	}
 
-	client->id = client->last_ackd_sn;
-
-	fprintf(stderr, "Client ID assigned by server: %u\n", client->id);
-
 	if (recv_res < 0) {
 		fprintf(stderr, "myclient ~ start_handshake(): failed to recv server handshake response.\n");
 		return 1;
 	} else if (recv_res > 1) return recv_res;
 
+	return complete_handshake(client);
+}
+
+// server accepted the WR, take the client id from its ACK and ACK it back
+// return 0 on success, 1 on error
+int complete_handshake(struct client *client) {
+	client->id = client->last_ackd_sn;
+
+	fprintf(stderr, "Client ID assigned by server: %u\n", client->id);
+
 	if (send_ack_pkt(client, client->id) < 0) {
-		fprintf(stderr, "myclient ~ start_handshake(): failed to send handshake ACK to server.\n");
+		fprintf(stderr, "myclient ~ complete_handshake(): failed to send handshake ACK to server.\n");
 		return 1;
 	}
 
 	client->start_sn = (client->id + 1) % client->pkt_count;
+	client->last_sent_sn = client->id;
 	// printf("handshake completed? start_sn set to %u\n", client->start_sn);
 
+	if (client->resume_off > 0 && resume_range(client, client->resume_off) < 0) {
+		fprintf(stderr, "myclient ~ complete_handshake(): failed to resume after %lld bytes.\n", (long long)client->resume_off);
+		return 1;
+	}
+
 	return 0;
 }
 
@@ -438,89 +756,117 @@ int finish_handshake(struct client *client) {
 }
 
 // send file from fd to sockfd, also using sockaddr
-// return 0 on success, -1 on error
+// return 0 on success, exit code on error
 // int send_file(int infd, const char *outfile_path, int sockfd, struct sockaddr *sockaddr, socklen_t *sockaddr_size, int mss, u_int32_t winsz) {
 int send_file(struct client *client) {
-	bool need_pkt_resend, reached_eof = false;
+	int res;
+	bool done = false;
 
-	// need to resend pkts if ack sn < last pkt sn sent
-	// send pkts from ack sn + 1
-	int pkts_sent;
+	// first window goes out right behind the handshake ACK
+	if ((res = send_window(client)) != 0) {
+		fprintf(stderr, "myclient ~ send_file(): encountered an error while sending pkt window.\n");
+		return res;
+	}
 
-	int recv_res;
+	// wait for server response, to get ack sn, then send the next window
+	while (!done) {
+		if ((res = send_file_step(client, recv_server_response(client), &done)) != 0) {
+			fprintf(stderr, "myclient ~ send_file(): failed to advance transfer.\n");
+			return res;
+		}
+	}
 
-	// continue while eof hasn't been reached or pkts need to be resent
-	while (!reached_eof || need_pkt_resend) {
-		need_pkt_resend = false;
+	return 0;
+}
 
-		do {
-			// send pkt window
-			if ((pkts_sent = send_window_pkts(client)) < 0) {
-				fprintf(stderr, "myclient ~ send_file(): encountered an error while sending pkt window.\n");
-				return -pkts_sent;
-			}
+// send the current window
+// return 0 on success, exit code on error
+int send_window(struct client *client) {
+	int pkts_sent;
+	if ((pkts_sent = send_window_pkts(client)) < 0) {
+		fprintf(stderr, "myclient ~ send_window(): encountered an error while sending pkt window.\n");
+		return -pkts_sent;
+	}
 
-			reached_eof = pkts_sent == 0; // update reached_eof
+	return 0;
+}
 
-			// wait for server response, to get ack sn
-			recv_res = recv_server_response(client);
+// advance transfer after recv_res from recv_server_response(), either terminating or sending the next window
+// *done is set once the termination ACK has been sent
+// return 0 on success, exit code on error
+int send_file_step(struct client *client, int recv_res, bool *done) {
+	*done = false;
 
-			if (!client->handshake_confirmed) {
-				int handshake_res = finish_handshake(client);
-				if (handshake_res == 2) {
-					continue;
-				} else if (handshake_res != 0) {
-					fprintf(stderr, "myclient ~ send_file(): failed to complete handshake.\n");
-					return handshake_res;
-				}
-			}
-		} while (recv_res == 1);
+	if (recv_res < 0) {
+		fprintf(stderr, "myclient ~ send_file_step(): encourntered an error while trying to receive server response.\n");
+		return 1;
+	} else if (recv_res > 1) {
+		return recv_res;
+	}
 
-		if (recv_res < 0) {
-			fprintf(stderr, "myclient ~ send_file(): encourntered an error while trying to receive server response.\n");
-			return 1;
+	if (!client->handshake_confirmed) {
+		int handshake_res = finish_handshake(client);
+		if (handshake_res != 0 && handshake_res != 2) {
+			fprintf(stderr, "myclient ~ send_file_step(): failed to complete handshake.\n");
+			return handshake_res;
 		}
+	}
 
-		if (reached_eof) {
-			if (client->last_ackd_sn == client->last_sent_sn) {
-				if (send_ack_pkt(client, client->id) < 0) {
-					fprintf(stderr, "myclient ~ send_file(): failed to send connection termination ACK.\n");
-					return 1; // TODO: maybe don't return here?
-				}
+	// need to resend pkts if ack sn < last pkt sn sent
+	if (recv_res == 1) return send_window(client);
 
-				break;
-			}
+	if (client->eof_sent && client->last_ackd_sn == client->last_sent_sn) {
+		if (send_ack_pkt(client, client->id) < 0) {
+			fprintf(stderr, "myclient ~ send_file_step(): failed to send connection termination ACK.\n");
+			return 1; // TODO: maybe don't return here?
+		}
+
+		// every pkt passed its crc, so a different digest means the server's outfile didn't end up as infile
+		if (client->server_digest_known && client->server_digest != client->digest) {
+			fprintf(stderr, "Digest mismatch IP %s port %d: infile %08x, server's outfile %08x\n", client->server.ip, client->server.port, client->digest, client->server_digest);
+			return 1;
 		}
 
-		// update pkt info with ack
-		u_int32_t sn = client->start_sn;
-		struct c_pkt_info *pkt;
-		while (sn != (client->last_ackd_sn + 1) % client->pkt_count) {
-			pkt = &client->pkt_info[sn];
+		*done = true;
+		return 0;
+	}
 
-			if (pkt->active) {
-				pkt->ackd = true;
-				pkt->active = false;
-			}
+	// update pkt info with ack
+	u_int32_t sn = client->start_sn;
+	u_int32_t acked = 0;
+	off_t acked_end = -1;
+	struct c_pkt_info *pkt;
+	while (sn != (client->last_ackd_sn + 1) % client->pkt_count) {
+		pkt = &client->pkt_info[sn];
 
-			sn = (sn + 1) % client->pkt_count;
+		if (pkt->active) {
+			pkt->ackd = true;
+			pkt->active = false;
+			acked ++;
+			acked_end = pkt->file_idx + pkt->pyld_sz;
 		}
 
-		need_pkt_resend = client->last_ackd_sn != (client->start_sn + client->winsz) % client->pkt_count;
+		if (sn == client->recover_sn) client->in_recovery = false;
 
-		client->start_sn = (client->last_ackd_sn + 1) % client->pkt_count;
+		sn = (sn + 1) % client->pkt_count;
 	}
 
-	return 0;
+	grow_cwnd(client, acked);
+
+	if (acked_end >= 0) release_chunks(client, acked_end);
+
+	// send pkts from ack sn + 1
+	client->start_sn = (client->last_ackd_sn + 1) % client->pkt_count;
+
+	return send_window(client);
 }
 
-// send window of pkts with content from infd
-// returns number of pkts sent, -1 on error
+// resend unacked pkts the server is missing, then fill the rest of the window with new pkts from infd
+// returns number of pkts sent, 0 once eof has been sent, -1 on error
 int send_window_pkts(struct client *client) {
 	char pkt_buf[client->mss];
 
 	client->start_sn = (client->last_ackd_sn + 1) % client->pkt_count;
-	client->last_sent_sn = (client->start_sn + client->pkt_count - 1) % client->pkt_count;
 
 	// reset pkt info array
 	int res;
@@ -529,89 +875,247 @@ int send_window_pkts(struct client *client) {
 		return -res;
 	}
 
-	struct c_pkt_info *pkt;
+	// pkts sent in earlier rounds that haven't been acked yet
+	u_int32_t in_flight = (client->last_sent_sn + 1 + client->pkt_count - client->start_sn) % client->pkt_count;
+	if (in_flight > client->winsz) in_flight = 0;
 
-	// check start pkt for ack, if no ack, go back to file idx
-	pkt = &client->pkt_info[client->start_sn];
-	if (!pkt->ackd && pkt->active) {
-		lseek(client->infd, pkt->file_idx, SEEK_SET);
+	client->cwnd_rounds ++;
+	client->cwnd_sum += client->cwnd;
+
+	start_pacing_round(client);
+
+	// holes are resent first, whatever cwnd has left over goes to new pkts
+	// after a timeout cwnd is 1, so the round only probes the first hole and lets the server's SACK say what it has
+	u_int32_t budget = client->cwnd;
+
+	u_int32_t holes = 0;
+	for (u_int32_t i = 0; i < in_flight; i++) {
+		struct c_pkt_info *pkt = &client->pkt_info[(client->start_sn + i) % client->pkt_count];
+		if (pkt->active && !pkt->sackd) holes ++;
 	}
 
-	u_int32_t pyld_sz;
+	u_int32_t resend_count = holes < budget ? holes : budget;
+	u_int32_t new_count = client->eof_sent ? 0 : client->winsz - in_flight;
+	if (new_count > budget - resend_count) new_count = budget - resend_count;
 
-	bool eof_reached = false;
+	bool sending_new = new_count > 0;
 
-	u_int32_t sn = client->start_sn;
+	struct c_pkt_info *pkt;
+
+	u_int32_t sn;
 	int pkts_sent = 0;
 	int bytes_read;
 
+	// payload inside the mapped infile or chunk cache, NULL when it's read into pkt_buf
+	char *pyld = NULL;
+	int pkt_size;
+
+	// resend only the holes, sacked pkts are already buffered by the server
+	u_int32_t resent = 0;
+	for (u_int32_t i = 0; i < in_flight && resent < resend_count; i++) {
+		sn = (client->start_sn + i) % client->pkt_count;
+		pkt = &client->pkt_info[sn];
+
+		if (!pkt->active || pkt->sackd) continue;
+
+		if ((pkt_size = find_pkt_pyld(client, pkt, pkt_buf, &pyld)) < 0) {
+			fprintf(stderr, "myclient ~ send_window_pkts(): encountered an error rereading pkt %u from infile.\n", sn);
+			return -1;
+		}
+
+		resent ++;
+
+		u_int8_t flags = (!sending_new && resent == resend_count) ? DATA_FLAG_ACK_REQ : 0;
+
+		// resent pkts are never timed (Karn)
+		if (flags & DATA_FLAG_ACK_REQ) client->rtt_pending = false;
+
+		if (pace_pkt(client) < 0) {
+			fprintf(stderr, "myclient ~ send_window_pkts(): failed to pace resent DATA pkt.\n");
+			return -1;
+		}
+
+		if (send_data_pkt(client, pkt_buf, pkt_size, pyld, sn, pkt->file_idx - client->range_off, pkt->pyld_sz, pkt->pyld_crc, flags) < 0) {
+			fprintf(stderr, "myclient ~ send_window_pkts(): failed to resend DATA pkt to server.\n");
+			return -1;
+		}
+
+		pkts_sent ++;
+	}
+
+	bool eof_reached = false;
+
 	// printf("send_window_pkts(): start sn is %u\n", sn);
 
-	while ((u_int32_t)pkts_sent < client->winsz && !eof_reached) { // only send max winsz packets
-		memset(pkt_buf, 0, sizeof(pkt_buf));
+	u_int32_t new_end = in_flight + new_count;
 
+	for (u_int32_t i = in_flight; i < new_end && !eof_reached; i++) { // never more than winsz pkts in flight
+		sn = (client->start_sn + i) % client->pkt_count;
 		pkt = &client->pkt_info[sn];
 
-		// update pkts for current transmission
-		pkt->file_idx = lseek(client->infd, 0, SEEK_CUR);
 		pkt->active = true;
 		pkt->ackd = false;
+		pkt->sackd = false;
 
-		// bytes_read is our payload size
-		bytes_read = read(client->infd, pkt_buf + DATA_HEADER_SIZE, ((u_int32_t)client->mss) - ((u_int32_t)DATA_HEADER_SIZE));
-		pyld_sz = (u_int32_t)bytes_read;
+		if (client->in_map != NULL || client->cache != NULL || client->delta != NULL) {
+			// delta stream is generated only as far as this pkt needs
+			if (client->delta != NULL) {
+				if (extend_delta(client->delta, client->in_pos + client->mss - DATA_HEADER_SIZE) < 0) {
+					fprintf(stderr, "myclient ~ send_window_pkts(): encountered an error extending delta.\n");
+					return -1;
+				}
 
-		if (bytes_read < 0) {
-			fprintf(stderr, "myclient ~ send_window_pkts(): encountered an error reading from infile.\n");
-			return -1;
-		} else if (bytes_read == 0) {
+				client->in_end = client->delta->size;
+			}
+
+			// next payload is just the next mss sized slice of the mapping, the shared chunks or the delta stream
+			off_t left = client->in_end - client->in_pos;
+
+			pkt->file_idx = client->in_pos;
+			bytes_read = left < client->mss - DATA_HEADER_SIZE ? (int)left : client->mss - DATA_HEADER_SIZE;
+			pkt->pyld_sz = (u_int32_t)bytes_read;
+
+			client->in_pos += bytes_read;
+
+			if ((pkt_size = find_pkt_pyld(client, pkt, pkt_buf, &pyld)) < 0) {
+				fprintf(stderr, "myclient ~ send_window_pkts(): encountered an error reading pkt %u from infile.\n", sn);
+				return -1;
+			}
+		} else {
+			memset(pkt_buf, 0, sizeof(pkt_buf));
+			pkt_size = sizeof(pkt_buf);
+
+			// update pkts for current transmission, infd's own offset is never used so every read stands alone
+			pkt->file_idx = client->in_pos;
+
+			// never read past the end of this stream's range
+			off_t left = client->in_end - pkt->file_idx;
+
+			// bytes_read is our payload size
+			bytes_read = left <= 0 ? 0 : pread(client->infd, pkt_buf + DATA_HEADER_SIZE, left < client->mss - DATA_HEADER_SIZE ? (size_t)left : ((u_int32_t)client->mss) - ((u_int32_t)DATA_HEADER_SIZE), pkt->file_idx);
+
+			if (bytes_read < 0) {
+				fprintf(stderr, "myclient ~ send_window_pkts(): encountered an error reading from infile.\n");
+				return -1;
+			}
+
+			client->in_pos += bytes_read;
+		}
+
+		if (bytes_read == 0) {
 			eof_reached = true;
 		}
 
-		if (send_data_pkt(client, pkt_buf, sizeof(pkt_buf), pyld_sz) < 0) {
+		pkt->pyld_sz = (u_int32_t)bytes_read;
+
+		// payload's crc starts its pkt's crc, so resends never sum its bytes again
+		// new bytes of infile come in order, the digest takes them while they're still in cache, a delta's were digested up front
+		u_int64_t start_us = monotonic_us();
+
+		char *raw = pyld != NULL ? pyld : pkt_buf + DATA_HEADER_SIZE;
+		pkt->pyld_crc = crc32c(0, raw, bytes_read);
+		client->crc_bytes += bytes_read;
+
+		if (client->delta == NULL) {
+			client->digest = crc32c(client->digest, raw, bytes_read);
+			client->crc_bytes += bytes_read;
+		}
+
+		client->crc_us += monotonic_us() - start_us;
+
+		u_int8_t flags = (i == new_end - 1 || eof_reached) ? DATA_FLAG_ACK_REQ : 0;
+
+		if (pace_pkt(client) < 0) {
+			fprintf(stderr, "myclient ~ send_window_pkts(): failed to pace DATA pkt.\n");
+			return -1;
+		}
+
+		if (send_data_pkt(client, pkt_buf, pkt_size, pyld, sn, pkt->file_idx - client->range_off, pkt->pyld_sz, pkt->pyld_crc, flags) < 0) {
 			fprintf(stderr, "myclient ~ send_window_pkts(): failed to send DATA pkt to server.\n");
 			return -1;
 		}
 
-		sn = (sn + 1) % client->pkt_count;
+		// ack for a new pkt closing the burst is an unambiguous rtt sample
+		if (flags & DATA_FLAG_ACK_REQ) start_rtt_sample(client);
+
+		client->last_sent_sn = sn;
 
 		pkts_sent ++;
 	}
 
+	// whatever the round queued for gso goes out before waiting on the server
+	if (flush_gso_batch(client) < 0) {
+		fprintf(stderr, "myclient ~ send_window_pkts(): failed to flush queued DATA pkts.\n");
+		return -1;
+	}
+
 	if (eof_reached) {
 		fprintf(stderr, "End of file.\n");
-		return 0;
+		client->eof_sent = true;
 	}
 
+	if (client->eof_sent) return 0;
+
 	return pkts_sent;
 }
 
-
 int send_pkt(struct client *client, int opcode, char *pkt_buf, size_t pkt_size) {
+	struct iovec iov = { pkt_buf, pkt_size };
+
+	return send_pkt_iov(client, opcode, &iov, 1);
+}
+
+// send pkt gathered from iov, the first element holds the whole header
+// return 0 on success, -1 on error
+int send_pkt_iov(struct client *client, int opcode, struct iovec *iov, int iovcnt) {
 	if (client == NULL) {
-		fprintf(stderr, "myclient ~ send_pkt(): cannot send pkt with NULL client ptr\n");
+		fprintf(stderr, "myclient ~ send_pkt_iov(): cannot send pkt with NULL client ptr\n");
 		return -1;
 	}
 
-	if (pkt_buf == NULL) {
-		fprintf(stderr, "myclient ~ send_pkt(): cannot send pkt with NULL pkt_buf ptr\n");
+	if (iov == NULL || iov[0].iov_base == NULL) {
+		fprintf(stderr, "myclient ~ send_pkt_iov(): cannot send pkt with NULL header ptr\n");
 		return -1;
 	}
 
+	char *pkt_buf = iov[0].iov_base;
+
 	if (assign_pkt_opcode(pkt_buf, opcode) < 0) {
-		fprintf(stderr, "myclient ~ send_pkt(): failed to assign opcode to pkt.\n");
+		fprintf(stderr, "myclient ~ send_pkt_iov(): failed to assign opcode to pkt.\n");
 		return -1;
 	}
 
+	struct msghdr msg = { &client->serveraddr, client->serveraddr_size, iov, iovcnt, NULL, 0, 0 };
+
+#ifdef SCM_TXTIME
+	u_int64_t txtime_ns;
+	char ctrl_buf[CMSG_SPACE(sizeof(txtime_ns))];
+
+	if (opcode == OP_DATA && client->pacing == PACING_TXTIME && client->pace_gap_us > 0) {
+		// departure time set by pace_pkt(), the fq qdisc holds the pkt until then
+		txtime_ns = client->txtime_us * 1000;
+
+		memset(ctrl_buf, 0, sizeof(ctrl_buf));
+		msg.msg_control = ctrl_buf;
+		msg.msg_controllen = sizeof(ctrl_buf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_TXTIME;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(txtime_ns));
+		memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+	}
+#endif
+
 	// pthread_mutex_lock(client->mut);
-	if (sendto(client->sockfd, pkt_buf, pkt_size, 0, &client->serveraddr, client->serveraddr_size) < 0) {
-		fprintf(stderr, "myclient ~ send_pkt(): failed to send pkt to server: opcode %u\n", opcode);
+	if (sendmsg(client->sockfd, &msg, 0) < 0) {
+		fprintf(stderr, "myclient ~ send_pkt_iov(): failed to send pkt to server: opcode %u\n", opcode);
 		return -1;
 	}
 	// pthread_mutex_unlock(client->mut);
 
 	if (log_pkt_sent(client, pkt_buf) < 0) { // TODO: fix
-		fprintf(stderr, "myclient ~ send_pkt(): failed to log pkt sent.\n");
+		fprintf(stderr, "myclient ~ send_pkt_iov(): failed to log pkt sent.\n");
 		return -1;
 	}
 
@@ -625,7 +1129,8 @@ int send_wr_pkt(struct client *client) {
 	}
 
 	// construct WR packet
-	char pkt_buf[WR_HEADER_SIZE + strlen(client->outfile_path) + 1];				// null terminated and opcode both 1 byte
+	bool resume = client->range_tag != 0 && client->opts != NULL && client->opts->resume;
+	char pkt_buf[WR_HEADER_SIZE + strlen(client->outfile_path) + 1 + WR_RANGE_SIZE + (resume ? WR_INFILE_ID_SIZE : 0)];	// null terminated and opcode both 1 byte
 
 	if (assign_wr_winsz(pkt_buf, client->winsz) < 0) {
 		fprintf(stderr, "myclient ~ send_wr_pkt(): encountered error assigning window size to handshake buffer.\n");
@@ -633,7 +1138,21 @@ int send_wr_pkt(struct client *client) {
 	}
 
 	memcpy(pkt_buf + WR_HEADER_SIZE, client->outfile_path, strlen(client->outfile_path));	// copy outfile_path to pkt
-	pkt_buf[sizeof(pkt_buf) - 1] = 0; // null terminate
+	pkt_buf[WR_HEADER_SIZE + strlen(client->outfile_path)] = 0; // null terminate
+
+	// one stream of a split transfer, say where its range goes in outfile
+	// every WR says how big the whole file is, so the server can lay outfile out up front
+	u_int8_t range_flags = client->range_tag == 0 ? 0 : (client->range_last ? RANGE_FLAG_LAST : 0) | (resume ? RANGE_FLAG_RESUME : 0) | (client->opts != NULL && client->opts->delta ? RANGE_FLAG_DELTA : 0) | (client->opts != NULL && client->opts->dedup ? RANGE_FLAG_DEDUP : 0) | (client->opts != NULL && client->opts->compress ? RANGE_FLAG_COMPRESS : 0);
+	if (assign_wr_range(pkt_buf, client->range_tag, client->range_off, range_flags, (u_int64_t)client->in_size) < 0) {
+		fprintf(stderr, "myclient ~ send_wr_pkt(): encountered error assigning range to handshake buffer.\n");
+		return -1;
+	}
+
+	// the server checks these against its manifest before resuming
+	if (resume && assign_wr_infile_id(pkt_buf, client->in_mtime, client->in_crc) < 0) {
+		fprintf(stderr, "myclient ~ send_wr_pkt(): encountered error assigning infile id to handshake buffer.\n");
+		return -1;
+	}
 
 	if (send_pkt(client, OP_WR, pkt_buf, sizeof(pkt_buf)) < 0) {
 		fprintf(stderr, "myclient ~ send_wr_pkt(): failed to send WR pkt to server.\n");
@@ -662,19 +1181,17 @@ int send_ack_pkt(struct client *client, u_int32_t ack_sn) {
 		return -1;
 	}
 
-	client->last_sent_sn = ack_sn;
-
 	return 0;
 }
 
-int send_data_pkt(struct client *client, char *pkt_buf, size_t pkt_size, u_int32_t pyld_sz) {
+// send DATA pkt with header in pkt_buf for the payload off bytes into the client's stream, payload follows the header in pkt_buf if pyld is NULL
+// return 0 on success, -1 on error
+int send_data_pkt(struct client *client, char *pkt_buf, size_t pkt_size, char *pyld, u_int32_t sn, u_int64_t off, u_int32_t pyld_sz, u_int32_t pyld_crc, u_int8_t flags) {
 	if (client == NULL) {
 		fprintf(stderr, "myclient ~ send_data_pkt(): cannot send DATA pkt with NULL client ptr.\n");
 		return -1;
 	}
 
-	u_int32_t sn = (client->last_sent_sn + 1) % client->pkt_count;
-
 	// assign client ID
 	if (assign_pkt_client_id(pkt_buf, client->id) < 0) {
 		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign client id to DATA pkt.\n");
@@ -686,20 +1203,101 @@ int send_data_pkt(struct client *client, char *pkt_buf, size_t pkt_size, u_int32
 		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign sn to DATA buffer.\n");
 		return -1;
 	}
+
+	// server writes the payload where this says, whatever order it arrives in
+	if (assign_data_off(pkt_buf, off) < 0) {
+		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign offset to DATA buffer.\n");
+		return -1;
+	}
 	
+	// compressed block replaces the payload on the wire, pkt info keeps the raw size for the file offsets
+	char z_buf[client->compress ? client->mss - DATA_HEADER_SIZE : 1];
+
+	if (client->compress && pyld_sz > 0) {
+		u_int64_t start_us = monotonic_us();
+		u_int32_t z_sz = lz_compress((u_int8_t *)(pyld != NULL ? pyld : pkt_buf + DATA_HEADER_SIZE), pyld_sz, (u_int8_t *)z_buf, pyld_sz - 1);
+		client->compress_us += monotonic_us() - start_us;
+		client->raw_bytes += pyld_sz;
+
+		if (z_sz > 0) {
+			pyld = z_buf;
+			pyld_sz = z_sz;
+			pkt_size = DATA_HEADER_SIZE;
+			flags |= DATA_FLAG_COMPRESSED;
+		}
+
+		client->wire_bytes += pyld_sz;
+	}
+
+	// last pkt has no payload, the digest of the whole range takes its place
+	if (pyld_sz == 0) {
+		if (assign_digest(pkt_buf, DATA_HEADER_SIZE, client->digest) < 0) {
+			fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign digest to DATA pkt.\n");
+			return -1;
+		}
+
+		pyld = NULL;
+		pkt_size = DATA_HEADER_SIZE + DIGEST_BYTES;
+		flags |= DATA_FLAG_DIGEST;
+	}
+
 	// assign payload size
 	if (assign_pkt_pyld_sz(pkt_buf, pyld_sz) < 0) {
 		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign payload size to DATA pkt.\n");
 		return -1;
 	}
+
+	// assign flags
+	if (assign_data_flags(pkt_buf, flags) < 0) {
+		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign flags to DATA pkt.\n");
+		return -1;
+	}
+
+	// crc covers the opcode too, which send_pkt_iov() would only fill in after it
+	if (assign_pkt_opcode(pkt_buf, OP_DATA) < 0) {
+		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign opcode to DATA pkt.\n");
+		return -1;
+	}
+
+	// crc covers the header and the bytes that follow it on the wire, so a compressed payload is checked before it's expanded
+	u_int64_t start_us = monotonic_us();
+
+	// pyld_crc is of the raw payload, a compressed block or the digest took its place on the wire
+	if (flags & (DATA_FLAG_COMPRESSED | DATA_FLAG_DIGEST)) {
+		u_int32_t body_sz = flags & DATA_FLAG_DIGEST ? DIGEST_BYTES : pyld_sz;
+
+		pyld_crc = crc32c(0, pyld != NULL ? pyld : pkt_buf + DATA_HEADER_SIZE, body_sz);
+		client->crc_bytes += body_sz;
+	}
+
+	if (assign_data_crc(pkt_buf, data_pkt_crc(pkt_buf, pyld_crc)) < 0) {
+		fprintf(stderr, "myclient ~ send_data_pkt(): failed to assign crc to DATA pkt.\n");
+		return -1;
+	}
+
+	client->crc_us += monotonic_us() - start_us;
+	client->crc_bytes += DATA_CRC_OFFSET;
 	
-	if (send_pkt(client, OP_DATA, pkt_buf, pkt_size) < 0) {
+	// mapped payload goes straight from the page cache into the socket
+	struct iovec iov[2] = { { pkt_buf, pkt_size }, { pyld, pyld_sz } };
+	int iovcnt = pyld == NULL || pyld_sz == 0 ? 1 : 2;
+
+	// txtime pacing stamps every pkt with its own departure time, so those can't share a send
+	if (client->gso && (client->pacing != PACING_TXTIME || client->pace_gap_us == 0)) {
+		// mapping and chunk cache outlive the batch, z_buf doesn't
+		if (queue_gso_pkt(client, iov, iovcnt, pyld != z_buf) < 0) {
+			fprintf(stderr, "myclient ~ send_data_pkt(): failed to queue DATA pkt for segmentation offload.\n");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if (send_pkt_iov(client, OP_DATA, iov, iovcnt) < 0) {
 		fprintf(stderr, "myclient ~ send_data_pkt(): failed to send DATA pkt to server.\n");
 		return -1;
 	}
 
-	client->last_sent_sn = sn;
-
 	return 0;
 }
 
@@ -714,24 +1312,960 @@ int update_pkt_info(struct client *client) {
 		pkt = &client->pkt_info[sn];
 
 		if (pkt->ackd) {
-			pkt->retransmits = 0;
 			pkt->active = false;
 			pkt->ackd = false;
-		} else if (pkt->active) {
-			pkt->retransmits ++;
-			if (pkt->retransmits > 3) {
+			pkt->sackd = false;
+		}
+	}
+
+	return 0;
+}
+
+// mark in flight pkts the server reports buffered past ack_sn, so they aren't resent
+void apply_sack(struct client *client, u_int32_t ack_sn, u_int8_t *bitmap, int bitmap_sz) {
+	// sack from before the current window, its bits no longer line up
+	if ((ack_sn + 1 + client->pkt_count - client->start_sn) % client->pkt_count > client->winsz) return;
+
+	u_int32_t bits = (u_int32_t)bitmap_sz * 8 < client->winsz ? (u_int32_t)bitmap_sz * 8 : client->winsz;
+
+	for (u_int32_t i = 0; i < bits; i++) {
+		if (bitmap[i / 8] & (1 << (i % 8))) {
+			struct c_pkt_info *pkt = &client->pkt_info[(ack_sn + 1 + i) % client->pkt_count];
+
+			if (pkt->active) pkt->sackd = true;
+		}
+	}
+}
+
+// start timing a first transmission, its response gives the next rtt sample
+void start_rtt_sample(struct client *client) {
+	client->rtt_start_us = monotonic_us();
+	client->rtt_pending = true;
+}
+
+// fold rtt sample into srtt and rttvar and recompute rto as in RFC 6298
+void update_rto(struct client *client, u_int64_t rtt_us) {
+	client->rtt_pending = false;
+
+	if (!client->rtt_sampled) {
+		client->srtt_us = rtt_us;
+		client->rttvar_us = rtt_us / 2;
+		client->rtt_sampled = true;
+	} else {
+		u_int64_t err_us = client->srtt_us > rtt_us ? client->srtt_us - rtt_us : rtt_us - client->srtt_us;
+
+		client->rttvar_us = (3 * client->rttvar_us + err_us) / 4;
+		client->srtt_us = (7 * client->srtt_us + rtt_us) / 8;
+	}
+
+	u_int64_t var_us = 4 * client->rttvar_us > RTO_CLOCK_US ? 4 * client->rttvar_us : RTO_CLOCK_US;
+
+	client->rto_us = client->srtt_us + var_us;
+	if (client->rto_us < RTO_MIN_US) client->rto_us = RTO_MIN_US;
+	if (client->rto_us > RTO_MAX_US) client->rto_us = RTO_MAX_US;
+}
+
+// double rto after a timeout, the pkt being timed is no longer a valid sample
+void backoff_rto(struct client *client) {
+	client->rtt_pending = false;
+
+	client->rto_us *= 2;
+	if (client->rto_us > RTO_MAX_US) client->rto_us = RTO_MAX_US;
+}
+
+// find payload of pkt in the mapped infile or chunk cache, or pread it into pkt_buf after the header if neither has it
+// payload ptr is put in *pyld, NULL when it was read into pkt_buf
+// return number of bytes of pkt_buf to send, -1 on error
+int find_pkt_pyld(struct client *client, struct c_pkt_info *pkt, char *pkt_buf, char **pyld) {
+	*pyld = NULL;
+
+	if (pkt->pyld_sz == 0) return DATA_HEADER_SIZE;
+
+	// delta stream headers are encoded as they're sent, so it's always copied into pkt_buf
+	if (client->delta != NULL) {
+		if (read_delta(client->delta, pkt->file_idx, pkt_buf + DATA_HEADER_SIZE, pkt->pyld_sz) < 0) {
+			fprintf(stderr, "myclient ~ find_pkt_pyld(): encountered an error reading %u bytes at %lld of delta.\n", pkt->pyld_sz, (long long)pkt->file_idx);
+			return -1;
+		}
+
+		return DATA_HEADER_SIZE + pkt->pyld_sz;
+	}
+
+	if (client->in_map != NULL) {
+		*pyld = client->in_map + pkt->file_idx;
+	} else if (client->cache != NULL) {
+		*pyld = chunk_cache_get(client->cache, pkt->file_idx, pkt->pyld_sz);
+	}
+
+	if (*pyld != NULL) return DATA_HEADER_SIZE;
+
+	memset(pkt_buf, 0, client->mss);
+
+	int bytes_read = pread(client->infd, pkt_buf + DATA_HEADER_SIZE, pkt->pyld_sz, pkt->file_idx);
+	if (bytes_read < 0 || (u_int32_t)bytes_read != pkt->pyld_sz) {
+		fprintf(stderr, "myclient ~ find_pkt_pyld(): encountered an error reading %u bytes at %lld from infile.\n", pkt->pyld_sz, (long long)pkt->file_idx);
+		return -1;
+	}
+
+	return client->mss;
+}
+
+// fetch the server's outfile signatures and start the delta against them, the DATA pkts then carry the delta stream
+// return 0 on success, exit code on error
+int start_delta(struct client *client) {
+	struct block_sig *sigs;
+	u_int32_t sig_count;
+	u_int32_t block_sz;
+
+	int res;
+	if ((res = fetch_signatures(client, &sigs, &sig_count, &block_sz)) != 0) {
+		fprintf(stderr, "myclient ~ start_delta(): failed to fetch signatures of server's outfile.\n");
+		return res;
+	}
+
+	// blocks are matched by sliding along the mapping a byte at a time
+	if (client->in_map == NULL && client->in_size > 0) {
+		fprintf(stderr, "myclient ~ start_delta(): delta needs infile mapped.\n");
+		free(sigs);
+		return 1;
+	}
+
+	client->delta = init_delta((const u_int8_t *)client->in_map, client->in_size, sigs, sig_count, block_sz);
+	if (client->delta == NULL) {
+		fprintf(stderr, "myclient ~ start_delta(): failed to initialize delta.\n");
+		free(sigs);
+		return 1;
+	}
+
+	// payloads are ops, the server digests the outfile they rebuild
+	digest_range(client, 0, client->in_size);
+
+	client->in_pos = 0;
+	client->in_end = 0;
+
+	// server answered SIG requests, so it has accepted us
+	client->handshake_confirmed = true;
+
+	return 0;
+}
+
+// pull the block signatures of the server's old outfile, keeping up to winsz SIG requests outstanding
+// signatures are put in *sigs, which the caller frees, their count in *sig_count and block size in *block_sz
+// return 0 on success, exit code on error
+int fetch_signatures(struct client *client, struct block_sig **sigs, u_int32_t *sig_count, u_int32_t *block_sz) {
+	char pkt_buf[MAX_SRVR_RES_SIZE];
+
+	*sigs = NULL;
+	*sig_count = 0;
+	*block_sz = 0;
+
+	// only the first response says how many there are, so it's asked for alone
+	bool *got = NULL;
+	u_int32_t pkts = 1;
+	u_int32_t sent = 0;
+	u_int32_t answered = 0;
+	int retransmits = 0;
+
+	struct pollfd fds[1] = { { client->sockfd, POLLIN, 0 } };
+
+	// the server's own ACKs keep arriving meanwhile, so the rto runs from the last progress rather than the last pkt
+	u_int64_t deadline_us = 0;
+
+	while (answered < pkts) {
+		for (; sent < pkts && sent - answered < client->winsz; sent++) {
+			if (send_sig_req(client, sent) < 0) {
+				fprintf(stderr, "myclient ~ fetch_signatures(): failed to send SIG request %u.\n", sent);
+				free(got);
+				return 1;
+			}
+
+			deadline_us = monotonic_us() + client->rto_us;
+		}
+
+		u_int64_t now_us = monotonic_us();
+		int poll_res = now_us >= deadline_us ? 0 : poll(fds, 1, (int)((deadline_us - now_us + 999) / 1000));
+		if (poll_res < 0) {
+			fprintf(stderr, "myclient ~ fetch_signatures(): an error occured while polling socket: %s\n", strerror(errno));
+			free(got);
+			return 1;
+		}
+
+		// resend every request still unanswered
+		if (poll_res == 0) {
+			fprintf(stderr, "Packet Loss Detected\n");
+
+			retransmits ++;
+			if (retransmits > 3) {
 				fprintf(stderr, "Reached max re-transmission limit IP %s\n", client->server.ip);
-				// exit(4);
+				free(got);
 				return 4;
 			}
+
+			backoff_rto(client);
+			deadline_us = monotonic_us() + client->rto_us;
+
+			for (u_int32_t idx = 0; idx < sent; idx++) {
+				if ((got == NULL || !got[idx]) && send_sig_req(client, idx) < 0) {
+					fprintf(stderr, "myclient ~ fetch_signatures(): failed to resend SIG request %u.\n", idx);
+					free(got);
+					return 1;
+				}
+			}
+
+			continue;
+		}
+
+		memset(pkt_buf, 0, sizeof(pkt_buf));
+
+		int bytes_recvd = recvfrom(client->sockfd, pkt_buf, sizeof(pkt_buf), 0, &client->serveraddr, &client->serveraddr_size);
+		if (bytes_recvd < 0) {
+			fprintf(stderr, "Server is down IP %s port %d\n", client->server.ip, client->server.port);
+			free(got);
+			return 5;
+		}
+
+		// a resent handshake ACK, nothing to do with the signatures
+		if (get_pkt_opcode(pkt_buf) != OP_SIG || bytes_recvd < SIG_HEADER_SIZE) continue;
+
+		if (log_pkt_recvd(client, pkt_buf) < 0) {
+			fprintf(stderr, "myclient ~ fetch_signatures(): encountered error logging pkt info.\n");
+			free(got);
+			return 1;
+		}
+
+		if (got == NULL) {
+			u_int64_t basis_size;
+			get_sig_basis(pkt_buf, &basis_size, block_sz);
+
+			if (basis_size > 0 && (*block_sz < DELTA_MIN_BLOCK || *block_sz > DELTA_MAX_BLOCK)) {
+				fprintf(stderr, "myclient ~ fetch_signatures(): server sent invalid block size %u.\n", *block_sz);
+				return 1;
+			}
+
+			*sig_count = basis_size == 0 ? 0 : delta_block_count(basis_size, *block_sz);
+			pkts = *sig_count == 0 ? 1 : (*sig_count + SIG_MAX_ENTRIES - 1) / SIG_MAX_ENTRIES;
+
+			got = calloc(pkts, sizeof(bool));
+			*sigs = *sig_count == 0 ? NULL : malloc(*sig_count * sizeof(struct block_sig));
+			if (got == NULL || (*sig_count > 0 && *sigs == NULL)) {
+				fprintf(stderr, "myclient ~ fetch_signatures(): failed to allocate signatures of %u blocks.\n", *sig_count);
+				free(got);
+				free(*sigs);
+				*sigs = NULL;
+				return 1;
+			}
+		}
+
+		u_int32_t idx = get_sig_idx(pkt_buf);
+		if (idx >= pkts || got[idx]) continue;
+
+		u_int32_t first = idx * SIG_MAX_ENTRIES;
+		u_int32_t entries = *sig_count - first < SIG_MAX_ENTRIES ? *sig_count - first : SIG_MAX_ENTRIES;
+		if ((u_int32_t)bytes_recvd < SIG_HEADER_SIZE + entries * SIG_ENTRY_SIZE) continue;
+
+		for (u_int32_t i = 0; i < entries; i++) {
+			get_sig_entry(pkt_buf, i, &(*sigs)[first + i].weak, &(*sigs)[first + i].strong);
+		}
+
+		got[idx] = true;
+		answered ++;
+		retransmits = 0;
+		deadline_us = monotonic_us() + client->rto_us;
+	}
+
+	free(got);
+
+	fprintf(stderr, "Fetched %u block signatures from IP %s port %d\n", *sig_count, client->server.ip, client->server.port);
+
+	return 0;
+}
+
+// send SIG request for response idx
+// return 0 on success, -1 on error
+int send_sig_req(struct client *client, u_int32_t idx) {
+	char pkt_buf[SIG_REQ_SIZE];
+
+	if (assign_sig_req(pkt_buf, client->id, idx) < 0) {
+		fprintf(stderr, "myclient ~ send_sig_req(): encountered error assigning SIG request.\n");
+		return -1;
+	}
+
+	return send_pkt(client, OP_SIG, pkt_buf, sizeof(pkt_buf));
+}
+
+// split infile into content defined chunks and ask which of them the server's chunk store holds, the DATA pkts then carry
+// a delta that names the held chunks by hash and sends the rest as literals
+// return 0 on success, exit code on error
+int start_dedup(struct client *client) {
+	// chunks are hashed straight from the mapping
+	if (client->in_map == NULL && client->in_size > 0) {
+		fprintf(stderr, "myclient ~ start_dedup(): dedup needs infile mapped.\n");
+		return 1;
+	}
+
+	struct chunk_ref *chunks;
+	u_int32_t chunk_count;
+
+	if (split_chunks((const u_int8_t *)client->in_map, client->in_size, &chunks, &chunk_count) < 0) {
+		fprintf(stderr, "myclient ~ start_dedup(): failed to split infile into chunks.\n");
+		return 1;
+	}
+
+	bool *held = calloc(chunk_count + 1, sizeof(bool));
+	if (held == NULL) {
+		fprintf(stderr, "myclient ~ start_dedup(): failed to allocate holdings of %u chunks.\n", chunk_count);
+		free(chunks);
+		return 1;
+	}
+
+	int res;
+	if ((res = fetch_chunk_holdings(client, chunks, chunk_count, held)) != 0) {
+		fprintf(stderr, "myclient ~ start_dedup(): failed to fetch chunk holdings of server.\n");
+		free(held);
+		free(chunks);
+		return res;
+	}
+
+	// delta takes over chunks
+	client->delta = init_dedup((const u_int8_t *)client->in_map, client->in_size, chunks, chunk_count, held);
+	free(held);
+
+	if (client->delta == NULL) {
+		fprintf(stderr, "myclient ~ start_dedup(): failed to initialize dedup.\n");
+		return 1;
+	}
+
+	// payloads are ops, the server digests the outfile they rebuild
+	digest_range(client, 0, client->in_size);
+
+	client->in_pos = 0;
+	client->in_end = 0;
+
+	// server answered HAVE requests, so it has accepted us
+	client->handshake_confirmed = true;
+
+	return 0;
+}
+
+// ask the server which of count chunks it holds, keeping up to winsz HAVE requests outstanding
+// held[i] is set for every chunk the server's store has
+// return 0 on success, exit code on error
+int fetch_chunk_holdings(struct client *client, struct chunk_ref *chunks, u_int32_t count, bool *held) {
+	char pkt_buf[MAX_SRVR_RES_SIZE];
+
+	if (client->mss < HAVE_HEADER_SIZE + CHUNK_HASH_SIZE) {
+		fprintf(stderr, "myclient ~ fetch_chunk_holdings(): mss %d is too small to ask about a chunk.\n", client->mss);
+		return 1;
+	}
+
+	// as many hashes as fit one pkt, and whose answering bitmap fits one server response
+	u_int32_t per = (u_int32_t)(client->mss - HAVE_HEADER_SIZE) / CHUNK_HASH_SIZE;
+	if (per > HAVE_MAX_HASHES) per = HAVE_MAX_HASHES;
+
+	u_int32_t pkts = (count + per - 1) / per;
+	bool *got = calloc(pkts + 1, sizeof(bool));
+	if (got == NULL) {
+		fprintf(stderr, "myclient ~ fetch_chunk_holdings(): failed to allocate answers of %u HAVE requests.\n", pkts);
+		return 1;
+	}
+
+	u_int32_t sent = 0;
+	u_int32_t answered = 0;
+	int retransmits = 0;
+
+	struct pollfd fds[1] = { { client->sockfd, POLLIN, 0 } };
+
+	// the rto runs from the last progress, like fetch_signatures()
+	u_int64_t deadline_us = 0;
+
+	while (answered < pkts) {
+		for (; sent < pkts && sent - answered < client->winsz; sent++) {
+			if (send_have_req(client, chunks, count, per, sent) < 0) {
+				fprintf(stderr, "myclient ~ fetch_chunk_holdings(): failed to send HAVE request %u.\n", sent);
+				free(got);
+				return 1;
+			}
+
+			deadline_us = monotonic_us() + client->rto_us;
+		}
+
+		u_int64_t now_us = monotonic_us();
+		int poll_res = now_us >= deadline_us ? 0 : poll(fds, 1, (int)((deadline_us - now_us + 999) / 1000));
+		if (poll_res < 0) {
+			fprintf(stderr, "myclient ~ fetch_chunk_holdings(): an error occured while polling socket: %s\n", strerror(errno));
+			free(got);
+			return 1;
+		}
+
+		// resend every request still unanswered
+		if (poll_res == 0) {
+			fprintf(stderr, "Packet Loss Detected\n");
+
+			retransmits ++;
+			if (retransmits > 3) {
+				fprintf(stderr, "Reached max re-transmission limit IP %s\n", client->server.ip);
+				free(got);
+				return 4;
+			}
+
+			backoff_rto(client);
+			deadline_us = monotonic_us() + client->rto_us;
+
+			for (u_int32_t idx = 0; idx < sent; idx++) {
+				if (!got[idx] && send_have_req(client, chunks, count, per, idx) < 0) {
+					fprintf(stderr, "myclient ~ fetch_chunk_holdings(): failed to resend HAVE request %u.\n", idx);
+					free(got);
+					return 1;
+				}
+			}
+
+			continue;
+		}
+
+		memset(pkt_buf, 0, sizeof(pkt_buf));
+
+		int bytes_recvd = recvfrom(client->sockfd, pkt_buf, sizeof(pkt_buf), 0, &client->serveraddr, &client->serveraddr_size);
+		if (bytes_recvd < 0) {
+			fprintf(stderr, "Server is down IP %s port %d\n", client->server.ip, client->server.port);
+			free(got);
+			return 5;
+		}
+
+		// a resent handshake ACK, nothing to do with the chunks
+		if (get_pkt_opcode(pkt_buf) != OP_HAVE || bytes_recvd < HAVE_HEADER_SIZE) continue;
+
+		if (log_pkt_recvd(client, pkt_buf) < 0) {
+			fprintf(stderr, "myclient ~ fetch_chunk_holdings(): encountered error logging pkt info.\n");
+			free(got);
+			return 1;
+		}
+
+		u_int32_t idx = get_sig_idx(pkt_buf);
+		if (idx >= pkts || got[idx]) continue;
+
+		u_int32_t first = idx * per;
+		u_int32_t asked = count - first < per ? count - first : per;
+		if (get_have_count(pkt_buf) != asked || (u_int32_t)bytes_recvd < HAVE_HEADER_SIZE + (asked + 7) / 8) continue;
+
+		u_int8_t *bitmap = (u_int8_t *)pkt_buf + HAVE_HEADER_SIZE;
+		for (u_int32_t i = 0; i < asked; i++) {
+			held[first + i] = (bitmap[i / 8] >> (i % 8)) & 1;
+		}
+
+		got[idx] = true;
+		answered ++;
+		retransmits = 0;
+		deadline_us = monotonic_us() + client->rto_us;
+	}
+
+	free(got);
+
+	u_int32_t held_count = 0;
+	for (u_int32_t i = 0; i < count; i++) held_count += held[i];
+
+	fprintf(stderr, "Server holds %u of %u chunks IP %s port %d\n", held_count, count, client->server.ip, client->server.port);
+
+	return 0;
+}
+
+// send HAVE request idx, asking about the idx-th run of per chunk hashes out of count
+// return 0 on success, -1 on error
+int send_have_req(struct client *client, struct chunk_ref *chunks, u_int32_t count, u_int32_t per, u_int32_t idx) {
+	char pkt_buf[client->mss];
+
+	u_int32_t first = idx * per;
+	u_int32_t asked = count - first < per ? count - first : per;
+
+	if (assign_have_req(pkt_buf, client->id, idx, asked) < 0) {
+		fprintf(stderr, "myclient ~ send_have_req(): encountered error assigning HAVE request.\n");
+		return -1;
+	}
+
+	for (u_int32_t i = 0; i < asked; i++) {
+		memcpy(pkt_buf + HAVE_HEADER_SIZE + i * CHUNK_HASH_SIZE, chunks[first + i].hash, CHUNK_HASH_SIZE);
+	}
+
+	return send_pkt(client, OP_HAVE, pkt_buf, HAVE_HEADER_SIZE + asked * CHUNK_HASH_SIZE);
+}
+
+// print compression ratio and cost, and the link speed below which compressing paid off
+void report_compression(struct client *client) {
+	if (!client->compress || client->raw_bytes == 0) return;
+
+	// sending raw takes raw / bw, compressed takes wire / bw + compress_us, so compressing wins below (raw - wire) / compress_us
+	u_int64_t saved = client->raw_bytes > client->wire_bytes ? client->raw_bytes - client->wire_bytes : 0;
+	double crossover_mbps = client->compress_us == 0 ? 0 : (double)saved * 8 / client->compress_us;
+
+	fprintf(stderr, "Compression IP %s port %d: %llu payload bytes sent as %llu (%.2fx), %.1f ms compressing (%.0f MB/s), pays off below %.0f Mbit/s\n",	client->server.ip,
+																																				client->server.port,
+																																				(unsigned long long)client->raw_bytes,
+																																				(unsigned long long)client->wire_bytes,
+																																				client->wire_bytes == 0 ? 0 : (double)client->raw_bytes / client->wire_bytes,
+																																				client->compress_us / 1000.0,
+																																				client->compress_us == 0 ? 0 : (double)client->raw_bytes / client->compress_us,
+																																				crossover_mbps);
+}
+
+// print what checksumming cost, as throughput and as a share of the transfer
+void report_checksum(struct client *client) {
+	u_int64_t elapsed_us = monotonic_us() - client->cwnd_start_us;
+
+	fprintf(stderr, "Checksum IP %s port %d: %llu bytes in %.1f ms (%.0f MB/s), %.2f%% of %.1f ms transfer, digest %08x%s\n",	client->server.ip,
+																																client->server.port,
+																																(unsigned long long)client->crc_bytes,
+																																client->crc_us / 1000.0,
+																																client->crc_us == 0 ? 0 : (double)client->crc_bytes / client->crc_us,
+																																elapsed_us == 0 ? 0 : 100.0 * client->crc_us / elapsed_us,
+																																elapsed_us / 1000.0,
+																																client->digest,
+																																client->server_digest_known ? " matched by server" : "");
+}
+
+// print how much of the delta was sent as literals and how much the server copied from its old outfile or chunk store
+void report_delta(struct client *client) {
+	if (client->delta == NULL) return;
+
+	fprintf(stderr, "Delta IP %s port %d: %lld literal bytes, %lld bytes copied from %s, %lld byte stream\n", 	client->server.ip,
+																														client->server.port,
+																														(long long)client->delta->literal_bytes,
+																														(long long)client->delta->copied_bytes,
+																														client->opts->dedup ? "chunk store" : "old outfile",
+																														(long long)client->delta->size);
+}
+
+// tell the chunk cache this replica is done with every chunk before acked_end
+void release_chunks(struct client *client, off_t acked_end) {
+	if (client->cache == NULL) return;
+
+	// ranges start on a chunk boundary, only the last one ends on a partial chunk
+	u_int32_t last = acked_end >= client->in_end ? (client->in_end + client->cache->chunk_size - 1) / client->cache->chunk_size : acked_end / client->cache->chunk_size;
+
+	if (last > client->chunks_released) {
+		chunk_cache_release(client->cache, client->chunks_released, last);
+		client->chunks_released = last;
+	}
+}
+
+// map the whole infile read only, payloads are then sent straight out of the mapping
+// return 0 on success, -1 on error, infile is read as usual if it can't be mapped
+int map_infile(struct client *client) {
+	struct stat st;
+	if (fstat(client->infd, &st) < 0) {
+		fprintf(stderr, "myclient ~ map_infile(): encountered error getting infile size: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// nothing to map, an empty file is one 0 payload pkt either way
+	if (st.st_size == 0) return 0;
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, client->infd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "myclient ~ map_infile(): encountered error mapping infile: %s\n", strerror(errno));
+		return -1;
+	}
+
+	// each window walks the file front to back, let the kernel read ahead aggressively
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	client->in_map = map;
+	client->in_size = st.st_size;
+	client->in_pos = 0;
+
+	return 0;
+}
+
+// record infile's mtime and the crc of its first bytes, sent with a resume
+// return 0 on success, -1 on error
+int identify_infile(struct client *client) {
+	struct stat st;
+	if (fstat(client->infd, &st) < 0) {
+		fprintf(stderr, "myclient ~ identify_infile(): failed to stat infile: %s\n", strerror(errno));
+		return -1;
+	}
+
+	client->in_mtime = (u_int64_t)st.st_mtim.tv_sec * 1000000000ull + (u_int64_t)st.st_mtim.tv_nsec;
+
+	off_t len = client->in_size < INFILE_PREFIX_BYTES ? client->in_size : INFILE_PREFIX_BYTES;
+	char prefix[INFILE_PREFIX_BYTES];
+	if (pread_n_bytes(client->infd, prefix, (int)len, 0) != (int)len) {
+		fprintf(stderr, "myclient ~ identify_infile(): failed to read the first %lld bytes of infile.\n", (long long)len);
+		return -1;
+	}
+
+	client->in_crc = crc32c(0, prefix, len);
+
+	return 0;
+}
+
+// skip the first bytes of client's range, the server already has them on disk
+// return 0 on success, -1 on error
+int resume_range(struct client *client, off_t bytes) {
+	if (bytes > client->in_end - client->range_off) bytes = client->in_end - client->range_off;
+
+	// they're still part of the range the server's digest covers
+	if (digest_range(client, client->range_off, bytes) < 0) {
+		fprintf(stderr, "myclient ~ resume_range(): encountered error digesting the first %lld bytes of infile.\n", (long long)bytes);
+		return -1;
+	}
+
+	client->in_pos = client->range_off + bytes;
+
+	// nothing before the resume point will be sent, its chunks are done
+	release_chunks(client, client->in_pos);
+
+	fprintf(stderr, "Resuming IP %s port %d after %lld of %lld bytes\n", client->server.ip, client->server.port, (long long)bytes, (long long)(client->in_end - client->range_off));
+
+	return 0;
+}
+
+// fold len bytes of infile from off into client's digest, out of the mapping if there is one
+// return 0 on success, -1 on error
+int digest_range(struct client *client, off_t off, off_t len) {
+	u_int64_t start_us = monotonic_us();
+
+	if (client->in_map != NULL) {
+		client->digest = crc32c(client->digest, client->in_map + off, len);
+	} else if (file_digest(client->infd, off, len, &client->digest) < 0) {
+		fprintf(stderr, "myclient ~ digest_range(): encountered error reading %lld bytes of infile at %lld.\n", (long long)len, (long long)off);
+		return -1;
+	}
+
+	client->crc_us += monotonic_us() - start_us;
+	client->crc_bytes += len;
+
+	return 0;
+}
+
+// split size bytes into *streams ranges of whole chunks, *streams is lowered if the file is too small to need them all
+// return bytes per range, the last range takes whatever is left
+off_t stream_span(off_t size, int *streams, int mss) {
+	off_t chunk = CHUNK_PKTS * (off_t)(mss - DATA_HEADER_SIZE);
+
+	// chunk aligned ranges never share a chunk cache chunk or a payload
+	off_t span = (size + *streams - 1) / *streams;
+	span = (span + chunk - 1) / chunk * chunk;
+
+	if (span == 0) {
+		*streams = 1;
+	} else {
+		*streams = (size + span - 1) / span;
+	}
+
+	return span;
+}
+
+// make client one stream of transfer tag, sending infile bytes [start, end), end -1 sends through the end of the file
+void set_client_range(struct client *client, u_int32_t tag, off_t start, off_t end) {
+	if (end < 0 || end > client->in_size) end = client->in_size;
+
+	client->range_tag = tag;
+	client->range_off = start;
+	client->range_last = end == client->in_size;
+
+	client->in_pos = start;
+	client->in_end = end;
+
+	// chunks before this range belong to other streams
+	if (client->cache != NULL) client->chunks_released = start / client->cache->chunk_size;
+}
+
+// enable SO_TXTIME on the socket for txtime pacing, falling back to sleeping if it isn't available
+void init_pacing(struct client *client, enum pacing_mode pacing) {
+	client->pacing = pacing;
+	client->pace_gap_us = 0;
+	client->next_send_us = 0;
+	client->txtime_us = 0;
+
+	if (pacing != PACING_TXTIME) return;
+
+#ifdef SO_TXTIME
+	struct sock_txtime txtime = { CLOCK_MONOTONIC, 0 };
+
+	if (setsockopt(client->sockfd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == 0) return;
+
+	fprintf(stderr, "myclient ~ init_pacing(): SO_TXTIME unavailable, pacing with sleeps instead: %s\n", strerror(errno));
+#else
+	fprintf(stderr, "myclient ~ init_pacing(): SO_TXTIME unsupported, pacing with sleeps instead.\n");
+#endif
+
+	client->pacing = PACING_SLEEP;
+}
+
+// spread the next round over srtt at cwnd pkts per srtt times the pacing gain
+void start_pacing_round(struct client *client) {
+	client->next_send_us = monotonic_us();
+
+	// no srtt to spread over yet, the first rounds go out as bursts
+	if (client->pacing == PACING_BURST || !client->rtt_sampled) {
+		client->pace_gap_us = 0;
+		return;
+	}
+
+	u_int64_t gain = client->cwnd < client->ssthresh ? PACING_GAIN_SS : PACING_GAIN_CA;
+
+	client->pace_gap_us = client->srtt_us * 100 / (client->cwnd * gain);
+}
+
+// hold the next DATA pkt until its departure time, or leave that to the qdisc with txtime pacing
+// return 0 on success, -1 on error
+int pace_pkt(struct client *client) {
+	if (client->pace_gap_us == 0) return 0;
+
+	// a pkt that's already late goes now, later ones keep their gap instead of bunching up behind it
+	u_int64_t now_us = monotonic_us();
+
+	client->txtime_us = client->next_send_us > now_us ? client->next_send_us : now_us;
+	client->next_send_us = client->txtime_us + client->pace_gap_us;
+
+	if (client->pacing != PACING_SLEEP) return 0;
+
+	// queued batch already left at its first pkt's time, this one rides along unless it's due well after that
+	struct gso_batch *gb = client->gso_batch;
+	if (gb != NULL && gb->count > 0) {
+		if (client->txtime_us <= gb->txtime_us + GSO_PACE_SLACK_US) return 0;
+
+		if (flush_gso_batch(client) < 0) {
+			fprintf(stderr, "myclient ~ pace_pkt(): failed to flush queued DATA pkts before pacing gap.\n");
+			return -1;
 		}
 	}
 
+	if (client->txtime_us > now_us + PACING_SPIN_US) {
+		struct timespec until = { (time_t)(client->txtime_us / 1000000), (long)(client->txtime_us % 1000000) * 1000 };
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+	}
+
+	while (monotonic_us() < client->txtime_us);
+
+	return 0;
+}
+
+// check the socket takes UDP_SEGMENT and set up the batch DATA pkts are queued in, pkts are sent one by one if it doesn't
+// return 0 on success, -1 on error
+int init_gso(struct client *client) {
+	if (!client->gso) return 0;
+
+	// segment size is set per send, this only asks whether the kernel knows the option
+	int seg_sz;
+	socklen_t len = sizeof(seg_sz);
+
+	if (getsockopt(client->sockfd, SOL_UDP, UDP_SEGMENT, &seg_sz, &len) < 0) {
+		fprintf(stderr, "myclient ~ init_gso(): UDP_SEGMENT unavailable, sending DATA pkts one at a time: %s\n", strerror(errno));
+		client->gso = false;
+		return 0;
+	}
+
+	client->gso_batch = malloc(sizeof(struct gso_batch));
+	if (client->gso_batch == NULL) {
+		fprintf(stderr, "myclient ~ init_gso(): failed to allocate memory to gso batch.\n");
+		return -1;
+	}
+
+	client->gso_batch->iovcnt = 0;
+	client->gso_batch->count = 0;
+	client->gso_batch->seg_sz = 0;
+	client->gso_batch->bytes = 0;
+	client->gso_batch->txtime_us = 0;
+	client->gso_batch->arena_used = 0;
+
 	return 0;
 }
 
+// queue DATA pkt gathered from iov for the next flush_gso_batch(), flushing first if it can't join the queued pkts
+// the header is copied, the payload in iov[1] too unless pyld_stable says it outlives the batch
+// return 0 on success, -1 on error
+int queue_gso_pkt(struct client *client, struct iovec *iov, int iovcnt, bool pyld_stable) {
+	struct gso_batch *gb = client->gso_batch;
+
+	size_t pkt_size = 0;
+	for (int i = 0; i < iovcnt; i++) pkt_size += iov[i].iov_len;
+
+	// kernel cuts the batch every seg_sz bytes, so only the last pkt may be shorter than the first
+	bool joins = gb->count == 0 || (gb->count < GSO_MAX_SEGS && gb->bytes % gb->seg_sz == 0 && pkt_size <= gb->seg_sz && gb->bytes + pkt_size <= GSO_MAX_BYTES);
+
+	if (!joins && flush_gso_batch(client) < 0) {
+		fprintf(stderr, "myclient ~ queue_gso_pkt(): failed to flush full gso batch.\n");
+		return -1;
+	}
+
+	if (gb->count == 0) {
+		gb->seg_sz = pkt_size;
+		gb->txtime_us = client->txtime_us;
+	}
+
+	gb->first_iov[gb->count] = gb->iovcnt;
+
+	for (int i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len == 0) continue;
+
+		// mapped payload is still sent straight from the page cache
+		if (i > 0 && pyld_stable) {
+			gb->iovs[gb->iovcnt++] = iov[i];
+			continue;
+		}
+
+		char *dst = gb->arena + gb->arena_used;
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		gb->arena_used += iov[i].iov_len;
+
+		gb->iovs[gb->iovcnt].iov_base = dst;
+		gb->iovs[gb->iovcnt].iov_len = iov[i].iov_len;
+		gb->iovcnt ++;
+	}
+
+	gb->bytes += pkt_size;
+	gb->count ++;
+
+	if (log_pkt_sent(client, iov[0].iov_base) < 0) {
+		fprintf(stderr, "myclient ~ queue_gso_pkt(): failed to log pkt sent.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+// send every queued DATA pkt in one sendmsg(), the kernel splits it into datagrams of seg_sz bytes
+// return 0 on success, -1 on error
+int flush_gso_batch(struct client *client) {
+	struct gso_batch *gb = client->gso_batch;
+	if (gb == NULL || gb->count == 0) return 0;
+
+	struct msghdr msg = { &client->serveraddr, client->serveraddr_size, gb->iovs, gb->iovcnt, NULL, 0, 0 };
+
+	u_int16_t seg_sz = (u_int16_t)gb->seg_sz;
+	char ctrl_buf[CMSG_SPACE(sizeof(seg_sz))];
+
+	// a lone pkt is just a datagram
+	if (gb->count > 1) {
+		memset(ctrl_buf, 0, sizeof(ctrl_buf));
+		msg.msg_control = ctrl_buf;
+		msg.msg_controllen = sizeof(ctrl_buf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(seg_sz));
+		memcpy(CMSG_DATA(cmsg), &seg_sz, sizeof(seg_sz));
+	}
+
+	int res = sendmsg(client->sockfd, &msg, 0);
+
+	// route can't segment, a device without checksum offload or pkts over its mtu, so the batch goes out one pkt at a time and batching stops
+	if (res < 0 && gb->count > 1 && (errno == EIO || errno == EINVAL)) {
+		fprintf(stderr, "myclient ~ flush_gso_batch(): kernel refused UDP_SEGMENT send, sending DATA pkts one at a time: %s\n", strerror(errno));
+		client->gso = false;
+
+		msg.msg_control = NULL;
+		msg.msg_controllen = 0;
+
+		res = 0;
+		for (int i = 0; i < gb->count && res >= 0; i++) {
+			msg.msg_iov = gb->iovs + gb->first_iov[i];
+			msg.msg_iovlen = (i + 1 < gb->count ? gb->first_iov[i + 1] : gb->iovcnt) - gb->first_iov[i];
+
+			res = sendmsg(client->sockfd, &msg, 0);
+		}
+	}
+
+	if (res < 0) {
+		fprintf(stderr, "myclient ~ flush_gso_batch(): failed to send %d DATA pkts to server: %s\n", gb->count, strerror(errno));
+	} else {
+		client->gso_sends ++;
+		client->gso_pkts += gb->count;
+	}
+
+	gb->iovcnt = 0;
+	gb->count = 0;
+	gb->bytes = 0;
+	gb->arena_used = 0;
+
+	return res < 0 ? -1 : 0;
+}
+
+// print how many DATA pkts each sendmsg() carried
+void report_gso(struct client *client) {
+	if (client->gso_sends == 0) return;
+
+	fprintf(stderr, "GSO IP %s port %d: %llu DATA pkts in %llu sends, %.1f pkts per send\n", 	client->server.ip,
+																					client->server.port,
+																					(unsigned long long)client->gso_pkts,
+																					(unsigned long long)client->gso_sends,
+																					(double)client->gso_pkts / client->gso_sends);
+}
+
+// grow cwnd for acked pkts newly acked by a cumulative ACK, slow start below ssthresh, additive increase above
+void grow_cwnd(struct client *client, u_int32_t acked) {
+	if (acked == 0 || client->cwnd >= client->winsz) return;
+
+	// cwnd holds at ssthresh until every pkt in flight at the cut has been acked
+	if (client->in_recovery && client->cwnd >= client->ssthresh) return;
+
+	if (client->cwnd < client->ssthresh) {
+		// one more pkt per pkt acked, doubles every round
+		client->cwnd += acked;
+		if (client->cwnd > client->ssthresh) client->cwnd = client->ssthresh;
+	} else {
+		// one more pkt per cwnd pkts acked, about one per round
+		client->cwnd_acc += acked;
+		if (client->cwnd_acc < client->cwnd) return;
+
+		client->cwnd_acc -= client->cwnd;
+		client->cwnd ++;
+	}
+
+	if (client->cwnd > client->winsz) client->cwnd = client->winsz;
+	if (client->cwnd > client->cwnd_max) client->cwnd_max = client->cwnd;
+
+	log_cwnd(client);
+}
+
+// halve cwnd on loss, a timeout also drops it to one pkt and restarts slow start
+void cut_cwnd(struct client *client, bool timeout) {
+	client->ssthresh = client->cwnd / 2 > CWND_MIN_SSTHRESH ? client->cwnd / 2 : CWND_MIN_SSTHRESH;
+	client->cwnd = timeout ? 1 : client->ssthresh;
+	if (client->cwnd > client->winsz) client->cwnd = client->winsz;
+
+	client->cwnd_acc = 0;
+	client->in_recovery = true;
+	client->recover_sn = client->last_sent_sn;
+
+	if (timeout) {
+		client->cwnd_timeouts ++;
+	} else {
+		client->cwnd_cuts ++;
+	}
+
+	log_cwnd(client);
+}
+
+// append cwnd and ssthresh to the cwnd log, if one was requested
+void log_cwnd(struct client *client) {
+	if (client->opts == NULL || client->opts->cwnd_log == NULL) return;
+
+	fprintf(client->opts->cwnd_log, "%s, %d, %llu, %u, %u\n", 	client->server.ip,
+															client->server.port,
+															(unsigned long long)((monotonic_us() - client->cwnd_start_us) / 1000),
+															client->cwnd,
+															client->ssthresh);
+}
+
+// print the cwnd trajectory summary for client
+void report_cwnd(struct client *client) {
+	double avg = client->cwnd_rounds == 0 ? 0 : (double)client->cwnd_sum / client->cwnd_rounds;
+
+	fprintf(stderr, "Congestion window IP %s port %d: avg %.1f, max %u, final %u, ssthresh %u, %u rounds, %u loss cuts, %u timeouts\n",	client->server.ip,
+																																		client->server.port,
+																																		avg,
+																																		client->cwnd_max,
+																																		client->cwnd,
+																																		client->ssthresh,
+																																		client->cwnd_rounds,
+																																		client->cwnd_cuts,
+																																		client->cwnd_timeouts);
+}
+
 // wait for server response, ack_pkt_sn is output
-// return 0 on success, 1 on resend, -1 on error
+// return 0 on success, 1 on resend, 2 on BUSY, -1 on error
 int recv_server_response(struct client *client) {
 	if (client == NULL) {
 		fprintf(stderr, "myclient ~ recv_server_response(): cannot recv server response with NULL client ptr\n");
@@ -741,88 +2275,130 @@ int recv_server_response(struct client *client) {
 	char pkt_buf[MAX_SRVR_RES_SIZE];
 	memset(pkt_buf, 0, sizeof(pkt_buf));
 
-	// configure fds and timeout for select() call
-	// fd_set fds;
-	// FD_SET(client->sockfd, &fds);
-
-	// struct timeval timeout = { LOSS_TIMEOUT_SECS, 0 };
-
 	int bytes_recvd;
 
-	u_int32_t ack_sn;
-
 	struct pollfd fds[1] = { {client->sockfd, POLLIN, 0 } };
 
+	// wait one rto, rounded up to poll() granularity
 	int poll_res;
-	if ((poll_res = poll(fds, 1, LOSS_TIMEOUT_SECS * 1000)) > 0) {
+	if ((poll_res = poll(fds, 1, (int)((client->rto_us + 999) / 1000))) > 0) {
+		if ((bytes_recvd = recvfrom(client->sockfd, pkt_buf, sizeof(pkt_buf), 0, &client->serveraddr, &client->serveraddr_size)) >= 0) {
+			// late answer to a SIG or HAVE request that was resent, keep waiting for the ACK
+			if (get_pkt_opcode(pkt_buf) == OP_SIG || get_pkt_opcode(pkt_buf) == OP_HAVE) return recv_server_response(client);
 
-	// pthread_mutex_lock(client->mut);
-	// if (select(client->sockfd + 1, &fds, NULL, NULL, &timeout) > 0) { // check there is data to be read from socket
-	// 	if (!FD_ISSET(client->sockfd, &fds)) {
-	// 		return recv_server_response(client);
-	// 	}
-		if ((bytes_recvd = recvfrom(client->sockfd, pkt_buf, sizeof(pkt_buf), 0, &client->serveraddr, &client->serveraddr_size)) >= 0) {			
-			// pthread_mutex_unlock(client->mut);
-			// recvfrom success
-			int opcode = get_pkt_opcode(pkt_buf);
-			// printf("PACKET RECEIVED\n");
-			switch (opcode) {
-				case OP_ACK:
-					ack_sn = get_ack_sn(pkt_buf);	// assign pkt sn to ack_pkt_sn
-					if (ack_sn == 0 && errno == 1) {
-						fprintf(stderr, "myclient ~ recv_server_response(): failed to get ACK sn from pkt.\n");
-						return -1;
-					}
-
-					if (log_pkt_recvd(client, pkt_buf) < 0) {
-						fprintf(stderr, "myclient ~ send_window_pkts(): encountered error logging pkt info.\n");
-						return -1;
-					}
-
-					if (ack_sn == client->last_ackd_sn) return 1; // repeat ACK, last transmission not recvd
-
-					client->last_ackd_sn = ack_sn;
-					break;
-				case OP_BUSY:
-					// TODO: idk how this is supposed to be handled tbh so make sure it's right
-					fprintf(stderr, "myclient ~ recv_server_response(): received BUSY from server\n");
-					if (log_pkt_recvd(client, pkt_buf) < 0) {
-						fprintf(stderr, "myclient ~ send_window_pkts(): encountered error logging pkt info.\n");
-						return -1;
-					}
-					return 2;
-					break;
-				default:
-					// TODO: make sure this is implemented correctly too
-					fprintf(stderr, "myclient ~ recv_server_response(): unrecognized opcode received from server: %d.\n", opcode);
-					return -1;
-					break;
-			};
+			return process_server_response(client, pkt_buf, bytes_recvd);
 		} else { // recvfrom failed
-			// pthread_mutex_unlock(client->mut);
 			fprintf(stderr, "Server is down IP %s port %d\n", client->server.ip, client->server.port);
 			// exit(5);
 			return 5;
 		}
 	} else if (poll_res == 0) {
-		fprintf(stderr, "Packet Loss Detected\n");
-		return 1;
+		return response_timeout(client);
 	} else {
 		fprintf(stderr, "myclient ~ recv_server_response(): an error occured while polling socket: %s\n", strerror(errno));
 		return -1;
 	}
-	
-	// else { // after timeout
-	// 	// pthread_mutex_unlock(client->mut);
-	// 	// TODO: retransmit pkt window since we didn't hear back from the server, keep track of retransmits per pkt
-	// 	//		also make sure to update the error message V V V
-	// 	fprintf(stderr, "Packet Loss Detected\n");
-	// 	return 1;
-	// }
 
 	return 0;
 }
 
+// handle bytes_recvd byte response in pkt_buf from the server
+// return 0 on success, 1 on resend, 2 on BUSY, -1 on error
+int process_server_response(struct client *client, char *pkt_buf, int bytes_recvd) {
+	u_int32_t ack_sn;
+
+	int opcode = get_pkt_opcode(pkt_buf);
+	switch (opcode) {
+		case OP_SACK:
+		case OP_ACK:
+			if (client->rtt_pending) {
+				update_rto(client, monotonic_us() - client->rtt_start_us);
+			}
+
+			ack_sn = get_ack_sn(pkt_buf);	// assign pkt sn to ack_pkt_sn
+			if (ack_sn == 0 && errno == 1) {
+				fprintf(stderr, "myclient ~ process_server_response(): failed to get ACK sn from pkt.\n");
+				return -1;
+			}
+
+			// handshake ACK says how much of the range the server kept, a server that can't resume sends none
+			if (client->id == 0 && opcode == OP_ACK && bytes_recvd >= ACK_HEADER_SIZE + RESUME_OFF_BYTES) {
+				client->resume_off = (off_t)get_ack_resume_off(pkt_buf);
+			}
+
+			// termination ACK carries the server's digest of what it wrote
+			if (client->eof_sent && opcode == OP_ACK && bytes_recvd >= ACK_HEADER_SIZE + DIGEST_BYTES) {
+				client->server_digest = get_digest(pkt_buf, ACK_HEADER_SIZE);
+				client->server_digest_known = true;
+			}
+
+			// payloads are only compressed once the server says it can expand them
+			if (client->id == 0 && opcode == OP_ACK && bytes_recvd >= ACK_HEADER_SIZE + RESUME_OFF_BYTES + ACCEPTED_FLAGS_BYTES) {
+				client->compress = (get_ack_accepted(pkt_buf) & RANGE_FLAG_COMPRESS) != 0;
+			}
+
+			if (log_pkt_recvd(client, pkt_buf) < 0) {
+				fprintf(stderr, "myclient ~ process_server_response(): encountered error logging pkt info.\n");
+				return -1;
+			}
+
+			// sacked pkts are skipped by the next send_window_pkts(), even if ack_sn didn't move
+			if (opcode == OP_SACK && bytes_recvd > ACK_HEADER_SIZE) {
+				apply_sack(client, ack_sn, (u_int8_t *)pkt_buf + ACK_HEADER_SIZE, bytes_recvd - (ACK_HEADER_SIZE));
+			}
+
+			// holes past ack_sn mean loss, cut once per window of data
+			if (opcode == OP_SACK && client->handshake_confirmed && !client->in_recovery) {
+				cut_cwnd(client, false);
+			}
+
+			if (ack_sn == client->last_ackd_sn) return 1; // repeat ACK, last transmission not recvd
+
+			client->last_ackd_sn = ack_sn;
+			client->stalled_rtos = 0;
+			break;
+		case OP_BUSY:
+			// TODO: idk how this is supposed to be handled tbh so make sure it's right
+			fprintf(stderr, "myclient ~ process_server_response(): received BUSY from server\n");
+			client->rtt_pending = false;	// the accepting ACK comes whenever the path frees up
+			if (log_pkt_recvd(client, pkt_buf) < 0) {
+				fprintf(stderr, "myclient ~ process_server_response(): encountered error logging pkt info.\n");
+				return -1;
+			}
+			return 2;
+			break;
+		default:
+			// TODO: make sure this is implemented correctly too
+			fprintf(stderr, "myclient ~ process_server_response(): unrecognized opcode received from server: %d.\n", opcode);
+			return -1;
+			break;
+	};
+
+	return 0;
+}
+
+// no response within one rto, back off and shrink cwnd before everything unacked is resent
+// return 1, the window needs resending, 4 once MAX_STALLED_RTOS have passed without the server acking anything
+int response_timeout(struct client *client) {
+	fprintf(stderr, "Packet Loss Detected\n");
+	backoff_rto(client);
+
+	// a lost WR says nothing about the data path, the handshake counts its own resends
+	if (client->id == 0) return 1;
+
+	cut_cwnd(client, true);
+
+	// only a silent server gives up, single lost pkts are resent as often as it takes
+	client->stalled_rtos ++;
+	if (client->stalled_rtos > MAX_STALLED_RTOS) {
+		fprintf(stderr, "Reached max re-transmission limit IP %s\n", client->server.ip);
+		// exit(4);
+		return 4;
+	}
+
+	return 1;
+}
+
 // prints log message of pkt
 // returns 0 on success, -1 on error
 int log_pkt_sent(struct client *client, char *pkt_buf) {
@@ -835,14 +2411,14 @@ int log_pkt_sent(struct client *client, char *pkt_buf) {
 		return -1;
 	}
 
-	if (opcode < OP_WR || opcode > OP_DATA) {
+	if ((opcode < OP_WR || opcode > OP_DATA) && opcode != OP_SIG && opcode != OP_HAVE) {
 		fprintf(stderr, "myclient ~ log_pkt_sent(): opcode %u is not supported by server.\n", opcode);
 		return -1;
 	}
 
 	char *opstring = opcode == OP_DATA ? "DATA" : "CTRL";
 
-	u_int32_t sn = opcode == OP_WR ? get_wr_sn(pkt_buf) : (opcode == OP_ACK ? get_ack_sn(pkt_buf) : get_data_sn(pkt_buf));
+	u_int32_t sn = opcode == OP_WR ? get_wr_sn(pkt_buf) : (opcode == OP_ACK ? get_ack_sn(pkt_buf) : (opcode == OP_SIG || opcode == OP_HAVE ? get_sig_idx(pkt_buf) : get_data_sn(pkt_buf)));
 	if (sn == 0 && errno == 1) {
 		fprintf(stderr, "myclient ~ log_pkt_sent(): encountered an error getting pkt sn from pkt.\n");
 		return -1;
@@ -888,14 +2464,14 @@ int log_pkt_recvd(struct client *client, char *pkt_buf) {
 		return -1;
 	}
 
-	if (opcode < OP_WR || opcode > OP_BUSY) {
+	if (opcode < OP_WR || opcode > OP_HAVE) {
 		fprintf(stderr, "myclient ~ log_pkt_recvd(): opcode %u is not supported by server.\n", opcode);
 		return -1;
 	}
 
-	char *opstring = opcode == OP_ACK ? "ACK" : "CTRL";
+	char *opstring = opcode == OP_ACK ? "ACK" : (opcode == OP_SACK ? "SACK" : "CTRL");
 
-	u_int32_t sn = opcode == OP_WR ? get_wr_sn(pkt_buf) : (opcode == OP_ACK ? get_ack_sn(pkt_buf) : 0);
+	u_int32_t sn = opcode == OP_WR ? get_wr_sn(pkt_buf) : ((opcode == OP_ACK || opcode == OP_SACK) ? get_ack_sn(pkt_buf) : (opcode == OP_SIG || opcode == OP_HAVE ? get_sig_idx(pkt_buf) : 0));
 	if (sn == 0 && errno == 1) {
 		fprintf(stderr, "myclient ~ log_pkt_recvd(): encountered an error getting pkt sn from pkt.\n");
 		return -1;
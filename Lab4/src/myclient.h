@@ -1,11 +1,70 @@
 #ifndef MYCLIENT_INCLUDE
 #define MYCLIENT_INCLUDE
 
+#include "timer_wheel.h"
+#include "delta.h"
+
+#define RTO_INITIAL_US (LOSS_TIMEOUT_SECS * 1000000ull)				// rto until the first rtt sample
+#define RTO_MIN_US 200000ull										// floor so a scheduling hiccup isn't mistaken for loss
+#define RTO_MAX_US (TIMEOUT_SECS * 1000000ull)						// cap for exponential backoff
+#define RTO_CLOCK_US 1000ull										// poll() granularity, G in RFC 6298
+#define MAX_STALLED_RTOS 5											// rtos in a row without the cumulative ACK moving before the server is given up on
+
+#define CWND_INITIAL 4												// pkts sent in the first round, capped at winsz
+#define CWND_MIN_SSTHRESH 2											// floor for ssthresh after a loss
+
+#define PACING_GAIN_SS 200											// pacing rate in percent of cwnd per srtt, leaves slow start room to grow
+#define PACING_GAIN_CA 120
+#define PACING_SPIN_US 50											// gaps shorter than this are spun, nanosleep overshoots them
+
+#define GSO_MAX_SEGS 64												// UDP_MAX_SEGMENTS, the most datagrams the kernel cuts one send into
+#define GSO_MAX_BYTES 65507											// largest UDP payload over IPv4, a whole batch has to fit in one
+#define GSO_PACE_SLACK_US 1000										// paced pkts due this soon after a batch's first one leave with it, like TCP's TSO autosizing
+
+// how the pkts of a round are spread out
+enum pacing_mode {
+	PACING_BURST,				// back to back, as fast as sendto() takes them
+	PACING_SLEEP,				// sleep the inter-pkt gap between sends
+	PACING_TXTIME				// stamp each pkt with its departure time and let the fq qdisc hold it (SO_TXTIME)
+};
+
+// options shared by every replica thread
+struct client_opts {
+	FILE *cwnd_log;				// -c, every cwnd change is appended here, NULL if not requested
+	enum pacing_mode pacing;	// -p burst|paced|txtime
+	bool mmap_infile;			// -m, send payloads straight from a mapping of infile
+	bool fan_out;				// -f, replicas share one read of infile through cache
+	struct chunk_cache *cache;
+	bool event_loop;			// -e, one thread drives every client over sockfd
+	int sockfd;					// socket shared by every client, -1 if each has its own
+	int streams;				// -s, clients per server, each sending one range of infile
+	bool resume;				// -r, ask servers to keep what an interrupted transfer already wrote
+	bool delta;					// -d, send only what changed against each server's existing outfile
+	bool compress;				// -z, ask servers to take compressed DATA payloads
+	bool dedup;					// -k, send only the chunks each server's chunk store doesn't hold
+	bool gso;					// -g, hand the kernel each burst of DATA pkts as one UDP_SEGMENT send
+};
+
+// DATA pkts waiting to leave in one UDP_SEGMENT sendmsg(), every pkt but the last is exactly seg_sz bytes
+struct gso_batch {
+	struct iovec iovs[2 * GSO_MAX_SEGS];
+	int first_iov[GSO_MAX_SEGS];	// iov each pkt starts at, so they can be sent one by one if the route can't segment
+	int iovcnt;
+	int count;
+	size_t seg_sz;
+	size_t bytes;
+	u_int64_t txtime_us;		// departure time of the first pkt, the batch leaves then
+	char arena[GSO_MAX_BYTES];	// headers, and payloads that don't outlive send_data_pkt(), are copied here
+	size_t arena_used;
+};
+
 struct c_pkt_info {
 	off_t file_idx;
+	u_int32_t pyld_sz;
 	bool ackd;
-	int retransmits;
+	bool sackd;		// server has it buffered past a hole, don't resend
 	bool active;
+	u_int32_t pyld_crc;		// crc32c of the payload, kept for resends
 };
 
 struct server_info {
@@ -14,7 +73,34 @@ struct server_info {
 };
 
 struct client {
-	int infd;
+	int infd;					// shared with the chunk cache when fanning out
+	bool shared_sockfd;			// sockfd belongs to the event loop, not this client
+	char *in_map;				// whole infile mapped read only, NULL when it's read() instead
+	off_t in_size;
+	off_t in_pos;				// offset of the next new payload in in_map, cache or infd
+	off_t in_end;				// end of this client's range of infile, in_size unless it's one of several streams
+	u_int32_t range_tag;		// shared by every stream of the transfer, 0 if infile isn't split
+	off_t range_off;			// start of this client's range of infile
+	bool range_last;			// range runs to the end of infile
+	off_t resume_off;			// bytes of the range the server already had, from its handshake ACK
+	u_int64_t in_mtime;			// sent with a resume along with in_size and in_crc, so a manifest left by another infile isn't picked up
+	u_int32_t in_crc;			// crc32c of the first INFILE_PREFIX_BYTES of infile
+	struct delta *delta;		// delta against the server's old outfile, in_pos and in_end are then offsets in the delta stream
+
+	// compression, each payload is compressed on its own and sent as is if that doesn't make it smaller
+	bool compress;				// server accepted compression in its handshake ACK
+	u_int64_t raw_bytes;		// payload bytes handed to the compressor
+	u_int64_t wire_bytes;		// what they took on the wire
+	u_int64_t compress_us;		// time spent compressing
+
+	// integrity, every DATA pkt carries a crc32c and the final one a digest of the client's whole range of infile
+	u_int32_t digest;			// crc32c of the range's bytes so far, in file order
+	u_int32_t server_digest;	// server's digest of that range of the finished outfile, from its termination ACK
+	bool server_digest_known;
+	u_int64_t crc_bytes;		// bytes run through crc32c, resends included
+	u_int64_t crc_us;			// time spent on them
+	struct chunk_cache *cache;	// infile chunks shared with the other replicas, NULL if not fanning out
+	u_int32_t chunks_released;	// chunks before this have been acked by the server and released
 	int sockfd;
 
 	struct server_info server;
@@ -33,14 +119,57 @@ struct client {
 	u_int32_t pkt_count;
 
 	u_int32_t start_sn;
-	u_int32_t last_sent_sn;
+	u_int32_t last_sent_sn;		// newest pkt read from infile and sent
 	u_int32_t last_ackd_sn;
+	bool eof_sent;				// 0 payload pkt has been sent, nothing new left to read
+
+	// congestion control, cwnd pkts may be in flight and never more than winsz
+	u_int32_t cwnd;
+	u_int32_t ssthresh;
+	u_int32_t cwnd_acc;			// pkts acked since cwnd last grew in congestion avoidance
+	bool in_recovery;			// cwnd already cut for the current losses, no further cuts until recover_sn is acked
+	u_int32_t recover_sn;		// newest pkt in flight when cwnd was cut
+	u_int64_t cwnd_start_us;	// handshake start, cwnd log times are relative to it
+	u_int32_t cwnd_rounds;
+	u_int64_t cwnd_sum;			// cwnd summed over rounds, for the average
+	u_int32_t cwnd_max;
+	u_int32_t cwnd_cuts;
+	u_int32_t cwnd_timeouts;
+
+	// pacing, the gap is recomputed from srtt and cwnd every round
+	enum pacing_mode pacing;	// falls back to PACING_SLEEP if the socket refuses SO_TXTIME
+	u_int64_t pace_gap_us;		// 0 sends the round as a burst
+	u_int64_t next_send_us;		// earliest departure time of the next DATA pkt
+	u_int64_t txtime_us;		// departure time of the DATA pkt being sent
+
+	// segmentation offload, a burst of DATA pkts leaves in one sendmsg() and the kernel cuts it into datagrams
+	bool gso;					// -g was given and the socket takes UDP_SEGMENT
+	struct gso_batch *gso_batch;	// NULL without -g
+	u_int64_t gso_sends;		// sendmsg() calls that flushed a batch
+	u_int64_t gso_pkts;			// pkts they carried
+
+	// RFC 6298 retransmission timer, in microseconds
+	u_int64_t srtt_us;
+	u_int64_t rttvar_us;
+	u_int64_t rto_us;
+	bool rtt_sampled;			// srtt and rttvar hold at least one sample
+	u_int64_t rtt_start_us;		// when the pkt being timed was sent
+	bool rtt_pending;			// a pkt is being timed, only ever a first transmission (Karn)
+	u_int32_t stalled_rtos;		// rtos since last_ackd_sn last moved, SACK resends and probes don't count
 
 	struct c_pkt_info *pkt_info;
 
+	const struct client_opts *opts;
+
 	bool handshake_confirmed;
 	int handshake_retransmits;
 
+	// event loop only, threads keep this state on their stacks
+	int state;					// enum client_state
+	struct timer loop_timer;	// rto, or the wait for a BUSY server to accept
+	int wr_retransmits;
+	int exit_code;
+
 	// pthread_mutex_t *mut;
 
 	int thread;
@@ -50,14 +179,23 @@ void *run_client(void *args);
 
 // initialize client with relevant information, perform handshake with server
 // return pointer to client struct on success, NULL on failure
-struct client *init_client(const char *infile_path, const char *outfile_path, struct server_info server, int mss, u_int32_t winsz);
+struct client *init_client(const char *infile_path, const char *outfile_path, struct server_info server, int mss, u_int32_t winsz, const struct client_opts *opts);
 
 // free all memory allocated in client and close infd and sockfd
 void free_client(struct client **client);
 
 // send file from client fd to sockfd
-// return 0 on success, -1 on error
+// return 0 on success, exit code on error
 int send_file(struct client *client);
+
+// send the current window
+// return 0 on success, exit code on error
+int send_window(struct client *client);
+
+// advance transfer after recv_res from recv_server_response(), either terminating or sending the next window
+// *done is set once the termination ACK has been sent
+// return 0 on success, exit code on error
+int send_file_step(struct client *client, int recv_res, bool *done);
 // int send_file(int infd, const char *outfile_path, int sockfd, struct sockaddr *sockaddr, socklen_t *sockaddr_size, int mss, u_int32_t winsz);
 
 // initiate handshake with server, which should respond with the client id
@@ -65,26 +203,161 @@ int send_file(struct client *client);
 // return 0 on success, -1 on error
 int start_handshake(struct client *client);
 
+// server accepted the WR, take the client id from its ACK and ACK it back
+// return 0 on success, 1 on error
+int complete_handshake(struct client *client);
+
 int finish_handshake(struct client *client);
 
-// send window of pkts with content from infd
-// returns number of pkts sent, -1 on error
+// resend unacked pkts the server is missing, then fill the rest of the window with new pkts from infd
+// returns number of pkts sent, 0 once eof has been sent, -1 on error
 int send_window_pkts(struct client *client);
 
 int send_pkt(struct client *client, int opcode, char *pkt_buf, size_t pkt_size);
 
+// send pkt gathered from iov, the first element holds the whole header
+// return 0 on success, -1 on error
+int send_pkt_iov(struct client *client, int opcode, struct iovec *iov, int iovcnt);
+
 int send_wr_pkt(struct client *client);
 
 int send_ack_pkt(struct client *client, u_int32_t ack_sn);
 
-int send_data_pkt(struct client *client, char *pkt_buf, size_t pkt_size, u_int32_t pyld_sz);
+// send DATA pkt with header in pkt_buf for the payload off bytes into the client's stream, payload follows the header in pkt_buf if pyld is NULL
+// return 0 on success, -1 on error
+int send_data_pkt(struct client *client, char *pkt_buf, size_t pkt_size, char *pyld, u_int32_t sn, u_int64_t off, u_int32_t pyld_sz, u_int32_t pyld_crc, u_int8_t flags);
 
 int update_pkt_info(struct client *client);
 
-// wait for server response, ack_pkt_sn is output
+// mark in flight pkts the server reports buffered past ack_sn, so they aren't resent
+void apply_sack(struct client *client, u_int32_t ack_sn, u_int8_t *bitmap, int bitmap_sz);
+
+// start timing a first transmission, its response gives the next rtt sample
+void start_rtt_sample(struct client *client);
+
+// fold rtt sample into srtt and rttvar and recompute rto as in RFC 6298
+void update_rto(struct client *client, u_int64_t rtt_us);
+
+// double rto after a timeout, the pkt being timed is no longer a valid sample
+void backoff_rto(struct client *client);
+
+// fetch the server's outfile signatures and start the delta against them, the DATA pkts then carry the delta stream
+// return 0 on success, exit code on error
+int start_delta(struct client *client);
+
+// pull the block signatures of the server's old outfile, keeping up to winsz SIG requests outstanding
+// signatures are put in *sigs, which the caller frees, their count in *sig_count and block size in *block_sz
+// return 0 on success, exit code on error
+int fetch_signatures(struct client *client, struct block_sig **sigs, u_int32_t *sig_count, u_int32_t *block_sz);
+
+// send SIG request for response idx
+// return 0 on success, -1 on error
+int send_sig_req(struct client *client, u_int32_t idx);
+
+// split infile into content defined chunks and ask which of them the server's chunk store holds, the DATA pkts then carry
+// a delta that names the held chunks by hash and sends the rest as literals
+// return 0 on success, exit code on error
+int start_dedup(struct client *client);
+
+// ask the server which of count chunks it holds, keeping up to winsz HAVE requests outstanding
+// held[i] is set for every chunk the server's store has
+// return 0 on success, exit code on error
+int fetch_chunk_holdings(struct client *client, struct chunk_ref *chunks, u_int32_t count, bool *held);
+
+// send HAVE request idx, asking about the idx-th run of per chunk hashes out of count
+// return 0 on success, -1 on error
+int send_have_req(struct client *client, struct chunk_ref *chunks, u_int32_t count, u_int32_t per, u_int32_t idx);
+
+// print compression ratio and cost, and the link speed below which compressing paid off
+void report_compression(struct client *client);
+
+// print what checksumming cost, as throughput and as a share of the transfer
+void report_checksum(struct client *client);
+
+// print how much of the delta was sent as literals and how much the server copied from its old outfile or chunk store
+void report_delta(struct client *client);
+
+// find payload of pkt in the mapped infile or chunk cache, or pread it into pkt_buf after the header if neither has it
+// payload ptr is put in *pyld, NULL when it was read into pkt_buf
+// return number of bytes of pkt_buf to send, -1 on error
+int find_pkt_pyld(struct client *client, struct c_pkt_info *pkt, char *pkt_buf, char **pyld);
+
+// tell the chunk cache this replica is done with every chunk before acked_end
+void release_chunks(struct client *client, off_t acked_end);
+
+// map the whole infile read only, payloads are then sent straight out of the mapping
+// return 0 on success, -1 on error, infile is read as usual if it can't be mapped
+int map_infile(struct client *client);
+
+// record infile's mtime and the crc of its first bytes, sent with a resume
+// return 0 on success, -1 on error
+int identify_infile(struct client *client);
+
+// skip the first bytes of client's range, the server already has them on disk
+// return 0 on success, -1 on error
+int resume_range(struct client *client, off_t bytes);
+
+// fold len bytes of infile from off into client's digest, out of the mapping if there is one
 // return 0 on success, -1 on error
+int digest_range(struct client *client, off_t off, off_t len);
+
+// split size bytes into *streams ranges of whole chunks, *streams is lowered if the file is too small to need them all
+// return bytes per range, the last range takes whatever is left
+off_t stream_span(off_t size, int *streams, int mss);
+
+// make client one stream of transfer tag, sending infile bytes [start, end), end -1 sends through the end of the file
+void set_client_range(struct client *client, u_int32_t tag, off_t start, off_t end);
+
+// enable SO_TXTIME on the socket for txtime pacing, falling back to sleeping if it isn't available
+void init_pacing(struct client *client, enum pacing_mode pacing);
+
+// spread the next round over srtt at cwnd pkts per srtt times the pacing gain
+void start_pacing_round(struct client *client);
+
+// hold the next DATA pkt until its departure time, or leave that to the qdisc with txtime pacing
+// return 0 on success, -1 on error
+int pace_pkt(struct client *client);
+
+// check the socket takes UDP_SEGMENT and set up the batch DATA pkts are queued in, pkts are sent one by one if it doesn't
+// return 0 on success, -1 on error
+int init_gso(struct client *client);
+
+// queue DATA pkt gathered from iov for the next flush_gso_batch(), flushing first if it can't join the queued pkts
+// the header is copied, the payload in iov[1] too unless pyld_stable says it outlives the batch
+// return 0 on success, -1 on error
+int queue_gso_pkt(struct client *client, struct iovec *iov, int iovcnt, bool pyld_stable);
+
+// send every queued DATA pkt in one sendmsg(), the kernel splits it into datagrams of seg_sz bytes
+// return 0 on success, -1 on error
+int flush_gso_batch(struct client *client);
+
+// print how many DATA pkts each sendmsg() carried
+void report_gso(struct client *client);
+
+// grow cwnd for acked pkts newly acked by a cumulative ACK, slow start below ssthresh, additive increase above
+void grow_cwnd(struct client *client, u_int32_t acked);
+
+// halve cwnd on loss, a timeout also drops it to one pkt and restarts slow start
+void cut_cwnd(struct client *client, bool timeout);
+
+// append cwnd and ssthresh to the cwnd log, if one was requested
+void log_cwnd(struct client *client);
+
+// print the cwnd trajectory summary for client
+void report_cwnd(struct client *client);
+
+// wait for server response, ack_pkt_sn is output
+// return 0 on success, 1 on resend, 2 on BUSY, -1 on error
 int recv_server_response(struct client *client);
 
+// handle bytes_recvd byte response in pkt_buf from the server
+// return 0 on success, 1 on resend, 2 on BUSY, -1 on error
+int process_server_response(struct client *client, char *pkt_buf, int bytes_recvd);
+
+// no response within one rto, back off and shrink cwnd before everything unacked is resent
+// return 1, the window needs resending, 4 once MAX_STALLED_RTOS have passed without the server acking anything
+int response_timeout(struct client *client);
+
 // prints log message of pkt
 // returns 0 on success, -1 on error
 int log_pkt_sent(struct client *client, char *pkt_buf);
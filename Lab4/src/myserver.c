@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <sys/socket.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -10,23 +12,68 @@
 #include <arpa/inet.h>
 #include <time.h>
 #include <stdint.h>
+#include <netinet/udp.h>
 #include <math.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 
 #include "myserver.h"
 #include "utils.h"
 #include "protocol.h"
 #include "client_info.h"
-
-#define BUFFER_SIZE 65535
+#include "path_table.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "chunk_store.h"
+#include "pkt_pool.h"
+#include "disk_writer.h"
 
 int main(int argc, char **argv) {
+	// handle command line options
+	int workers = 1;
+	bool use_store = false;
+	bool use_gro = false;
+	int disk_writers = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "w:kgj:")) != -1) {
+		switch (opt) {
+			case 'g':
+				use_gro = true;
+				break;
+			case 'j':
+				disk_writers = atoi(optarg);
+				if (disk_writers < 0 || disk_writers > MAX_DISK_WRITERS) {
+					printf("Invalid disk writer count provided. Please provide a writer count between 0-%d.\n", MAX_DISK_WRITERS);
+					exit(1);
+				}
+				break;
+			case 'k':
+				use_store = true;
+				break;
+			case 'w':
+				workers = atoi(optarg);
+				if (workers < 1 || workers > MAX_WORKERS) {
+					printf("Invalid worker count provided. Please provide a worker count between 1-%d.\n", MAX_WORKERS);
+					exit(1);
+				}
+				break;
+			default:
+				printf("Usage: %s [-w workers] [-k] [-g] [-j disk_writers] port droppc root_folder_path\n", argv[0]);
+				exit(1);
+		}
+	}
+
 	// handle command line args
-	if (argc != 4) {
+	if (argc - optind != 3) {
 		printf("Invalid number of options provided.\n");
 		exit(1);
 	}
 
+	argv += optind - 1;
+
 	int port = atoi(argv[1]);
 	if (port < 0 || port > 65535) {
 		printf("Invalid port provided. Please provide a port between 0-65535.\n");
@@ -59,52 +106,142 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
-	// initialize server socket
+	// outfile paths are shared between workers so busy paths are detected across shards
+	struct path_table *paths = init_path_table();
+	if (paths == NULL) {
+		fprintf(stderr, "myserver ~ main(): encountered error initializing path table.\n");
+		exit(1);
+	}
 
-	struct server *server = init_server(port, droppc, root_folder_path);
-	if (server == NULL) {
-		fprintf(stderr, "myserver ~ main(): encountered error initializing server state.\n");
-		exit(1); // TODO
+	// finished outfiles are also split into chunks kept once each, later transfers only send the chunks it lacks
+	// the store is a second copy of what the outfiles hold, it saves wire bytes at the cost of disk
+	struct chunk_store *store = NULL;
+	if (use_store && (store = init_chunk_store(root_folder_path)) == NULL) {
+		fprintf(stderr, "myserver ~ main(): encountered error initializing chunk store.\n");
+		exit(1);
+	}
+
+	// initialize one server per worker, each with its own SO_REUSEPORT socket and client shard
+	struct server **servers = calloc(workers, sizeof(struct server *));
+	pthread_t *threads = calloc(workers, sizeof(pthread_t));
+	if (servers == NULL || threads == NULL) {
+		fprintf(stderr, "myserver ~ main(): failed to allocate state for %d workers.\n", workers);
+		exit(1);
+	}
+
+	for (int i = 0; i < workers; i++) {
+		servers[i] = init_server(port, droppc, root_folder_path, i, workers, paths, store, use_gro, disk_writers);
+		if (servers[i] == NULL) {
+			fprintf(stderr, "myserver ~ main(): encountered error initializing server state.\n");
+			exit(1); // TODO
+		}
+	}
+
+	// a path freed on one worker may go to a client waiting on another
+	for (int i = 0; i < workers; i++) {
+		servers[i]->peers = servers;
 	}
 
 	// printf("server created with port %d\n", port);
 
-	if (run(server) < 0) {
+	// worker 0 runs on the main thread
+	for (int i = 1; i < workers; i++) {
+		if (pthread_create(&threads[i], NULL, &run_worker, (void *)servers[i]) != 0) {
+			fprintf(stderr, "myserver ~ main(): failed to spawn thread for worker %d\n", i);
+			exit(1);
+		}
+	}
+
+	if (run(servers[0]) < 0) {
 		fprintf(stderr,"myserver ~ main(): server failed to receive from socket.\n");
 
-		close_server(&server);
+		close_server(&servers[0]);
 
 		exit(1);
 	}
 
-	if (!rfp_terminated) free(root_folder_path);
+	for (int i = 1; i < workers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (int i = 0; i < workers; i++) {
+		close_server(&servers[i]);
+	}
 
-	close_server(&server);
+	free(servers);
+	free(threads);
+
+	free_path_table(&paths);
+	if (store != NULL) free_chunk_store(&store);
+
+	if (!rfp_terminated) free(root_folder_path);
 
 	return 0;
 }
 
+// run server worker on its own thread, exiting process if the worker fails
+void *run_worker(void *server) {
+	if (run((struct server *)server) < 0) {
+		fprintf(stderr,"myserver ~ run_worker(): worker %d failed to receive from socket.\n", ((struct server *)server)->shard);
+		exit(1);
+	}
+
+	return NULL;
+}
+
 // initialize server info with port and droppc, init socket and clients
+// shard is this worker's index out of shard_count workers sharing port, paths and store
+// gro asks the kernel to coalesce pkts with UDP_GRO, the server receives them one at a time if it can't
+// disk_writers threads take the worker's outfile writes, 0 writes them on the worker itself
 // returns pointer to server struct on success, NULL on failure
-struct server *init_server(int port, int droppc, const char *root_folder_path) {
+struct server *init_server(int port, int droppc, const char *root_folder_path, int shard, int shard_count, struct path_table *paths, struct chunk_store *store, bool gro, int disk_writers) {
 	struct server *server = malloc(sizeof(struct server));
+	if (server == NULL) {
+		fprintf(stderr, "myserver ~ init_server(): failed to allocate memory for server.\n");
+		return NULL;
+	}
 
-	server->sockfd = init_socket((struct sockaddr_in *)&server->serveraddr, NULL, port, AF_INET, SOCK_DGRAM, IPPROTO_UDP, true);
+	server->sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if (server->sockfd < 0) {
-		fprintf(stderr, "myserver ~ init_server(): server init_socket() failed.\n");
+		fprintf(stderr, "myserver ~ init_server(): failed to initialize socket: %s\n", strerror(errno));
 		return NULL;
 	}
 
+	// every worker binds the same port, kernel spreads clients across worker sockets
+	int reuse = 1;
+	if (shard_count > 1 && setsockopt(server->sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+		fprintf(stderr, "myserver ~ init_server(): failed to set SO_REUSEPORT: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (init_sockaddr(server->sockfd, (struct sockaddr_in *)&server->serveraddr, NULL, port, AF_INET) < 0) {
+		fprintf(stderr, "myserver ~ init_server(): server init_sockaddr() failed.\n");
+		return NULL;
+	}
+
+	// a client's run of equal sized pkts then arrives as one datagram, up to BUFFER_SIZE bytes, that process_pkt() splits
+	int gro_on = 1;
+	server->gro = gro && setsockopt(server->sockfd, SOL_UDP, UDP_GRO, &gro_on, sizeof(gro_on)) == 0;
+	if (gro && !server->gro) {
+		fprintf(stderr, "myserver ~ init_server(): UDP_GRO unavailable, receiving pkts one at a time: %s\n", strerror(errno));
+	}
+
+	server->shard = shard;
+	server->shard_count = shard_count;
+	server->paths = paths;
+	server->store = store;
+
 	server->clientaddr_size = sizeof(server->clientaddr);
 
 	server->droppc = droppc;
 	server->pkts_recvd = 0;
 	server->pkts_sent = 0;
 
-	server->max_client_count = START_CLIENTS;
+	server->now_ms = monotonic_ms();
+	init_timer_wheel(&server->timers, server->now_ms);
 
 	// initialize clients
-	server->clients = init_clients(server->max_client_count);
+	server->clients = init_client_table(shard);
 	if (server->clients == NULL) {
 		fprintf(stderr, "myserver ~ init_server(): encountered error initializing clients.\n");
 		return NULL;
@@ -114,22 +251,90 @@ struct server *init_server(int port, int droppc, const char *root_folder_path) {
 
 	// server->next_client_id = 1;
 
+	// initialize recvmmsg() buffers, each msg gets its own pooled buffer and the rest wait for out of order payloads
+	server->pool = init_pkt_pool(RECV_POOL_BUFS);
+	if (server->pool == NULL) {
+		fprintf(stderr, "myserver ~ init_server(): failed to set up receive buffer pool.\n");
+		return NULL;
+	}
+
+	server->recv_buf = NULL;
+
+	struct recv_batch *rb = &server->recv_batch;
+	for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+		memset(&rb->msgs[i].msg_hdr, 0, sizeof(rb->msgs[i].msg_hdr));
+		set_recv_buf(rb, i, pkt_pool_get(server->pool));
+		rb->msgs[i].msg_hdr.msg_iovlen = 2;
+		rb->msgs[i].msg_hdr.msg_name = &rb->addrs[i];
+		rb->msgs[i].msg_hdr.msg_control = server->gro ? rb->ctrls[i] : NULL;
+	}
+
+	// initialize sendmmsg() queue
+	struct send_batch *sb = &server->send_batch;
+	sb->arena = malloc(SEND_ARENA_SIZE);
+	if (sb->arena == NULL) {
+		fprintf(stderr, "myserver ~ init_server(): failed to allocate send batch arena.\n");
+		return NULL;
+	}
+
+	sb->arena_used = 0;
+	sb->count = 0;
+
+	// a slow disk then only holds up the ACKs of clients whose batches it hasn't written yet
+	server->writers = NULL;
+	server->acks_ready = NULL;
+	server->acks_ready_count = 0;
+	server->acks_ready_cap = 0;
+	server->write_failed = false;
+
+	if (disk_writers > 0 && (server->writers = init_writer_pool(disk_writers, reap_write_job, server)) == NULL) {
+		fprintf(stderr, "myserver ~ init_server(): failed to start %d disk writers.\n", disk_writers);
+		return NULL;
+	}
+
+	// peers are filled in once every worker exists
+	server->peers = NULL;
+
+	struct promote_inbox *inbox = &server->inbox;
+	pthread_mutex_init(&inbox->lock, NULL);
+	inbox->ids = NULL;
+	inbox->count = 0;
+	inbox->cap = 0;
+	inbox->pending = false;
+
+	// other workers push onto it while this one may be asleep in poll()
+	inbox->wake_fd = eventfd(0, EFD_NONBLOCK);
+	if (inbox->wake_fd < 0) {
+		fprintf(stderr, "myserver ~ init_server(): failed to create promotion eventfd: %s\n", strerror(errno));
+		return NULL;
+	}
+
 	return server;
 }
 
 // free allocated memory for server, terminate clients, and close socket
 void close_server(struct server **server) {
 	struct client_info *client;
-	for (u_int32_t i = 0; i < (*server)->max_client_count; i++) {
-		client = &(*server)->clients[i];
-		if (client->is_active) {
+	for (u_int32_t slot_id = 1; slot_id <= (*server)->clients->slot_count; slot_id++) {
+		client = client_table_slot((*server)->clients, slot_id);
+		if (client->in_use) {
 			terminate_client(*server, client->id); // TODO: change terminate_client() to use client_info ptr?
-		} else if (client->waiting || client->handshaking) {
-			free(client->outfile_path);
 		}
 	}
 
-	free((*server)->clients);
+	free_client_table(&(*server)->clients);
+
+	// terminating every client reaped every job
+	if ((*server)->writers != NULL) free_writer_pool(&(*server)->writers);
+	free((*server)->acks_ready);
+
+	close((*server)->inbox.wake_fd);
+	free((*server)->inbox.ids);
+	pthread_mutex_destroy(&(*server)->inbox.lock);
+
+	flush_send_batch(*server);
+	free((*server)->send_batch.arena);
+	free_pkt_pool(&(*server)->pool);
 	
 	close((*server)->sockfd);
 
@@ -138,34 +343,45 @@ void close_server(struct server **server) {
 	*server = NULL;
 }
 
-struct client_info *check_existing_client(struct server *server, char *outfile_path) {
+// look up the path table entry for outfile_path, the entry added by the current client address is preferred over the owner
+// copy of entry is put in *entry
+// return true if entry was found, false otherwise
+bool check_existing_client(struct server *server, char *outfile_path, struct path_entry *entry) {
 	if (server == NULL) {
 		fprintf(stderr, "myserver ~ check_existing_client(): NULL ptr passed to server parameter.\n");
-		return NULL;
+		return false;
 	}
 
 	if (outfile_path == NULL) {
 		fprintf(stderr, "myserver ~ check_existing_client(): NULL ptr passed to outfile_path parameter.\n");
+		return false;
+	}
+
+	// paths are keyed relative to root_folder_path, no need to build the full path
+	return path_table_find(server->paths, outfile_path, server->clientaddr, entry);
+}
+
+// find client in this worker's shard from client id
+// return client_info ptr, NULL if client id is invalid or belongs to another worker
+struct client_info *get_client(struct server *server, u_int32_t client_id) {
+	if ((int)CLIENT_ID_SHARD(client_id) != server->shard) {
+		fprintf(stderr, "myserver ~ get_client(): client %u belongs to worker %u, not worker %d.\n", client_id, CLIENT_ID_SHARD(client_id), server->shard);
 		return NULL;
 	}
 
-	char new_file_path[strlen(server->root_folder_path) + strlen(outfile_path) + 1];
-	new_file_path[sizeof(new_file_path) - 1] = 0; // null terminate
-	memcpy(new_file_path, server->root_folder_path, strlen(server->root_folder_path));
-	memcpy(new_file_path + strlen(server->root_folder_path), outfile_path, strlen(outfile_path));
+	struct client_info *client = client_table_slot(server->clients, CLIENT_ID_SLOT(client_id));
+	if (client == NULL) {
+		fprintf(stderr, "myserver ~ get_client(): invalid client_id %u, max client slot is %u\n", client_id, server->clients->slot_count);
+		return NULL;
+	}
 
-	struct client_info *client;
-	for (u_int32_t id = 1; id <= server->max_client_count; id++) {
-		client = &server->clients[id - 1];
-		if (client->outfile_path != NULL && !strcmp(client->outfile_path, new_file_path)) {
-			return client;
-		}
-		// } else {
-		// 	fprintf(stderr, "PATH CHECK: %s != %s\n", client->outfile_path, new_file_path);
-		// }
+	// slot was recycled (or never used) since this id was handed out
+	if (!client->in_use || client->id != client_id) {
+		fprintf(stderr, "myserver ~ get_client(): stale client_id %u, slot now holds client %u.\n", client_id, client->id);
+		return NULL;
 	}
 
-	return NULL;
+	return client;
 }
 
 // accept new client with id client_id writing to file outfile_path
@@ -196,41 +412,25 @@ struct client_info *find_new_client(struct server *server, char *outfile_path, u
 
 	fprintf(stderr, "init client w path: %s\n", new_file_path);
 	
-	// find first inactive client slot in clients
-	bool inactive_client_found = false;
-
-	struct client_info *client;
-	for (u_int32_t id = 1; id <= server->max_client_count; id++) {
-		client = &server->clients[id - 1];
-		if (!client->is_active && !client->handshaking) {
-			inactive_client_found = true;
-			if (client_info_init(client, id, new_file_path, server->clientaddr, winsz) < 0) {
-				fprintf(stderr, "myserver ~ accept_client(): encountered error while initializing client_info.\n");
-				return NULL;
-			}
-
-			// printf("%d: inactive client found: id %u\n", ntohs(((struct sockaddr_in *)&server->serveraddr)->sin_port), id);
-			
-			break;
-		}
+	// take free slot, client table grows by a segment if none are free
+	struct client_info *client = alloc_client(server->clients);
+	if (client == NULL) {
+		fprintf(stderr, "myserver ~ find_new_client(): encountered error allocating client slot.\n");
+		free(new_file_path);
+		return NULL;
 	}
 
-	// if no inactive clients, allocate space for more then init new client
-	if (!inactive_client_found) {
-		u_int32_t id = server->max_client_count + 1;
-
-		if (increase_client_cap(&server->clients, &server->max_client_count, MAX_CLIENTS_INCREASE) < 0) {
-			fprintf(stderr, "myserver ~ accept_client(): encountered error increasing client cap.\n");
-			return NULL;
-		}
-
-		client = &server->clients[id - 1];
-		if (client_info_init(client, id, new_file_path, server->clientaddr, winsz) < 0) {
-			fprintf(stderr, "myserver ~ accept_client(): encountered error while initializing client_info.\n");
-			return NULL;
-		}
+	if (client_info_init(client, client->id, new_file_path, server->clientaddr, winsz) < 0) {
+		fprintf(stderr, "myserver ~ find_new_client(): encountered error while initializing client_info.\n");
+		release_client(server->clients, client);
+		free(new_file_path);
+		return NULL;
 	}
 
+	// silence timer runs until the client is terminated, it catches clients that vanish at any stage
+	client->last_recv_ms = server->now_ms;
+	timer_add(&server->timers, &client->silence_timer, server->now_ms + LOSS_TIMEOUT_SECS * 1000);
+
 	return client;
 }
 
@@ -243,285 +443,763 @@ int accept_client(struct client_info *client) {
 	client->is_active = true;
 	client->handshaking = false;
 
-	client->outfd = open(client->outfile_path, O_CREAT | O_TRUNC | O_RDWR, 0664);
+	if (client->delta) {
+		if (open_delta(client) < 0) {
+			fprintf(stderr, "myserver ~ accept_client(): failed to open delta files for client %u.\n", client->id);
+			return -1;
+		}
+	} else {
+		// streams of a split transfer write around each other, only the last one trims the outfile to size
+		client->outfd = open(client->outfile_path, O_CREAT | O_RDWR | (client->range_tag == 0 ? O_TRUNC : 0), 0664);
+		client->pyld_fd = client->outfd;
+	}
 
 	if (client->outfd < 0) {
 		fprintf(stderr, "myserver ~ accept_client(): failed to open client outfile: %s with error %s\n", client->outfile_path, strerror(errno));
 		return -1;
 	}
 
+	// range is rewritten from the start, an older manifest no longer describes it
+	// a resuming client's manifest was already checked at handshake, before this transfer preallocated anything
+	if (!client->resuming) remove_manifest(client);
+
+	// a delta's temp file is mostly blocks copy_fd_range() may share with the old outfile, reserving them first would defeat that
+	if (!client->delta && preallocate_outfile(client) < 0) {
+		fprintf(stderr, "myserver ~ accept_client(): encountered error preallocating outfile of client %u, continuing without.\n", client->id);
+	}
+
 	return 0;
 }
 
-// terminate connection with client with id client_id and free necessary memory
-// close outfile and set client inactive
+// reserve the whole advertised file in outfile before any payload lands, so it's laid out in few extents and writes never extend it
+// sets the size instead when the filesystem can't preallocate, outfile is never shrunk
 // return 0 on success, -1 on error
-int terminate_client(struct server *server, u_int32_t client_id) {
-	if (client_id < 1 || client_id > server->max_client_count) {
-		fprintf(stderr, "myserver ~ terminate_client(): invalid client_id %u, max client id is %u\n", client_id, server->max_client_count);
+int preallocate_outfile(struct client_info *client) {
+	if (client->file_size <= 0) return 0;
+
+	// every stream of a split transfer asks for the whole file, which is a no-op once one of them has it
+	if (fallocate(client->outfd, 0, 0, client->file_size) == 0) return 0;
+
+	if (errno != EOPNOTSUPP && errno != ENOSYS) {
+		fprintf(stderr, "myserver ~ preallocate_outfile(): failed to preallocate %lld bytes of %s: %s\n", (long long)client->file_size, client->outfile_path, strerror(errno));
 		return -1;
 	}
 
-	struct client_info *client = &server->clients[client_id - 1];
-	if (client == NULL) {
-		fprintf(stderr, "myserver ~ terminate_client(): invalid ptr passed to client parameter.\n");
+	struct stat st;
+	if (fstat(client->outfd, &st) < 0) {
+		fprintf(stderr, "myserver ~ preallocate_outfile(): encountered error getting size of %s: %s\n", client->outfile_path, strerror(errno));
 		return -1;
 	}
 
-	if (client->is_active) {
-		// reset values and free allocated memory
-		client->is_active = false;
-		free(client->pkt_info);
-		// free(client->outfile_path);
-		close(client->outfd);
-	} else {
-		fprintf(stderr, "myserver ~ terminate_client(): cannot terminate inactive client %u.\n", client_id);
+	// other streams, or the transfer being resumed, may already have written further
+	if (st.st_size < client->file_size && ftruncate(client->outfd, client->file_size) < 0) {
+		fprintf(stderr, "myserver ~ preallocate_outfile(): encountered error extending %s: %s\n", client->outfile_path, strerror(errno));
 		return -1;
 	}
 
-	// check for clients waiting for same path
-	struct client_info *check_client;
-	for (u_int32_t id = 1; id <= server->max_client_count; id++) {
-		check_client = &server->clients[id - 1];
-		if (client->outfile_path == NULL || check_client->outfile_path == NULL) continue;
+	return 0;
+}
 
-		if (!strcmp(check_client->outfile_path, client->outfile_path) && id != client->id) {
-		// send ack with client id as sn
-			fprintf(stderr, "Re-initiating handshake with waiting client (busy path)\n");
-			if (send_client_ack_sn(server, check_client, id) < 0) {
-				fprintf(stderr, "myserver ~ terminate_client(): encountered error sending ACK with client id %u to accept client.\n", client->id);
-				return -1;
-			}
+// terminate connection with client with id client_id and free necessary memory
+// close outfile and set client inactive
+// slot is released even if handing its path on fails
+// return 0 on success, -1 on error
+int terminate_client(struct server *server, u_int32_t client_id) {
+	struct client_info *client = get_client(server, client_id);
+	if (client == NULL) {
+		fprintf(stderr, "myserver ~ terminate_client(): invalid client_id %u.\n", client_id);
+		return -1;
+	}
 
-			check_client->waiting = false;
+	int res = 0;
 
-			break;
+	// reset values and free allocated memory
+	if (client->is_active) {
+		client->is_active = false;
+
+		// a silent client's batched payloads are still progress a resume can use
+		if (flush_write_batch(client) < 0 || wait_client_writes(client) < 0) {
+			fprintf(stderr, "myserver ~ terminate_client(): encountered error writing batched payloads of client %u.\n", client->id);
+		}
+
+		close(client->outfd);
+
+		if (client->write_pylds > 0) {
+			fprintf(stderr, "Client %u wrote %llu payloads in %llu pwritev() calls.\n", client->id, (unsigned long long)client->write_pylds, (unsigned long long)client->write_calls);
 		}
 	}
 
-	free(client->outfile_path);
-	client->outfile_path = NULL;
+	free(client->write_batch.stage);
+	client->write_batch.stage = NULL;
 
-	fprintf(stderr, "Client %u terminated.\n", client->id);
+	// a stale entry on the ready list is skipped once the flag is clear
+	client->ack_deferred = false;
+	client->ack_ready = false;
 
-	return 0;
-}
+	// temp file of an unfinished delta stays behind, outfile itself was never touched
+	if (client->basis_fd >= 0) {
+		close(client->basis_fd);
+		client->basis_fd = -1;
+	}
 
-// run server: accept pkts and send acks for highest pkt sn from client during breaks
-// this function will run forever once called, or until there is an error (returns -1)
-int run(struct server *server) {
-// int run(int sockfd, struct sockaddr *sockaddr, socklen_t *sockaddr_size, int droppc) {
-	// init pkt buffer
-	char pkt_buf[BUFFER_SIZE];
+	if (client->spool_fd >= 0) {
+		close(client->spool_fd);
+		client->spool_fd = -1;
+	}
 
-	int recv_res;
+	// manifest stays behind if the range never finished, so the client can resume
+	if (client->manifest_fd >= 0) {
+		close(client->manifest_fd);
+		client->manifest_fd = -1;
+	}
 
-	while (1) { // hopefully run forever
-		if ((recv_res = recv_pkt(server, pkt_buf)) == 1) {
-			// pkt recvd successfully
-			if (process_pkt(server, pkt_buf) < 0) {
-				fprintf(stderr, "myserver ~ run(): encountered error processing pkt.\n");
-				return -1;
-			}
+	free(client->pkt_info);
+	client->pkt_info = NULL;
+	// free(client->outfile_path);
 
-			memset(pkt_buf, 0, BUFFER_SIZE);
-		} else if (recv_res == 2) {
-			// select timeout, send ACKs
-			// printf("sending ACKs\n");
-			struct client_info *client;
-			for (u_int32_t i = 0; i < server->max_client_count; i++) {
-				client = &server->clients[i];
-				if (!client->is_active) {
-					continue;
-				}
+	timer_del(&server->timers, &client->ack_timer);
+	timer_del(&server->timers, &client->silence_timer);
 
-				client->ack_sent = false;
+	// hand path to first client waiting for it, and the other streams of its transfer, which may belong to other workers
+	struct path_entry next[MAX_RANGE_STREAMS];
+	int release_res = path_table_release(server->paths, client->path_holder, next, MAX_RANGE_STREAMS);
+	client->path_holder = NULL;
+	if (release_res < 0) {
+		fprintf(stderr, "myserver ~ terminate_client(): encountered error releasing path %s.\n", client->outfile_path);
+	}
 
-				if (send_client_ack(server, client) < 0) {
-					fprintf(stderr, "myserver ~ run(): encountered error while sending ack to client.\n");
-					return -1;
-				}
-			}
-		} else if (recv_res < 0) {
-			// error
-			fprintf(stderr, "myserver ~ run(): encountered error receiving pkt with recv_pkt() call.\n");
-			return -1;
+	for (int i = 0; i < release_res; i++) {
+		fprintf(stderr, "Re-initiating handshake with waiting client (busy path)\n");
+		if (promote_waiting_client(server, next[i].client_id) < 0) {
+			fprintf(stderr, "myserver ~ terminate_client(): encountered error accepting waiting client %u.\n", next[i].client_id);
+			res = -1;
 		}
-		// continue otherwise (0)
 	}
 
-	return -1; // TODO: check if exit code is needed
-}
+	free(client->outfile_path);
+	client->outfile_path = NULL;
 
-// send pkt to client
-// return 0 on success, -1 on error
-int send_pkt(struct server *server, struct client_info *client, char *pkt_buf, size_t pkt_size) {
-	if (drop_pkt(server, pkt_buf, &server->pkts_sent, server->droppc)) {
-		return 0;
-	}
+	release_client(server->clients, client);
 
-	if (sendto(server->sockfd, pkt_buf, pkt_size, 0, &client->sockaddr, client->sockaddr_size) < 0) {
-		fprintf(stderr, "myserver ~ send_pkt(): encountered an error sending pkt to client %u.\n", client->id);
-		return -1;
-	}
+	fprintf(stderr, "Client %u terminated.\n", client->id);
 
-	return 0;
+	return res;
 }
 
-// send ack to client based on what packets were received
+// client owns its outfile path, pick up where its manifest says if it asked to resume and send the handshake ACK
+// shared by clients accepted right away and waiting clients promoted once their path frees up
 // return 0 on success, -1 on error
-int send_client_ack(struct server *server, struct client_info *client) {
-	u_int32_t ack_sn = get_client_ack_sn(client);
+int send_handshake_ack(struct server *server, struct client_info *client) {
+	// whoever held the path before a waiting client left the manifest, if any, describing the outfile as it is now
+	// a delta goes to a temp file, there is nothing in outfile to resume
+	if (client->resume_asked && client->range_tag != 0 && !client->delta) {
+		client->resuming = true;
+		client->write_idx = load_manifest(client);
+		client->stream_idx = client->write_idx;
+		client->synced_idx = client->write_idx;
+
+		fprintf(stderr, "Client %u resuming after %lld bytes\n", client->id, (long long)client->write_idx);
+	}
 
-	if (send_client_ack_sn(server, client, ack_sn) < 0) {
-		fprintf(stderr, "myserver ~ send_client_ack(): encountered error sending ACK...\n");
+	// send ack with client id as sn
+	client->ack_sent = false;
+
+	if (send_client_ack_sn(server, client, client->id) < 0) {
+		fprintf(stderr, "myserver ~ send_handshake_ack(): encountered error sending ACK with client id %u to accept client.\n", client->id);
 		return -1;
 	}
 
 	return 0;
 }
 
-// send ack to client with given sn
+// hand the path a terminated client released to waiting client client_id, on whichever worker owns it
 // return 0 on success, -1 on error
-int send_client_ack_sn(struct server *server, struct client_info *client, u_int32_t ack_sn) {
-	if (client->ack_sent) return 0;
+int promote_waiting_client(struct server *server, u_int32_t client_id) {
+	int shard = CLIENT_ID_SHARD(client_id);
 
-	char ack_buf[5];
-	ack_buf[0] = OP_ACK;
+	if (shard == server->shard || server->peers == NULL) {
+		struct client_info *client = get_client(server, client_id);
 
-	// printf("sending ACK %u\n", ack_sn);
+		// waiting client gave up and was reaped meanwhile
+		if (client == NULL || !client->handshaking) return 0;
 
-	if (assign_ack_sn(ack_buf, ack_sn) < 0) {
-		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered an error assigning ACK sn %u to client %u ACK.\n", ack_sn, client->id);
-		return -1;
+		return send_handshake_ack(server, client);
 	}
 
-	if (send_pkt(server, client, ack_buf, sizeof(ack_buf)) < 0) {
-		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered error sending ACK %u to client %u.\n", ack_sn, client->id);
+	if (shard >= server->shard_count) {
+		fprintf(stderr, "myserver ~ promote_waiting_client(): client %u belongs to worker %d, only %d exist.\n", client_id, shard, server->shard_count);
 		return -1;
 	}
 
-	if (update_pkt_info(client) < 0) {
-		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered error updating pkt info.\n");
-		return -1;
+	struct promote_inbox *inbox = &server->peers[shard]->inbox;
+
+	pthread_mutex_lock(&inbox->lock);
+
+	if (inbox->count == inbox->cap) {
+		u_int32_t cap = inbox->cap == 0 ? 16 : inbox->cap * 2;
+		u_int32_t *ids = realloc(inbox->ids, cap * sizeof(u_int32_t));
+		if (ids == NULL) {
+			pthread_mutex_unlock(&inbox->lock);
+			fprintf(stderr, "myserver ~ promote_waiting_client(): failed to grow promotion inbox of worker %d.\n", shard);
+			return -1;
+		}
+
+		inbox->ids = ids;
+		inbox->cap = cap;
 	}
 
-	client->ack_sent = true;
-	client->expected_start_sn = (ack_sn + 1) % client->pkt_count;
-	client->expected_sn = client->expected_start_sn;
+	inbox->ids[inbox->count++] = client_id;
+
+	pthread_mutex_unlock(&inbox->lock);
+
+	u_int64_t kick = 1;
+	if (write(inbox->wake_fd, &kick, sizeof(kick)) < 0) {
+		fprintf(stderr, "myserver ~ promote_waiting_client(): failed to wake worker %d: %s\n", shard, strerror(errno));
+		return -1;
+	}
 
 	return 0;
 }
 
-// update ack and written status of pkts when ack is sent
-// return 0 on success, -1 on failure
-int update_pkt_info(struct client_info *client) {
-	if (client == NULL || (!client->is_active && !client->handshaking)) {
-		fprintf(stderr, "myserver ~ update_pkt_info(): can't update pkt info for inactive client.\n");
+// send the handshake ACK of every waiting client other workers promoted since the last call
+// return 0 on success, -1 on error
+int take_promoted_clients(struct server *server) {
+	struct promote_inbox *inbox = &server->inbox;
+	if (!inbox->pending) return 0;
+
+	inbox->pending = false;
+
+	// eventfd is cleared before the ids are taken, so a push racing this leaves it readable for the next poll()
+	u_int64_t kicks;
+	if (read(inbox->wake_fd, &kicks, sizeof(kicks)) < 0 && errno != EAGAIN) {
+		fprintf(stderr, "myserver ~ take_promoted_clients(): encountered error reading promotion eventfd: %s\n", strerror(errno));
 		return -1;
 	}
 
-	if (client->ack_sent) return (client->expected_start_sn + client->pkt_count - 1) % client->pkt_count;
-
-	u_int32_t sn = client->expected_start_sn, pkts = 0;
-	struct s_pkt_info *pkt;
-	while (pkts < client->winsz) {
-		pkt = &client->pkt_info[sn];
+	pthread_mutex_lock(&inbox->lock);
 
-		pkt->ackd = pkt->written;
+	u_int32_t count = inbox->count;
+	u_int32_t ids[count > 0 ? count : 1];
+	memcpy(ids, inbox->ids, count * sizeof(u_int32_t));
+	inbox->count = 0;
 
-		client->pkt_info[(sn + client->winsz) % client->pkt_count].ackd = false;
-		client->pkt_info[(sn + client->winsz) % client->pkt_count].written = false;
+	pthread_mutex_unlock(&inbox->lock);
 
-		sn = (sn + 1) % client->pkt_count;
-		pkts ++;
+	for (u_int32_t i = 0; i < count; i++) {
+		if (promote_waiting_client(server, ids[i]) < 0) {
+			fprintf(stderr, "myserver ~ take_promoted_clients(): encountered error accepting waiting client %u.\n", ids[i]);
+			return -1;
+		}
 	}
 
 	return 0;
 }
 
-// finds sn for client ack based on first unwritten pkt
-u_int32_t get_client_ack_sn(struct client_info *client) {
-	if (client->ack_sent) return (client->expected_start_sn + client->pkt_count - 1) % client->pkt_count;
+// run server: accept pkts and send acks for highest pkt sn from client during breaks
+// this function will run forever once called, or until there is an error (returns -1)
+int run(struct server *server) {
+	struct recv_batch *rb = &server->recv_batch;
 
-	u_int32_t first_unwritten_sn = client->expected_start_sn;
+	int recv_res;
 
-	// find first unackd pkt
-	u_int32_t pkts_counted = 0;
-	struct s_pkt_info *pkt;
-	while (pkts_counted < client->winsz) {
-		pkt = &client->pkt_info[first_unwritten_sn];
-		
-		if (!pkt->written) {
-			break;
-		}
+	while (1) { // hopefully run forever
+		recv_res = recv_pkt_batch(server);
+		server->now_ms = monotonic_ms();
+
+		if (recv_res > 0) {
+			// process every pkt drained from the socket, acks are queued until the batch is done
+			for (int i = 0; i < recv_res; i++) {
+				char *pkt_buf = rb->iovs[i][0].iov_base;
+				server->clientaddr = rb->addrs[i];
+				server->clientaddr_size = rb->msgs[i].msg_hdr.msg_namelen;
+				server->recv_buf = rb->bufs[i];
+
+				// only what follows the datagram has to read as zeros, not the whole buffer
+				memset(pkt_buf + rb->msgs[i].msg_len, 0, RECV_ZERO_TAIL);
+
+				if (process_pkt(server, pkt_buf, rb->msgs[i].msg_len, get_gro_seg_sz(&rb->msgs[i].msg_hdr)) < 0) {
+					fprintf(stderr, "myserver ~ run(): encountered error processing pkt.\n");
+					return -1;
+				}
 
-		first_unwritten_sn = (first_unwritten_sn + 1) % client->pkt_count;
+				// batched pkts kept their payloads where they landed, the slot moves on to a free buffer
+				if (rb->bufs[i]->refs > 1) {
+					pkt_pool_put(server->pool, rb->bufs[i]);
+					set_recv_buf(rb, i, pkt_pool_get(server->pool));
+				}
 
-		pkts_counted ++;
-	}
+				server->recv_buf = NULL;
+			}
+		} else if (recv_res < 0) {
+			// error
+			fprintf(stderr, "myserver ~ run(): encountered error receiving pkts with recv_pkt_batch() call.\n");
+			return -1;
+		}
 
-	return (first_unwritten_sn + client->pkt_count - 1) % client->pkt_count;
-}
+		// acks held back for writes in flight go out once the writer is done with them
+		if (server->writers != NULL) {
+			writer_pool_reap(server->writers);
 
-// recv pkt from socket into pkt_buf
-// pkt will potentially be dropped
-// return 1 on success, 2 on select timeout, 0 on drop, and -1 on error
-int recv_pkt(struct server *server, char *pkt_buf) {
-	// fd_set fds;
-	// FD_SET(server->sockfd, &fds);
+			if (server->write_failed) {
+				fprintf(stderr, "myserver ~ run(): disk writer failed to write an outfile.\n");
+				return -1;
+			}
 
-	// struct timeval timeout = { LOSS_TIMEOUT_SECS, 0 };
+			if (send_ready_acks(server) < 0) {
+				fprintf(stderr, "myserver ~ run(): encountered error sending deferred acks.\n");
+				return -1;
+			}
+		}
 
-	struct pollfd fds[1] = { { server->sockfd, POLLIN, 0 } };
+		if (take_promoted_clients(server) < 0) {
+			fprintf(stderr, "myserver ~ run(): encountered error accepting clients promoted by other workers.\n");
+			return -1;
+		}
 
-	int poll_res;
-	if ((poll_res = poll(fds, 1, LOSS_TIMEOUT_SECS * 1000)) > 0) {
-
-	// if (select(server->sockfd + 1, &fds, NULL, NULL, &timeout) > 0 && FD_ISSET(server->sockfd, &fds)) { // check there is data to be read from socket
-		// data available at socket
-		// read into buffer
-		if (recvfrom(server->sockfd, pkt_buf, BUFFER_SIZE, 0, &server->clientaddr, &server->clientaddr_size) >= 0) {
-			// pkt dropped
-			if (drop_pkt(server, pkt_buf, &server->pkts_recvd, server->droppc)) {
-				return 0;
-			}
+		// poll timeout comes from the next timer, so this is where acks for stalled clients go out
+		if (timer_wheel_advance(&server->timers, server->now_ms, fire_client_timer, server) < 0) {
+			fprintf(stderr, "myserver ~ run(): encountered error firing client timers.\n");
+			return -1;
+		}
 
-			return 1; // pkt recvd successfully
-		} else { // recvfrom() failure
-			// TODO: check this
-			fprintf(stderr, "myserver ~ recv_pkt(): encountered error with recvfrom() call.\n");
+		if (flush_send_batch(server) < 0) {
+			fprintf(stderr, "myserver ~ run(): encountered error flushing queued pkts.\n");
 			return -1;
 		}
-	} else if (poll_res < 0) {
-		fprintf(stderr, "myserver ~ recv_pkt(): encountered error polling socket: %s\n", strerror(errno));
-		return -1;
-	} else {
-		return 2;
 	}
+
+	return -1; // TODO: check if exit code is needed
 }
 
-// process pkt from pkt_buf based on opcode
+// dispatch expired client timer to its handler, arg is the server
 // return 0 on success, -1 on error
-int process_pkt(struct server *server, char *pkt_buf) {
-	int opcode = get_pkt_opcode(pkt_buf);
-	
-	switch (opcode) {
-		case OP_WR:
-			if (process_write_req(server, pkt_buf) < 0) {
-				fprintf(stderr, "myserver ~ process_pkt(): encountered error processing write request.\n");
-				return -1;
-			}
-			break;
+int fire_client_timer(struct timer *timer, void *arg) {
+	struct server *server = arg;
+	struct client_info *client = timer->data;
+
+	if (timer == &client->ack_timer) {
+		return client_ack_timeout(server, client);
+	}
+
+	return client_silence_timeout(server, client);
+}
+
+// ack delay expired, ack whatever arrived since the last ack even though the client never asked for it
+// return 0 on success, -1 on error
+int client_ack_timeout(struct server *server, struct client_info *client) {
+	if (!client->is_active || client->ack_sent) return 0;
+
+	// burst still arriving, wait for the rest of it
+	if (server->now_ms - client->last_recv_ms < ACK_DELAY_MS) {
+		timer_add(&server->timers, &client->ack_timer, client->last_recv_ms + ACK_DELAY_MS);
+		return 0;
+	}
+
+	if (send_client_ack(server, client) < 0) {
+		fprintf(stderr, "myserver ~ client_ack_timeout(): encountered error sending delayed ack to client %u.\n", client->id);
+		return -1;
+	}
+
+	return 0;
+}
+
+// client has been silent, resend its ack every LOSS_TIMEOUT_SECS and reap it after CLIENT_IDLE_SECS
+// return 0 on success, -1 on error
+int client_silence_timeout(struct server *server, struct client_info *client) {
+	u_int64_t silence_ms = server->now_ms - client->last_recv_ms;
+
+	if (silence_ms >= CLIENT_IDLE_SECS * 1000) {
+		fprintf(stderr, "Client %u silent for %d seconds, reaping.\n", client->id, CLIENT_IDLE_SECS);
+
+		if (terminate_client(server, client->id) < 0) {
+			fprintf(stderr, "myserver ~ client_silence_timeout(): encountered error reaping client %u.\n", client->id);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// pkts arrived since the timer was armed, only the last one counts
+	if (silence_ms < LOSS_TIMEOUT_SECS * 1000) {
+		timer_add(&server->timers, &client->silence_timer, client->last_recv_ms + LOSS_TIMEOUT_SECS * 1000);
+		return 0;
+	}
+
+	// accept pkt loss, resend the ack in case the last one never made it
+	if (client->is_active) {
+		client->ack_sent = false;
+
+		if (send_client_ack(server, client) < 0) {
+			fprintf(stderr, "myserver ~ client_silence_timeout(): encountered error resending ack to client %u.\n", client->id);
+			return -1;
+		}
+	}
+
+	u_int64_t expires_ms = server->now_ms + LOSS_TIMEOUT_SECS * 1000;
+	if (expires_ms > client->last_recv_ms + CLIENT_IDLE_SECS * 1000) {
+		expires_ms = client->last_recv_ms + CLIENT_IDLE_SECS * 1000;
+	}
+
+	timer_add(&server->timers, &client->silence_timer, expires_ms);
+
+	return 0;
+}
+
+// queue pkt to client, it is sent on the next flush_send_batch()
+// return 0 on success, -1 on error
+int send_pkt(struct server *server, struct client_info *client, char *pkt_buf, size_t pkt_size) {
+	if (send_pkt_to(server, &client->sockaddr, client->sockaddr_size, pkt_buf, pkt_size) < 0) {
+		fprintf(stderr, "myserver ~ send_pkt(): encountered an error sending pkt to client %u.\n", client->id);
+		return -1;
+	}
+
+	return 0;
+}
+
+// queue pkt to sockaddr, it is sent on the next flush_send_batch()
+// return 0 on success, -1 on error
+int send_pkt_to(struct server *server, struct sockaddr *sockaddr, socklen_t sockaddr_size, char *pkt_buf, size_t pkt_size) {
+	if (drop_pkt(server, pkt_buf, &server->pkts_sent, server->droppc)) {
+		return 0;
+	}
+
+	struct send_batch *sb = &server->send_batch;
+
+	// pkt too large to ever be queued, send it on its own
+	if (pkt_size > SEND_ARENA_SIZE) {
+		if (sendto(server->sockfd, pkt_buf, pkt_size, 0, sockaddr, sockaddr_size) < 0) {
+			fprintf(stderr, "myserver ~ send_pkt_to(): encountered an error sending pkt: %s\n", strerror(errno));
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if (sb->count == SEND_BATCH_SIZE || sb->arena_used + pkt_size > SEND_ARENA_SIZE) {
+		if (flush_send_batch(server) < 0) {
+			fprintf(stderr, "myserver ~ send_pkt_to(): encountered an error flushing full send batch.\n");
+			return -1;
+		}
+	}
+
+	char *dst = sb->arena + sb->arena_used;
+	memcpy(dst, pkt_buf, pkt_size);
+	sb->arena_used += pkt_size;
+
+	unsigned int i = sb->count++;
+	sb->addrs[i] = *sockaddr;
+	sb->iovs[i].iov_base = dst;
+	sb->iovs[i].iov_len = pkt_size;
+	memset(&sb->msgs[i].msg_hdr, 0, sizeof(sb->msgs[i].msg_hdr));
+	sb->msgs[i].msg_hdr.msg_iov = &sb->iovs[i];
+	sb->msgs[i].msg_hdr.msg_iovlen = 1;
+	sb->msgs[i].msg_hdr.msg_name = &sb->addrs[i];
+	sb->msgs[i].msg_hdr.msg_namelen = sockaddr_size;
+
+	return 0;
+}
+
+// queue bare ACK with sn to sockaddr, without touching any client state
+// return 0 on success, -1 on error
+int send_ack_to(struct server *server, struct sockaddr *sockaddr, socklen_t sockaddr_size, u_int32_t ack_sn) {
+	char ack_buf[ACK_HEADER_SIZE];
+	ack_buf[0] = OP_ACK;
+
+	if (assign_ack_sn(ack_buf, ack_sn) < 0) {
+		fprintf(stderr, "myserver ~ send_ack_to(): encountered an error assigning ACK sn %u.\n", ack_sn);
+		return -1;
+	}
+
+	return send_pkt_to(server, sockaddr, sockaddr_size, ack_buf, sizeof(ack_buf));
+}
+
+// send all queued pkts with sendmmsg()
+// return 0 on success, -1 on error
+int flush_send_batch(struct server *server) {
+	struct send_batch *sb = &server->send_batch;
+
+	unsigned int sent = 0;
+	int res;
+	while (sent < sb->count) {
+		if ((res = sendmmsg(server->sockfd, sb->msgs + sent, sb->count - sent, 0)) < 0) {
+			if (errno == EINTR) continue;
+
+			fprintf(stderr, "myserver ~ flush_send_batch(): encountered an error sending %u queued pkts: %s\n", sb->count - sent, strerror(errno));
+			sb->count = 0;
+			sb->arena_used = 0;
+			return -1;
+		}
+
+		sent += res;
+	}
+
+	sb->count = 0;
+	sb->arena_used = 0;
+
+	return 0;
+}
+
+// send ack to client based on what packets were received
+// return 0 on success, -1 on error
+int send_client_ack(struct server *server, struct client_info *client) {
+	u_int32_t ack_sn = get_client_ack_sn(client);
+
+	if (send_client_ack_sn(server, client, ack_sn) < 0) {
+		fprintf(stderr, "myserver ~ send_client_ack(): encountered error sending ACK...\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+// send ack to client with given sn, as a SACK if pkts past it were received
+// return 0 on success, -1 on error
+int send_client_ack_sn(struct server *server, struct client_info *client, u_int32_t ack_sn) {
+	if (client->ack_sent) return 0;
+
+	// an ACK only ever covers bytes already handed to the kernel
+	if (flush_write_batch(client) < 0) {
+		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered error writing batched payloads of client %u.\n", client->id);
+		return -1;
+	}
+
+	// writer still has some of them, reaping the last one sends the ACK
+	if (client->writes_inflight > 0) {
+		client->ack_deferred = true;
+		return 0;
+	}
+
+	char ack_buf[ACK_HEADER_SIZE + SACK_BITMAP_MAX_BYTES];
+
+	// pkts received past a hole turn the ACK into a SACK, so the client only resends the holes
+	u_int32_t bitmap_sz = fill_sack_bitmap(client, ack_sn, (u_int8_t *)ack_buf + ACK_HEADER_SIZE);
+	ack_buf[0] = bitmap_sz > 0 ? OP_SACK : OP_ACK;
+
+	// nothing is received before the handshake, the resume offset and the range flags we honor take the bitmap's place
+	if (client->handshaking && (client->resuming || client->compress)) {
+		if (assign_ack_resume_off(ack_buf, client->write_idx) < 0) {
+			fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered an error assigning resume offset to client %u ACK.\n", client->id);
+			return -1;
+		}
+
+		if (assign_ack_accepted(ack_buf, client->compress ? RANGE_FLAG_COMPRESS : 0) < 0) {
+			fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered an error assigning accepted flags to client %u ACK.\n", client->id);
+			return -1;
+		}
+
+		bitmap_sz = RESUME_OFF_BYTES + ACCEPTED_FLAGS_BYTES;
+	} else if (client->terminating && bitmap_sz == 0) {
+		// termination ACK tells the client the digest of what was written, so it knows the whole transfer landed intact
+		if (assign_digest(ack_buf, ACK_HEADER_SIZE, client->digest) < 0) {
+			fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered an error assigning digest to client %u ACK.\n", client->id);
+			return -1;
+		}
+
+		bitmap_sz = DIGEST_BYTES;
+	}
+
+	// printf("sending ACK %u\n", ack_sn);
+
+	if (assign_ack_sn(ack_buf, ack_sn) < 0) {
+		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered an error assigning ACK sn %u to client %u ACK.\n", ack_sn, client->id);
+		return -1;
+	}
+
+	if (send_pkt(server, client, ack_buf, ACK_HEADER_SIZE + bitmap_sz) < 0) {
+		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered error sending ACK %u to client %u.\n", ack_sn, client->id);
+		return -1;
+	}
+
+	if (update_pkt_info(client, ack_sn) < 0) {
+		fprintf(stderr, "myserver ~ send_client_ack_sn(): encountered error updating pkt info.\n");
+		return -1;
+	}
+
+	client->ack_sent = true;
+	timer_del(&server->timers, &client->ack_timer);
+
+	return 0;
+}
+
+// set bit i of bitmap for every received pkt ack_sn + 1 + i in the receive window
+// return bitmap size in bytes, trimmed after the last received pkt, 0 if nothing past ack_sn was received
+u_int32_t fill_sack_bitmap(struct client_info *client, u_int32_t ack_sn, u_int8_t *bitmap) {
+	u_int32_t bits = client->winsz < SACK_BITMAP_MAX_BYTES * 8 ? client->winsz : SACK_BITMAP_MAX_BYTES * 8;
+	u_int32_t bitmap_sz = 0;
+
+	memset(bitmap, 0, (bits + 7) / 8);
+
+	for (u_int32_t i = 0; i < bits; i++) {
+		if (client->pkt_info[(ack_sn + 1 + i) % client->pkt_count].received) {
+			bitmap[i / 8] |= 1 << (i % 8);
+			bitmap_sz = i / 8 + 1;
+		}
+	}
+
+	return bitmap_sz;
+}
+
+// slide receive window past ack_sn, clearing the pkt info of every acked pkt so its slot can be reused
+// received pkts past ack_sn are kept
+// return 0 on success, -1 on failure
+int update_pkt_info(struct client_info *client, u_int32_t ack_sn) {
+	if (client == NULL || (!client->is_active && !client->handshaking)) {
+		fprintf(stderr, "myserver ~ update_pkt_info(): can't update pkt info for inactive client.\n");
+		return -1;
+	}
+
+	// acks behind the window (handshake, resent acks) don't move it
+	u_int32_t acked = (ack_sn + 1 + client->pkt_count - client->expected_start_sn) % client->pkt_count;
+	if (acked > client->winsz) return 0;
+
+	struct s_pkt_info *pkt;
+	for (u_int32_t i = 0; i < acked; i++) {
+		pkt = &client->pkt_info[(client->expected_start_sn + i) % client->pkt_count];
+
+		pkt->received = false;
+		pkt->ackd = false;
+	}
+
+	client->expected_start_sn = (ack_sn + 1) % client->pkt_count;
+
+	// window can't start past the first pkt not yet received
+	if ((client->expected_sn + client->pkt_count - client->expected_start_sn) % client->pkt_count > client->winsz) {
+		client->expected_sn = client->expected_start_sn;
+	}
+
+	return 0;
+}
+
+// finds sn for client ack, the last pkt of the contiguous written prefix
+u_int32_t get_client_ack_sn(struct client_info *client) {
+	return (client->expected_sn + client->pkt_count - 1) % client->pkt_count;
+}
+
+// recv up to RECV_BATCH_SIZE pkts from socket into server->recv_batch
+// return number of pkts received, 0 on poll timeout, and -1 on error
+int recv_pkt_batch(struct server *server) {
+	struct recv_batch *rb = &server->recv_batch;
+
+	// a completed write or a client promoted by another worker wakes the worker too, poll() skips the negative fd without writers
+	struct pollfd fds[3] = { { server->sockfd, POLLIN, 0 }, { server->writers != NULL ? server->writers->done_fd : -1, POLLIN, 0 }, { server->inbox.wake_fd, POLLIN, 0 } };
+
+	// sleep until the next client timer is due, forever if there are no clients
+	int timeout_ms = timer_wheel_next_timeout(&server->timers, monotonic_ms());
+
+	int poll_res;
+	if ((poll_res = poll(fds, 3, timeout_ms)) > 0) {
+		if (fds[1].revents & POLLIN) writer_pool_clear(server->writers);
+		if (fds[2].revents & POLLIN) server->inbox.pending = true;
+		if (!(fds[0].revents & POLLIN)) return 0;
+
+		// data available at socket, drain as much as fits in one call
+		for (int i = 0; i < RECV_BATCH_SIZE; i++) {
+			rb->msgs[i].msg_hdr.msg_namelen = sizeof(rb->addrs[i]);
+			rb->msgs[i].msg_hdr.msg_controllen = server->gro ? sizeof(rb->ctrls[i]) : 0;
+		}
+
+		int recv_res = recvmmsg(server->sockfd, rb->msgs, RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (recv_res < 0) {
+			// another wakeup raced us to the data, nothing to process
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return recv_pkt_batch(server);
+
+			fprintf(stderr, "myserver ~ recv_pkt_batch(): encountered error with recvmmsg() call: %s\n", strerror(errno));
+			return -1;
+		}
+
+		return recv_res;
+	} else if (poll_res < 0) {
+		if (errno == EINTR) return recv_pkt_batch(server);
+
+		fprintf(stderr, "myserver ~ recv_pkt_batch(): encountered error polling socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+// size of the pkts GRO coalesced into the datagram msg_hdr received, 0 if it holds a single pkt
+size_t get_gro_seg_sz(struct msghdr *msg_hdr) {
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(msg_hdr, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+			int seg_sz;
+			memcpy(&seg_sz, CMSG_DATA(cmsg), sizeof(seg_sz));
+
+			return seg_sz > 0 ? (size_t)seg_sz : 0;
+		}
+	}
+
+	return 0;
+}
+
+// point recv slot i at buf, header iov ending where buf's data begins
+void set_recv_buf(struct recv_batch *rb, int i, struct pkt_buf *buf) {
+	rb->bufs[i] = buf;
+
+	rb->iovs[i][0].iov_base = buf->data - DATA_HEADER_SIZE;
+	rb->iovs[i][0].iov_len = DATA_HEADER_SIZE;
+	rb->iovs[i][1].iov_base = buf->data;
+	rb->iovs[i][1].iov_len = BUFFER_SIZE - DATA_HEADER_SIZE;
+
+	rb->msgs[i].msg_hdr.msg_iov = rb->iovs[i];
+}
+
+// process every pkt in the pkt_size byte datagram at pkt_buf, GRO may have coalesced a run of seg_sz byte pkts from one client into it
+// seg_sz is 0 for a single pkt
+// return 0 on success, -1 on error
+int process_pkt(struct server *server, char *pkt_buf, size_t pkt_size, size_t seg_sz) {
+	if (seg_sz == 0 || seg_sz > pkt_size) seg_sz = pkt_size;
+
+	// every pkt of a coalesced run is dropped or processed as if it had arrived on its own, an empty datagram still counts as one
+	// only the last segment may be shorter than seg_sz
+	size_t off = 0;
+	do {
+		size_t pkt_len = seg_sz < pkt_size - off ? seg_sz : pkt_size - off;
+
+		if (!drop_pkt(server, pkt_buf + off, &server->pkts_recvd, server->droppc) && dispatch_pkt(server, pkt_buf + off, pkt_len) < 0) {
+			fprintf(stderr, "myserver ~ process_pkt(): encountered error processing pkt at %zu of %zu byte datagram.\n", off, pkt_size);
+			return -1;
+		}
+
+		off += seg_sz;
+	} while (off < pkt_size);
+
+	return 0;
+}
+
+// process one pkt_len byte pkt from pkt_buf based on opcode
+// return 0 on success, -1 on error
+int dispatch_pkt(struct server *server, char *pkt_buf, size_t pkt_len) {
+	int opcode = get_pkt_opcode(pkt_buf);
+	
+	switch (opcode) {
+		case OP_WR:
+			if (process_write_req(server, pkt_buf, pkt_len) < 0) {
+				fprintf(stderr, "myserver ~ dispatch_pkt(): encountered error processing write request.\n");
+				return -1;
+			}
+			break;
 		case OP_DATA:
-			if (process_data_pkt(server, pkt_buf) < 0) {
-				fprintf(stderr, "myserver ~ process_pkt(): encountered error processing data pkt.\n");
+			if (process_data_pkt(server, pkt_buf, pkt_len) < 0) {
+				fprintf(stderr, "myserver ~ dispatch_pkt(): encountered error processing data pkt.\n");
 				return -1;
 			}
 			break;
 		case OP_ACK:
 			if (process_ack_pkt(server, pkt_buf) < 0) {
-				fprintf(stderr, "myserver ~ process_pkt(): encountered error processing ack pkt.\n");
+				fprintf(stderr, "myserver ~ dispatch_pkt(): encountered error processing ack pkt.\n");
+				return -1;
+			}
+			break;
+		case OP_SIG:
+			if (process_sig_req(server, pkt_buf) < 0) {
+				fprintf(stderr, "myserver ~ dispatch_pkt(): encountered error processing SIG request.\n");
+				return -1;
+			}
+			break;
+		case OP_HAVE:
+			if (process_have_req(server, pkt_buf, pkt_len) < 0) {
+				fprintf(stderr, "myserver ~ dispatch_pkt(): encountered error processing HAVE request.\n");
 				return -1;
 			}
 			break;
@@ -533,213 +1211,1237 @@ int process_pkt(struct server *server, char *pkt_buf) {
 	return 0;
 }
 
-// initialize client connection with outfile and next client_id, send response to client with client_id
+// initialize client connection with outfile and next client_id, send response to client with client_id
+// return 0 on success, -1 on error
+int process_write_req(struct server *server, char *pkt_buf, size_t pkt_len) {
+	if (server == NULL) {
+		fprintf(stderr, "myserver ~ process_write_req(): null ptr passed to server.\n");
+		return -1;
+	}
+
+	// path has to end inside the pkt, a GRO segment is followed by the next one rather than zeros
+	if (pkt_len <= WR_HEADER_SIZE || memchr(pkt_buf + WR_HEADER_SIZE, 0, pkt_len - WR_HEADER_SIZE) == NULL) {
+		fprintf(stderr, "myserver ~ process_write_req(): outfile path runs past the %zu byte pkt, skipping packet.\n", pkt_len);
+		return 0;
+	}
+
+	u_int32_t winsz = get_write_req_winsz(pkt_buf);
+	if (winsz == 0) {
+		fprintf(stderr, "myserver ~ process_write_req(): encountered an error getting window size from write request pkt.\n");
+		return -1;
+	}
+
+	// create outfile path, starting at byte 1 of pkt_buf (byte 0 is opcode)
+	// char *outfile_path = calloc(strlen(pkt_buf + WR_HEADER_SIZE) + 1, sizeof(char));
+	char outfile_path[strlen(pkt_buf + WR_HEADER_SIZE) + 1];
+	outfile_path[sizeof(outfile_path) - 1] = 0; // null terminate
+	memcpy(outfile_path, pkt_buf + WR_HEADER_SIZE, strlen(pkt_buf + WR_HEADER_SIZE));
+
+	struct client_info *client;
+	struct path_entry entry;
+
+	bool found = check_existing_client(server, outfile_path, &entry);
+	bool same_addr = found && sockaddrs_eq(entry.sockaddr, server->clientaddr);
+
+	if (found && same_addr && !entry.waiting) {
+		// retransmitted WR from the path owner, same address always lands on the same worker
+		client = get_client(server, entry.client_id);
+		if (client != NULL) {
+			client->last_recv_ms = server->now_ms;
+		}
+
+		if (client != NULL && client->handshaking) {
+			fprintf(stderr, "Client handshaking, resending handshake ACK to port %d\n", ntohs(((struct sockaddr_in *)(&client->sockaddr))->sin_port));
+
+			client->ack_sent = false;
+
+			// send ack with client id as sn
+			if (send_client_ack_sn(server, client, client->id) < 0) {
+				fprintf(stderr, "myserver ~ process_write_req(): encountered error sending ACK with client id %u to accept client.\n", client->id);
+				return -1;
+			}
+		}
+
+		return 0;
+	}
+
+	if (found && same_addr) {
+		// retransmitted WR from a client already waiting on this path
+		char pkt = OP_BUSY;
+		if (send_pkt_to(server, &server->clientaddr, server->clientaddr_size, &pkt, 1) < 0) {
+			fprintf(stderr, "myserver ~ process_write_req(): encountered error resending BUSY pkt to client\n");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// accept client, initializing all client_info data
+	client = find_new_client(server, outfile_path, winsz);
+	if (client == NULL) {
+		fprintf(stderr, "myserver ~ process_write_req(): encountered error while accepting client.\n");
+		return -1;
+	}
+
+	// finished whole outfiles are added to the chunk store, if there is one
+	client->store = server->store;
+	client->pool = server->pool;
+
+	// one stream of a split transfer, its payloads start at the range offset instead of the start of the file
+	u_int64_t range_off;
+	u_int8_t range_flags;
+	if (get_wr_range(pkt_buf, &client->range_tag, &range_off, &range_flags)) {
+		client->range_off = (off_t)range_off;
+		client->range_last = (range_flags & RANGE_FLAG_LAST) != 0;
+		client->dedup = (range_flags & RANGE_FLAG_DEDUP) != 0;
+		client->delta = (range_flags & (RANGE_FLAG_DELTA | RANGE_FLAG_DEDUP)) != 0;
+		client->compress = (range_flags & RANGE_FLAG_COMPRESS) != 0;
+		client->resume_asked = (range_flags & RANGE_FLAG_RESUME) != 0;
+	}
+
+	// older clients don't send the extension unless they split, their outfile grows as it's written
+	client->file_size = (off_t)get_wr_file_size(pkt_buf);
+
+	// a resume names the infile it comes from, a manifest left by another one isn't picked up
+	if (client->resume_asked) get_wr_infile_id(pkt_buf, &client->in_mtime, &client->in_crc);
+
+	// one writer owns each client's files, so its batches land in order, a delta is applied and its old outfile read there too
+	if (server->writers != NULL) {
+		client->writer = &server->writers->writers[CLIENT_ID_SLOT(client->id) % server->writers->count];
+	}
+
+	int claim_res = path_table_claim(server->paths, outfile_path, client->id, client->sockaddr, client->range_tag, &client->path_holder);
+	if (claim_res < 0) {
+		fprintf(stderr, "myserver ~ process_write_req(): encountered error claiming path %s.\n", client->outfile_path);
+		return -1;
+	}
+
+	if (claim_res == 0) {
+		// printf("sent client ID: %u\n", client->id);
+
+		if (send_handshake_ack(server, client) < 0) {
+			fprintf(stderr, "myserver ~ process_write_req(): encountered error accepting client %u.\n", client->id);
+			return -1;
+		}
+	} else {
+		fprintf(stderr, "Conflicting filepath, storing client and sending BUSY message\n");
+
+		char pkt = OP_BUSY;
+		if (send_pkt(server, client, &pkt, 1) < 0) {
+			fprintf(stderr, "myserver ~ process_write_req(): encountered error sending BUSY pkt to client\n");
+			return -1;
+		}
+	}
+		
+	return 0;
+}
+
+// perform writing actions from a data pkt sent by known client
+// if payload size == 0, terminate client connection
+// if payload runs past the pkt_len bytes received, drop it
+// if client unrecognized, don't do anything
+// return 0 on success, -1 on error
+int process_data_pkt(struct server *server, char *pkt_buf, size_t pkt_len) {
+	// if payload size == 0: terminate connection
+	// if pkt in client ooo buffer, write to file based on that
+	// else write to end of file
+	// if client unrecognized, idk don't do it
+
+	if (server == NULL) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): NULL ptr passed to server parameter.\n");
+		return -1;
+	}
+
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): NULL ptr passed to pkt_buf parameter.\n");
+		return -1;
+	}
+
+	if (pkt_len < DATA_HEADER_SIZE) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): %zu byte pkt too short for a data header, skipping packet.\n", pkt_len);
+		return 0;
+	}
+
+	// get payload size, terminate client connection once written up to a pkt with size 0
+	u_int32_t pyld_sz = get_data_pyld_sz(pkt_buf);
+	if (pyld_sz == 0 && errno == 1) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting payload size from data pkt.\n");
+		return -1;
+	}
+
+	if (pyld_sz > BUFFER_SIZE - DATA_HEADER_SIZE - DIGEST_BYTES) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): payload size %u too large, skipping packet.\n", pyld_sz);
+		return 0;
+	}
+
+	// nothing in the pkt is trusted before its crc checks out, a corrupt pkt is dropped like a lost one and resent
+	u_int8_t flags = get_data_flags(pkt_buf);
+	u_int32_t body_sz = pyld_sz + (flags & DATA_FLAG_DIGEST ? DIGEST_BYTES : 0);
+
+	// a payload size claiming more than arrived would have the crc and the write read past the pkt, or the buffer
+	if (DATA_HEADER_SIZE + (size_t)body_sz > pkt_len) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): payload size %u runs past the %zu byte pkt, skipping packet.\n", pyld_sz, pkt_len);
+		return 0;
+	}
+
+	u_int32_t body_crc = crc32c(0, pkt_buf + DATA_HEADER_SIZE, body_sz);
+	if (data_pkt_crc(pkt_buf, body_crc) != get_data_crc(pkt_buf)) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): pkt failed its crc, skipping packet.\n");
+		return 0;
+	}
+
+	// get client id from pkt and check if we are serving that client
+	u_int32_t client_id = get_data_client_id(pkt_buf);
+	if (client_id == 0) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting client_id from pkt.\n");
+		return -1;
+	}
+
+	struct client_info *client = get_client(server, client_id);
+
+	// don't process data, but don't exit server
+	if (client == NULL || !client->is_active) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): failed to find client %u, skipping packet.\n", client_id);
+		return 0;
+	}
+
+	client->last_recv_ms = server->now_ms;
+
+	if (client->handshaking) {
+		// resend handshake ACK (not supposed to get data yet)
+		if (send_client_ack_sn(server, client, client->id) < 0) {
+			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error resending client %u handshake ACK.\n", client->id);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// get pkt sn
+	u_int32_t pkt_sn = get_data_sn(pkt_buf);
+	if (pkt_sn == 0 && errno == 1) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting pkt sn from data pkt.\n");
+		return -1;
+	}
+
+	if (pkt_sn >= client->pkt_count) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): pkt sn %u out of range for client %u, skipping packet.\n", pkt_sn, client_id);
+		return 0;
+	}
+
+	struct s_pkt_info *pkt = &client->pkt_info[pkt_sn];
+
+	// client flags the last pkt of every burst it sends, and waits for an ack after it
+	bool ack_req = (flags & DATA_FLAG_ACK_REQ) != 0;
+
+	// position of pkt in the receive window, anything past winsz is from an already acked window
+	u_int32_t window_idx = (pkt_sn + client->pkt_count - client->expected_start_sn) % client->pkt_count;
+
+	if (window_idx >= client->winsz || pkt->received) {
+		// resent burst, so the client never got our last ack, tell it where the holes are again
+		if (ack_req) {
+			client->ack_sent = false;
+
+			if (send_client_ack(server, client) < 0) {
+				fprintf(stderr, "myserver ~ process_data_pkt(): encountered error resending ack to client.\n");
+				return -1;
+			}
+		}
+
+		// printf("turn away %u (already have it)\n", pkt_sn);
+		return 0;
+	}
+
+	// printf("recv DATA %u\n", pkt_sn);
+
+	// final pkt, the prefix may only reach it once the holes before it are filled but its digest is kept now
+	if (flags & DATA_FLAG_DIGEST) {
+		client->peer_digest = get_digest(pkt_buf, DATA_HEADER_SIZE);
+		client->peer_digest_known = true;
+	}
+
+	char *pyld = pkt_buf + DATA_HEADER_SIZE;
+
+	// compressed payload is expanded here, everything after only ever sees file bytes
+	char raw[client->compress ? BUFFER_SIZE - DATA_HEADER_SIZE : 1];
+	if (flags & DATA_FLAG_COMPRESSED) {
+		int raw_sz = client->compress ? lz_decompress((u_int8_t *)pyld, pyld_sz, (u_int8_t *)raw, sizeof(raw)) : -1;
+		if (raw_sz <= 0) {
+			fprintf(stderr, "myserver ~ process_data_pkt(): failed to decompress pkt %u of client %u, skipping packet.\n", pkt_sn, client_id);
+			return 0;
+		}
+
+		pyld = raw;
+		pyld_sz = (u_int32_t)raw_sz;
+	}
+
+	// payload goes where its offset says, never before what the prefix already covers or past the advertised file
+	u_int64_t off = get_data_off(pkt_buf);
+	if (off < (u_int64_t)client->stream_idx || off + pyld_sz < off || (!client->delta && client->file_size > 0 && client->range_off + off + pyld_sz > (u_int64_t)client->file_size)) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): pkt %u of client %u is for bytes %llu-%llu, outside its range, skipping packet.\n", pkt_sn, client_id, (unsigned long long)off, (unsigned long long)(off + pyld_sz));
+		return 0;
+	}
+
+	pkt->off = off;
+	pkt->pyld_sz = pyld_sz;
+
+	// if we've made it to here, everything is valid and pkt is new
+
+	client->ack_sent = false;
+
+	// written as it arrives whatever its order, a hole only holds back the ACK
+	// a delta's stream goes to its spool, the delta itself is applied from there in order
+	off_t pos = (client->delta ? 0 : client->range_off) + (off_t)off;
+	if (pyld_sz > 0 && batch_pkt_pyld(client, pyld == raw ? NULL : server->recv_buf, pyld, pyld_sz, pos) < 0) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): encountered error writing pkt %u.\n", pkt_sn);
+		return -1;
+	}
+
+	pkt->received = true;
+
+	// hole filled, the prefix takes in every pkt now contiguous with it
+	if (pkt_sn == client->expected_sn && advance_prefix(client) < 0) {
+		fprintf(stderr, "myserver ~ process_data_pkt(): encountered error advancing prefix past pkt %u.\n", pkt_sn);
+		return -1;
+	}
+
+	if (client->terminating) {
+		// ack final pkt to finish terminating client
+		fprintf(stderr, "myserver ~ Payload size of 0 encountered. Terminating connection with client %u.\n", client_id);
+		if (send_client_ack(server, client) < 0) {
+			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error sending final ack to client.\n");
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// last pkt of the burst arrived, ack the contiguous prefix instead of waiting for timeout
+	if (ack_req) {
+		if (send_client_ack(server, client) < 0) {
+			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error sending ack to client.\n");
+			return -1;
+		}
+	} else if (!client->ack_timer.pending) {
+		// make sure an ack goes out even if the end of the burst is lost
+		timer_add(&server->timers, &client->ack_timer, server->now_ms + ACK_DELAY_MS);
+	}
+
+	return 0;
+}
+
+// take every received pkt from expected_sn on into the contiguous prefix, until the next hole
+// return 0 on success, -1 on error
+int advance_prefix(struct client_info *client) {
+	struct s_pkt_info *pkt = &client->pkt_info[client->expected_sn];
+
+	while (pkt->received && !client->terminating) {
+		if (extend_prefix(client, pkt) < 0) {
+			fprintf(stderr, "myserver ~ advance_prefix(): encountered error extending prefix of client %u.\n", client->id);
+			return -1;
+		}
+
+		pkt = &client->pkt_info[client->expected_sn];
+	}
+
+	return 0;
+}
+
+// contiguous prefix reached pkt, whose payload is already batched at its offset, payload size 0 marks client as terminating
+// checkpoints, termination and how far a delta can be applied all follow the prefix, so they see the stream in order
+// return 0 on success, -1 on error
+int extend_prefix(struct client_info *client, struct s_pkt_info *pkt) {
+	u_int32_t pyld_sz = pkt->pyld_sz;
+
+	// offsets have to follow on from each other, anything else left a gap or an overlap in outfile
+	if (pkt->off != (u_int64_t)client->stream_idx) {
+		fprintf(stderr, "myserver ~ extend_prefix(): client %u sent bytes at %llu where its stream was at %lld.\n", client->id, (unsigned long long)pkt->off, (long long)client->stream_idx);
+		client->digest_mismatch = true;
+	}
+
+	if (pyld_sz == 0) {
+		client->terminating = true;
+
+		// outfile is finished once every batch is in it, a writer does that after its last one and the termination ACK waits for it
+		if (client->writer != NULL) {
+			if (submit_write_batch(client, NULL, 0, finish_client_job) < 0) {
+				fprintf(stderr, "myserver ~ extend_prefix(): encountered error handing the finish of client %u to its writer.\n", client->id);
+				return -1;
+			}
+		} else if (flush_write_batch(client) < 0 || finish_client(client) < 0) {
+			fprintf(stderr, "myserver ~ extend_prefix(): encountered error finishing client %u.\n", client->id);
+			return -1;
+		}
+	}
+
+	client->write_pylds ++;
+
+	// a delta moves write_idx as its ops are applied
+	if (!client->delta) client->write_idx += pyld_sz;
+	client->stream_idx += pyld_sz;
+	client->expected_sn = (client->expected_sn + 1) % client->pkt_count;
+
+	// a failed checkpoint only costs a later resume some progress, the transfer itself is fine
+	if (!client->terminating && !client->delta && client->write_idx - client->synced_idx >= RESUME_SYNC_BYTES && checkpoint_client(client) < 0) {
+		fprintf(stderr, "myserver ~ extend_prefix(): encountered error checkpointing client %u, continuing without.\n", client->id);
+	}
+
+	return 0;
+}
+
+// client's range is complete and every batch written, bring outfile to its final state and check it against the client's digest
+// apply what's left of a delta, truncate past the last range, drop the manifest, digest the range and replace outfile with a rebuilt delta, then ingest a whole outfile that matched
+// runs on the client's writer when it has one, the worker leaves the client's files alone until it's reaped
+// return 0 on success, -1 on error
+int finish_client(struct client_info *client) {
+	// prefix reached the end of the delta stream, and all of it is in the spool now
+	if (client->delta && apply_spool(client, client->stream_idx) < 0) {
+		fprintf(stderr, "myserver ~ finish_client(): encountered error applying the rest of the delta of client %u.\n", client->id);
+		return -1;
+	}
+
+	// outfile wasn't truncated on open, or was preallocated to a size the file no longer has, drop whatever is past the end of the last range
+	if ((client->range_last || client->range_tag == 0) && ftruncate(client->outfd, client->range_off + client->write_idx) < 0) {
+		fprintf(stderr, "myserver ~ finish_client(): encountered error truncating outfile: %s.\n", strerror(errno));
+		return -1;
+	}
+
+	remove_manifest(client);
+
+	// a delta's temp file has the bytes outfile will, digested before it replaces outfile so a mismatch keeps the old one
+	if (!client->delta_broken && check_digest(client, client->outfd, client->write_idx) < 0) {
+		fprintf(stderr, "myserver ~ finish_client(): encountered error digesting outfile of client %u.\n", client->id);
+		return -1;
+	}
+
+	if (client->delta && client->digest_mismatch) client->delta_broken = true;
+
+	if (client->delta && finish_delta(client) < 0) {
+		fprintf(stderr, "myserver ~ finish_client(): encountered error finishing delta of client %u.\n", client->id);
+		return -1;
+	}
+
+	// a broken delta left the old outfile in place, the client's digest is held against that instead
+	if (client->delta_broken) {
+		struct stat st;
+		int old_fd = open(client->outfile_path, O_RDONLY);
+		off_t old_size = old_fd >= 0 && fstat(old_fd, &st) == 0 ? st.st_size : 0;
+
+		client->digest_mismatch = false;
+		int res = check_digest(client, old_fd, old_size);
+		if (old_fd >= 0) close(old_fd);
+
+		if (res < 0) {
+			fprintf(stderr, "myserver ~ finish_client(): encountered error digesting old outfile of client %u.\n", client->id);
+			return -1;
+		}
+	}
+
+	// only a whole outfile, a range's chunks would straddle the other streams' ranges
+	if (client->store != NULL && !client->delta_broken && !client->digest_mismatch && client->range_off == 0 && (client->range_tag == 0 || client->range_last)) {
+		store_outfile(client);
+	}
+
+	return 0;
+}
+
+// set client's digest to the crc32c of len bytes of fd from the start of its range, fd -1 for a file that isn't there
+// a digest other than the client's marks the mismatch, every pkt passed its crc so outfile didn't end up as infile
+// return 0 on success, -1 on error
+int check_digest(struct client_info *client, int fd, off_t len) {
+	client->digest = 0;
+
+	if (fd >= 0 && file_digest(fd, client->range_off, len, &client->digest) < 0) {
+		fprintf(stderr, "myserver ~ check_digest(): encountered error reading %s: %s.\n", client->outfile_path, strerror(errno));
+		return -1;
+	}
+
+	if (client->peer_digest_known && client->peer_digest != client->digest) {
+		fprintf(stderr, "myserver ~ check_digest(): client %u sent digest %08x, but %s digests to %08x.\n", client->id, client->peer_digest, client->outfile_path, client->digest);
+		client->digest_mismatch = true;
+	}
+
+	return 0;
+}
+
+// finish_client() as the task of the client's last write job
+// return 0 on success, -1 on error
+int finish_client_job(struct write_job *job) {
+	return finish_client(job->client);
+}
+
+// path of the manifest for client's range of outfile, written into buf
+void manifest_path(struct client_info *client, char *buf, size_t buf_sz) {
+	snprintf(buf, buf_sz, "%s.resume-%lld", client->outfile_path, (long long)client->range_off);
+}
+
+// find how much of client's range an earlier transfer left durably written
+// return bytes to resume after, 0 if there is no usable manifest
+off_t load_manifest(struct client_info *client) {
+	char path[strlen(client->outfile_path) + 32];
+	manifest_path(client, path, sizeof(path));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return 0;
+
+	struct resume_manifest manifest;
+	int bytes_read = read_n_bytes(fd, (char *)&manifest, sizeof(manifest));
+	close(fd);
+
+	if (bytes_read != sizeof(manifest) || manifest.magic != RESUME_MAGIC || manifest.range_off != (u_int64_t)client->range_off) {
+		fprintf(stderr, "myserver ~ load_manifest(): ignoring unusable manifest %s.\n", path);
+		return 0;
+	}
+
+	// infile was changed since, what outfile holds is part of a file the client no longer sends
+	if (manifest.in_size != (u_int64_t)client->file_size || manifest.in_mtime != client->in_mtime || manifest.in_crc != client->in_crc) {
+		fprintf(stderr, "myserver ~ load_manifest(): infile isn't the one manifest %s was written for, starting over.\n", path);
+		return 0;
+	}
+
+	// outfile was changed behind the manifest's back
+	struct stat st;
+	if (stat(client->outfile_path, &st) < 0 || (u_int64_t)st.st_size < manifest.range_off + manifest.bytes) {
+		fprintf(stderr, "myserver ~ load_manifest(): outfile %s is shorter than manifest %s says, starting over.\n", client->outfile_path, path);
+		return 0;
+	}
+
+	// the interrupted transfer preallocated the whole outfile, so its size says nothing about what was written, its last bytes do
+	char tail[RESUME_TAIL_BYTES];
+	if (manifest.tail_len > RESUME_TAIL_BYTES || manifest.tail_len > manifest.bytes) {
+		fprintf(stderr, "myserver ~ load_manifest(): ignoring unusable manifest %s.\n", path);
+		return 0;
+	}
+
+	fd = open(client->outfile_path, O_RDONLY);
+	bytes_read = fd < 0 ? -1 : pread_n_bytes(fd, tail, manifest.tail_len, manifest.range_off + manifest.bytes - manifest.tail_len);
+	if (fd >= 0) close(fd);
+
+	if (bytes_read != (int)manifest.tail_len || crc32c(0, tail, manifest.tail_len) != manifest.tail_crc) {
+		fprintf(stderr, "myserver ~ load_manifest(): outfile %s doesn't hold what manifest %s says, starting over.\n", client->outfile_path, path);
+		return 0;
+	}
+
+	return (off_t)manifest.bytes;
+}
+
+// sync outfile and record write_idx in client's manifest, so a later transfer can resume after it
+// return 0 on success, -1 on error
+int checkpoint_client(struct client_info *client) {
+	if (client->manifest_fd < 0) {
+		char path[strlen(client->outfile_path) + 32];
+		manifest_path(client, path, sizeof(path));
+
+		client->manifest_fd = open(path, O_CREAT | O_WRONLY, 0664);
+		if (client->manifest_fd < 0) {
+			fprintf(stderr, "myserver ~ checkpoint_client(): failed to open manifest %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	// one small record, rewritten in place
+	_Static_assert(sizeof(struct resume_manifest) <= WRITE_JOB_RECORD_SIZE, "a manifest has to fit a write job's record");
+	struct resume_manifest manifest = { RESUME_MAGIC, 0, (u_int64_t)client->range_off, (u_int64_t)client->write_idx, 0, client->in_crc, (u_int64_t)client->file_size, client->in_mtime };
+
+	// writer syncs outfile and rewrites the manifest after the batch, the worker never waits on either
+	if (client->writer != NULL) {
+		if (submit_write_batch(client, &manifest, sizeof(manifest), NULL) < 0) {
+			fprintf(stderr, "myserver ~ checkpoint_client(): encountered error handing checkpoint to writer.\n");
+			return -1;
+		}
+
+		client->synced_idx = client->write_idx;
+
+		return 0;
+	}
+
+	// bytes have to be on disk before the manifest claims them
+	if (flush_write_batch(client) < 0) {
+		fprintf(stderr, "myserver ~ checkpoint_client(): encountered error writing batched payloads.\n");
+		return -1;
+	}
+
+	if (fdatasync(client->outfd) < 0) {
+		fprintf(stderr, "myserver ~ checkpoint_client(): encountered error syncing outfile: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (seal_manifest(client->outfd, (char *)&manifest) < 0) {
+		fprintf(stderr, "myserver ~ checkpoint_client(): encountered error reading back outfile of client %u.\n", client->id);
+		return -1;
+	}
+
+	if (pwrite_n_bytes(client->manifest_fd, (char *)&manifest, sizeof(manifest), 0) < 0 || fdatasync(client->manifest_fd) < 0) {
+		fprintf(stderr, "myserver ~ checkpoint_client(): encountered error writing manifest: %s\n", strerror(errno));
+		return -1;
+	}
+
+	client->synced_idx = client->write_idx;
+
+	return 0;
+}
+
+// read back the tail of the range manifest record claims from synced outfd and record its crc
+// runs on whichever thread synced outfd
+// return 0 on success, -1 on error
+int seal_manifest(int outfd, char *record) {
+	struct resume_manifest *manifest = (struct resume_manifest *)record;
+
+	manifest->tail_len = manifest->bytes < RESUME_TAIL_BYTES ? (u_int32_t)manifest->bytes : RESUME_TAIL_BYTES;
+
+	char tail[RESUME_TAIL_BYTES];
+	if (pread_n_bytes(outfd, tail, manifest->tail_len, manifest->range_off + manifest->bytes - manifest->tail_len) != (int)manifest->tail_len) {
+		fprintf(stderr, "myserver ~ seal_manifest(): encountered error reading back %u bytes of outfile: %s\n", manifest->tail_len, strerror(errno));
+		return -1;
+	}
+
+	manifest->tail_crc = crc32c(0, tail, manifest->tail_len);
+
+	return 0;
+}
+
+// range is complete, its manifest is no longer needed
+void remove_manifest(struct client_info *client) {
+	if (client->manifest_fd >= 0) {
+		close(client->manifest_fd);
+		client->manifest_fd = -1;
+	}
+
+	char path[strlen(client->outfile_path) + 32];
+	manifest_path(client, path, sizeof(path));
+
+	if (unlink(path) < 0 && errno != ENOENT) {
+		fprintf(stderr, "myserver ~ remove_manifest(): failed to remove manifest %s: %s\n", path, strerror(errno));
+	}
+}
+
+// open old outfile as the basis of client's delta, and the temp file outfile is rebuilt in
+// return 0 on success, -1 on error
+int open_delta(struct client_info *client) {
+	// a dedup copies from the chunk store, never from the old outfile
+	if (!client->dedup) client->basis_fd = open(client->outfile_path, O_RDONLY);
+
+	if (client->basis_fd >= 0) {
+		struct stat st;
+		if (fstat(client->basis_fd, &st) < 0) {
+			fprintf(stderr, "myserver ~ open_delta(): encountered error getting size of %s: %s\n", client->outfile_path, strerror(errno));
+			return -1;
+		}
+
+		client->basis_size = st.st_size;
+	} else if (!client->dedup && errno != ENOENT) {
+		// no old outfile to match against, the whole file comes as literals
+		fprintf(stderr, "myserver ~ open_delta(): failed to open old outfile %s, continuing without: %s\n", client->outfile_path, strerror(errno));
+	}
+
+	client->block_sz = delta_block_size(client->basis_size);
+
+	char path[strlen(client->outfile_path) + 8];
+	delta_path(client, path, sizeof(path));
+
+	client->outfd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0664);
+	if (client->outfd < 0) {
+		fprintf(stderr, "myserver ~ open_delta(): failed to open temp file %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	// stream lands in the spool at its offsets as it arrives, unlinked so it never outlives the client
+	char spool[strlen(client->outfile_path) + 8];
+	snprintf(spool, sizeof(spool), "%s.spool", client->outfile_path);
+
+	client->spool_fd = open(spool, O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if (client->spool_fd < 0 || unlink(spool) < 0) {
+		fprintf(stderr, "myserver ~ open_delta(): failed to open spool %s: %s\n", spool, strerror(errno));
+		return -1;
+	}
+
+	client->pyld_fd = client->spool_fd;
+
+	if (client->dedup) {
+		fprintf(stderr, "Client %u dedup against chunk store\n", client->id);
+	} else {
+		fprintf(stderr, "Client %u delta against %lld byte outfile in %u byte blocks\n", client->id, (long long)client->basis_size, client->block_sz);
+	}
+
+	return 0;
+}
+
+// path of the temp file client's outfile is rebuilt in, written into buf
+void delta_path(struct client_info *client, char *buf, size_t buf_sz) {
+	snprintf(buf, buf_sz, "%s.delta", client->outfile_path);
+}
+
+// apply delta stream bytes from pyld to client's temp file, ops can span pkts so the parse state is kept in client
+// return 0 on success, -1 on error
+int apply_delta(struct client_info *client, char *pyld, u_int32_t pyld_sz) {
+	u_int32_t used = 0;
+
+	while (used < pyld_sz && !client->delta_broken) {
+		// inside a literal, its bytes go straight to the temp file
+		if (client->literal_left > 0) {
+			u_int32_t len = client->literal_left < pyld_sz - used ? client->literal_left : pyld_sz - used;
+
+			if (pwrite_n_bytes(client->outfd, pyld + used, len, client->range_off + client->write_idx) < 0) {
+				fprintf(stderr, "myserver ~ apply_delta(): encountered error writing literal to temp file: %s\n", strerror(errno));
+				return -1;
+			}
+
+			client->write_idx += len;
+			client->literal_left -= len;
+			used += len;
+			continue;
+		}
+
+		// gather the op header, its first byte says how long it is
+		u_int8_t *hdr = client->delta_hdr;
+		hdr[client->delta_hdr_len++] = (u_int8_t)pyld[used++];
+
+		if (hdr[0] != DELTA_OP_LITERAL && hdr[0] != DELTA_OP_COPY && hdr[0] != DELTA_OP_CHUNK) {
+			fprintf(stderr, "myserver ~ apply_delta(): unknown delta op %u from client %u, keeping old outfile.\n", hdr[0], client->id);
+			client->delta_broken = true;
+			break;
+		}
+
+		u_int32_t hdr_sz = hdr[0] == DELTA_OP_COPY ? DELTA_COPY_HEADER_SIZE : (hdr[0] == DELTA_OP_CHUNK ? DELTA_CHUNK_HEADER_SIZE : DELTA_LITERAL_HEADER_SIZE);
+		if (client->delta_hdr_len < hdr_sz) continue;
+
+		client->delta_hdr_len = 0;
+
+		if (hdr[0] == DELTA_OP_LITERAL) {
+			client->literal_left = reunite_bytes(hdr + 1);
+		} else if (hdr[0] == DELTA_OP_CHUNK) {
+			copy_store_chunk(client, hdr + 5, reunite_bytes(hdr + 1));
+		} else if (copy_basis_blocks(client, reunite_bytes(hdr + 1), reunite_bytes(hdr + 5)) < 0) {
+			fprintf(stderr, "myserver ~ apply_delta(): encountered error copying old outfile blocks.\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// apply client's delta stream from its spool up to end, the prefix has to have reached end and every byte before it be in the spool
 // return 0 on success, -1 on error
-int process_write_req(struct server *server, char *pkt_buf) {
-	if (server == NULL) {
-		fprintf(stderr, "myserver ~ process_write_req(): null ptr passed to server.\n");
+int apply_spool(struct client_info *client, off_t end) {
+	char buf[DELTA_APPLY_BYTES];
+
+	while (client->applied_idx < end) {
+		int len = end - client->applied_idx < DELTA_APPLY_BYTES ? (int)(end - client->applied_idx) : DELTA_APPLY_BYTES;
+
+		if (pread_n_bytes(client->spool_fd, buf, len, client->applied_idx) != len) {
+			fprintf(stderr, "myserver ~ apply_spool(): encountered error reading %d bytes at %lld of delta stream spool: %s\n", len, (long long)client->applied_idx, strerror(errno));
+			return -1;
+		}
+
+		if (apply_delta(client, buf, len) < 0) {
+			fprintf(stderr, "myserver ~ apply_spool(): encountered error applying delta of client %u.\n", client->id);
+			return -1;
+		}
+
+		client->applied_idx += len;
+	}
+
+	return 0;
+}
+
+// apply_spool() as the task of a write job, up to where the prefix was when the job was handed over
+// return 0 on success, -1 on error
+int apply_spool_job(struct write_job *job) {
+	return apply_spool(job->client, (off_t)job->task_arg);
+}
+
+// copy count blocks of the old outfile from first on to the end of client's temp file
+// return 0 on success, -1 on error
+int copy_basis_blocks(struct client_info *client, u_int32_t first, u_int32_t count) {
+	if ((u_int64_t)first + count > delta_block_count(client->basis_size, client->block_sz)) {
+		fprintf(stderr, "myserver ~ copy_basis_blocks(): client %u copied blocks %u-%u of an outfile with %u, keeping old outfile.\n", client->id, first, first + count, delta_block_count(client->basis_size, client->block_sz));
+		client->delta_broken = true;
+		return 0;
+	}
+
+	if (copy_fd_range(client->basis_fd, (off_t)first * client->block_sz, client->outfd, client->range_off + client->write_idx, (size_t)count * client->block_sz) < 0) {
+		fprintf(stderr, "myserver ~ copy_basis_blocks(): encountered error copying old outfile blocks.\n");
 		return -1;
 	}
 
-	u_int32_t winsz = get_write_req_winsz(pkt_buf);
-	if (winsz == 0) {
-		fprintf(stderr, "myserver ~ process_write_req(): encountered an error getting window size from write request pkt.\n");
+	client->write_idx += (off_t)count * client->block_sz;
+
+	return 0;
+}
+
+// add the chunks of client's finished outfile the chunk store doesn't hold yet, a failure only costs later transfers the dedup
+void store_outfile(struct client_info *client) {
+	off_t new_bytes;
+
+	int added = chunk_store_ingest(client->store, client->outfd, &new_bytes);
+	if (added < 0) {
+		fprintf(stderr, "myserver ~ store_outfile(): encountered error adding %s to chunk store, continuing without.\n", client->outfile_path);
+		return;
+	}
+
+	fprintf(stderr, "Client %u added %d new chunks (%lld bytes) of %s to chunk store\n", client->id, added, (long long)new_bytes, client->outfile_path);
+}
+
+// copy len byte chunk with hash from the chunk store to the end of client's temp file
+// a chunk the store doesn't hold breaks the stream, the old outfile is then kept
+void copy_store_chunk(struct client_info *client, u_int8_t *hash, u_int32_t len) {
+	if (client->store == NULL || chunk_store_copy(client->store, hash, len, client->outfd, client->range_off + client->write_idx) < 0) {
+		fprintf(stderr, "myserver ~ copy_store_chunk(): client %u referenced a chunk the store can't supply, keeping old outfile.\n", client->id);
+		client->delta_broken = true;
+		return;
+	}
+
+	client->write_idx += len;
+}
+
+// delta stream ended, replace outfile with the temp file unless the stream was broken
+// return 0 on success, -1 on error
+int finish_delta(struct client_info *client) {
+	char path[strlen(client->outfile_path) + 8];
+	delta_path(client, path, sizeof(path));
+
+	if (client->literal_left > 0 || client->delta_hdr_len > 0) {
+		fprintf(stderr, "myserver ~ finish_delta(): delta stream of client %u ended inside an op, keeping old outfile.\n", client->id);
+		client->delta_broken = true;
+	}
+
+	if (client->delta_broken) {
+		unlink(path);
+		return 0;
+	}
+
+	if (rename(path, client->outfile_path) < 0) {
+		fprintf(stderr, "myserver ~ finish_delta(): failed to replace %s with %s: %s\n", client->outfile_path, path, strerror(errno));
 		return -1;
 	}
 
-	// create outfile path, starting at byte 1 of pkt_buf (byte 0 is opcode)
-	// char *outfile_path = calloc(strlen(pkt_buf + WR_HEADER_SIZE) + 1, sizeof(char));
-	char outfile_path[strlen(pkt_buf + WR_HEADER_SIZE) + 1];
-	outfile_path[sizeof(outfile_path) - 1] = 0; // null terminate
-	memcpy(outfile_path, pkt_buf + WR_HEADER_SIZE, strlen(pkt_buf + WR_HEADER_SIZE));
+	return 0;
+}
 
-	struct client_info *client;
+// process SIG request from a delta client, answering with the signatures of one run of old outfile blocks
+// with disk writers the blocks are read on the client's writer and the answer goes out once its job is reaped
+// return 0 on success, -1 on error
+int process_sig_req(struct server *server, char *pkt_buf) {
+	u_int32_t client_id = get_sig_client_id(pkt_buf);
+	if (client_id == 0) {
+		fprintf(stderr, "myserver ~ process_sig_req(): encountered an error getting client_id from pkt.\n");
+		return -1;
+	}
 
-	if ((client = check_existing_client(server, outfile_path)) == NULL) {
-		// accept client, initializing all client_info data and opening outfile for writing
-		client = find_new_client(server, outfile_path, winsz);
-		if (client == NULL) {
-			fprintf(stderr, "myserver ~ process_write_req(): encountered error while accepting client.\n");
-			return -1;
-		}
-		
-		// printf("sent client ID: %u\n", client->id);
+	// don't process request, but don't exit server
+	struct client_info *client = get_client(server, client_id);
+	if (client == NULL || !client->delta) {
+		fprintf(stderr, "myserver ~ process_sig_req(): client %u isn't sending a delta, skipping packet.\n", client_id);
+		return 0;
+	}
 
-		// send ack with client id as sn
-		if (send_client_ack_sn(server, client, client->id) < 0) {
-			fprintf(stderr, "myserver ~ process_write_req(): encountered error sending ACK with client id %u to accept client.\n", client->id);
+	client->last_recv_ms = server->now_ms;
+
+	// client only asks once it has its id, so its handshake ACK was lost
+	if (client->handshaking && accept_client(client) < 0) {
+		fprintf(stderr, "myserver ~ process_sig_req(): failed to accept client %u\n", client_id);
+		return -1;
+	}
+
+	// old outfile is read on the client's writer, the SIG goes out once its job is reaped
+	if (client->writer != NULL) {
+		struct write_job *job = take_write_job(client);
+		if (job == NULL) {
+			fprintf(stderr, "myserver ~ process_sig_req(): encountered error getting a write job for client %u.\n", client_id);
 			return -1;
 		}
-		
-		client->handshaking = true;
-	} else {
-		fprintf(stderr, "Existing client with outfile path found\n");
 
-		if (client->handshaking && !client->waiting && sockaddrs_eq(client->sockaddr, server->clientaddr)) {
-			fprintf(stderr, "Client handshaking, resending handshake ACK to port %d\n", ntohs(((struct sockaddr_in *)(&client->sockaddr))->sin_port));
+		job->task = fill_sig_job;
+		job->task_arg = get_sig_idx(pkt_buf);
 
-			client->ack_sent = false;
+		return hand_write_job(client);
+	}
 
-			// send ack with client id as sn
-			if (send_client_ack_sn(server, client, client->id) < 0) {
-				fprintf(stderr, "myserver ~ process_write_req(): encountered error sending ACK with client id %u to accept client.\n", client->id);
-				return -1;
-			}
-		} else {
-			fprintf(stderr, "Conflicting filepath, storing client and sending BUSY message\n");
+	char sig_buf[MAX_SRVR_RES_SIZE];
 
-			client = find_new_client(server, outfile_path, winsz);
-			if (client == NULL) {
-				fprintf(stderr, "myserver ~ process_write_req(): encountered error while accepting client.\n");
-				return -1;
-			}
+	int sig_sz = fill_sig_pkt(client, get_sig_idx(pkt_buf), sig_buf);
+	if (sig_sz < 0) {
+		fprintf(stderr, "myserver ~ process_sig_req(): encountered error filling SIG pkt for client %u.\n", client_id);
+		return -1;
+	}
 
-			client->waiting = true;
+	if (send_pkt(server, client, sig_buf, sig_sz) < 0) {
+		fprintf(stderr, "myserver ~ process_sig_req(): encountered error sending SIG pkt to client %u.\n", client_id);
+		return -1;
+	}
 
-			char pkt = OP_BUSY;
-			if (send_pkt(server, client, &pkt, 1) < 0) {
-				fprintf(stderr, "myserver ~ process_write_req(): encountered error sending BUSY pkt to client\n");
-				return -1;
-			}
-		}
+	return 0;
+}
+
+// fill_sig_pkt() as the task of a write job, the SIG is its reply
+// return 0 on success, -1 on error
+int fill_sig_job(struct write_job *job) {
+	_Static_assert(WRITE_JOB_REPLY_SIZE >= MAX_SRVR_RES_SIZE, "a write job's reply has to fit a SIG pkt");
+
+	job->reply_sz = fill_sig_pkt(job->client, (u_int32_t)job->task_arg, job->reply);
+	if (job->reply_sz < 0) {
+		job->reply_sz = 0;
+		return -1;
 	}
-		
+
 	return 0;
 }
 
-// perform writing actions from a data pkt sent by known client
-// if payload size == 0, terminate client connection
-// if client unrecognized, don't do anything
+// process HAVE request from a dedup client, answering with a bitmap of the chunk hashes in it the chunk store holds
 // return 0 on success, -1 on error
-int process_data_pkt(struct server *server, char *pkt_buf) {
-	// if payload size == 0: terminate connection
-	// if pkt in client ooo buffer, write to file based on that
-	// else write to end of file
-	// if client unrecognized, idk don't do it
+int process_have_req(struct server *server, char *pkt_buf, size_t pkt_len) {
+	u_int32_t client_id = get_sig_client_id(pkt_buf);
+	if (client_id == 0) {
+		fprintf(stderr, "myserver ~ process_have_req(): encountered an error getting client_id from pkt.\n");
+		return -1;
+	}
 
-	if (server == NULL) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): NULL ptr passed to server parameter.\n");
+	// don't process request, but don't exit server
+	struct client_info *client = get_client(server, client_id);
+	if (client == NULL || !client->dedup) {
+		fprintf(stderr, "myserver ~ process_have_req(): client %u isn't deduplicating, skipping packet.\n", client_id);
+		return 0;
+	}
+
+	u_int32_t count = get_have_count(pkt_buf);
+	if (count > HAVE_MAX_HASHES || HAVE_HEADER_SIZE + (size_t)count * CHUNK_HASH_SIZE > pkt_len) {
+		fprintf(stderr, "myserver ~ process_have_req(): client %u asked about %u chunks, skipping packet.\n", client_id, count);
+		return 0;
+	}
+
+	client->last_recv_ms = server->now_ms;
+
+	// client only asks once it has its id, so its handshake ACK was lost
+	if (client->handshaking && accept_client(client) < 0) {
+		fprintf(stderr, "myserver ~ process_have_req(): failed to accept client %u\n", client_id);
 		return -1;
 	}
 
-	if (pkt_buf == NULL) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): NULL ptr passed to pkt_buf parameter.\n");
+	char have_buf[MAX_SRVR_RES_SIZE];
+	memset(have_buf, 0, sizeof(have_buf));
+
+	if (assign_pkt_opcode(have_buf, OP_HAVE) < 0 || assign_have_req(have_buf, client_id, get_sig_idx(pkt_buf), count) < 0) {
+		fprintf(stderr, "myserver ~ process_have_req(): encountered an error assigning HAVE header.\n");
 		return -1;
 	}
 
-	// get client id from pkt and check if we are serving that client
-	u_int32_t client_id = get_data_client_id(pkt_buf);
-	if (client_id == 0) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting client_id from pkt.\n");
+	// without a chunk store every bit stays clear and the whole file comes as literals
+	u_int8_t *bitmap = (u_int8_t *)have_buf + HAVE_HEADER_SIZE;
+	for (u_int32_t i = 0; client->store != NULL && i < count; i++) {
+		if (chunk_store_has(client->store, (u_int8_t *)pkt_buf + HAVE_HEADER_SIZE + i * CHUNK_HASH_SIZE)) bitmap[i / 8] |= 1 << (i % 8);
+	}
+
+	if (send_pkt(server, client, have_buf, HAVE_HEADER_SIZE + (count + 7) / 8) < 0) {
+		fprintf(stderr, "myserver ~ process_have_req(): encountered error sending HAVE pkt to client %u.\n", client_id);
 		return -1;
 	}
 
-	if (client_id < 1 || client_id > server->max_client_count) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): invalid client_id provided: %u, max client_id is %u\n", client_id, server->max_client_count);
+	return 0;
+}
+
+// fill SIG response idx for client into pkt_buf, header followed by the signatures of the blocks it covers
+// return pkt size, -1 on error
+int fill_sig_pkt(struct client_info *client, u_int32_t idx, char *pkt_buf) {
+	if (assign_pkt_opcode(pkt_buf, OP_SIG) < 0 || assign_sig_req(pkt_buf, client->id, idx) < 0 || assign_sig_basis(pkt_buf, client->basis_size, client->block_sz) < 0) {
+		fprintf(stderr, "myserver ~ fill_sig_pkt(): encountered an error assigning SIG header.\n");
+		return -1;
 	}
 
-	struct client_info *client = &server->clients[client_id - 1];
+	u_int32_t block_count = delta_block_count(client->basis_size, client->block_sz);
+	u_int64_t first = (u_int64_t)idx * SIG_MAX_ENTRIES;
 
-	// don't process data, but don't exit server
-	if (client == NULL || !client->is_active) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): failed to find client %u, skipping packet.\n", client_id);
-		return 0;
+	u_int32_t entries = first >= block_count ? 0 : (block_count - first < SIG_MAX_ENTRIES ? block_count - first : SIG_MAX_ENTRIES);
+	if (entries == 0) return SIG_HEADER_SIZE;
+
+	u_int8_t *block = malloc(client->block_sz);
+	if (block == NULL) {
+		fprintf(stderr, "myserver ~ fill_sig_pkt(): failed to allocate %u byte block buffer.\n", client->block_sz);
+		return -1;
 	}
 
-	if (client->handshaking) {
-		// resend handshake ACK (not supposed to get data yet)
-		if (send_client_ack_sn(server, client, client->id) < 0) {
-			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error resending client %u handshake ACK.\n", client->id);
+	for (u_int32_t i = 0; i < entries; i++) {
+		off_t off = (off_t)(first + i) * client->block_sz;
+
+		if (pread(client->basis_fd, block, client->block_sz, off) != (ssize_t)client->block_sz) {
+			fprintf(stderr, "myserver ~ fill_sig_pkt(): encountered error reading block %llu of old outfile: %s\n", (unsigned long long)(first + i), strerror(errno));
+			free(block);
 			return -1;
 		}
 
-		return 0;
+		assign_sig_entry(pkt_buf, i, weak_sum(block, client->block_sz), strong_sum(block, client->block_sz));
 	}
 
-	// get pkt sn
-	u_int32_t pkt_sn = get_data_sn(pkt_buf);
-	if (pkt_sn == 0 && errno == 1) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting pkt sn from data pkt.\n");
+	free(block);
+
+	return SIG_HEADER_SIZE + entries * SIG_ENTRY_SIZE;
+}
+
+// add payload at pos of pyld_fd to client's write batch, writing the batch first if it has no room left or pos doesn't follow on from it
+// a payload still in receive buffer buf pins it, anything else is copied to the batch's stage
+// return 0 on success, -1 on error
+int batch_pkt_pyld(struct client_info *client, struct pkt_buf *buf, char *pyld, u_int32_t pyld_sz, off_t pos) {
+	struct write_batch *wb = &client->write_batch;
+
+	bool follows = wb->count > 0 && wb->off + (off_t)wb->bytes == pos;
+	if ((wb->count == WRITE_BATCH_PKTS || wb->bytes + pyld_sz > WRITE_BATCH_BYTES || (wb->count > 0 && !follows)) && flush_write_batch(client) < 0) {
+		fprintf(stderr, "myserver ~ batch_pkt_pyld(): encountered error writing full batch.\n");
 		return -1;
 	}
 
-	struct s_pkt_info *pkt = &client->pkt_info[pkt_sn];
+	if (wb->count == 0) wb->off = pos;
 
-	// if (client->ack_sent && pkt_sn != client->expected_sn) {
-	// 	printf("turn away %u (already ackd)\n", pkt_sn);
-	// 	return 0;
-	// }
+	if (buf != NULL && client->pool != NULL && pkt_pool_pin(client->pool, buf)) {
+		wb->iovs[wb->count].iov_base = pyld;
+		wb->iovs[wb->count].iov_len = pyld_sz;
+		wb->bufs[wb->count] = buf;
+		wb->count ++;
+		wb->bytes += pyld_sz;
 
-	if (pkt_sn != client->expected_sn && (pkt_sn + client->pkt_count - client->expected_start_sn) % client->pkt_count < (client->expected_sn + client->pkt_count - client->expected_start_sn) % client->pkt_count) {
-		// printf("turn away %u (already seen)\n", pkt_sn);
 		return 0;
 	}
 
-	if (pkt->written && pkt->ackd) {
-		// printf("turn away %u (written and ackd)\n", pkt_sn);
+	// decompressed, or every spare buffer is already pinned
+	if (wb->stage == NULL) {
+		wb->stage = malloc(WRITE_BATCH_BYTES);
+		if (wb->stage == NULL) {
+			fprintf(stderr, "myserver ~ batch_pkt_pyld(): failed to allocate write batch stage.\n");
+			return -1;
+		}
+	}
+
+	char *dst = wb->stage + wb->stage_used;
+	memcpy(dst, pyld, pyld_sz);
+	wb->stage_used += pyld_sz;
+	wb->bytes += pyld_sz;
+
+	// copies land back to back, a run of them is one iov
+	struct iovec *last = wb->count > 0 ? &wb->iovs[wb->count - 1] : NULL;
+	if (last != NULL && wb->bufs[wb->count - 1] == NULL && (char *)last->iov_base + last->iov_len == dst) {
+		last->iov_len += pyld_sz;
 		return 0;
 	}
 
-	// printf("recv DATA %u\n", pkt_sn);
+	wb->iovs[wb->count].iov_base = dst;
+	wb->iovs[wb->count].iov_len = pyld_sz;
+	wb->bufs[wb->count] = NULL;
+	wb->count ++;
 
-	// get payload size, terminate client connection if == 0
-	u_int32_t pyld_sz = get_data_pyld_sz(pkt_buf);
-	if (pyld_sz == 0 && errno == 1) {
-		fprintf(stderr, "myserver ~ process_data_pkt(): encountered an error getting payload size from data pkt.\n");
+	return 0;
+}
+
+// write client's batched payloads to outfile with one pwritev() and unpin their receive buffers
+// batch is emptied even if the write fails
+// return 0 on success, -1 on error
+int flush_write_batch(struct client_info *client) {
+	struct write_batch *wb = &client->write_batch;
+	if (wb->count == 0) return 0;
+
+	if (client->writer != NULL) return submit_write_batch(client, NULL, 0, NULL);
+
+	int res = 0;
+	if (pwritev_n_bytes(client->pyld_fd, wb->iovs, wb->count, wb->off) < 0) {
+		fprintf(stderr, "myserver ~ flush_write_batch(): encountered error writing %zu bytes to outfile: %s.\n", wb->bytes, strerror(errno));
+		res = -1;
+	}
+
+	client->write_calls ++;
+
+	for (int i = 0; i < wb->count; i++) {
+		if (wb->bufs[i] != NULL) pkt_pool_put(client->pool, wb->bufs[i]);
+	}
+
+	wb->count = 0;
+	wb->bytes = 0;
+	wb->stage_used = 0;
+
+	// whatever the prefix covers is in the spool now
+	if (res == 0 && client->delta && apply_spool(client, client->stream_idx) < 0) {
+		fprintf(stderr, "myserver ~ flush_write_batch(): encountered error applying delta of client %u.\n", client->id);
+		res = -1;
+	}
+
+	return res;
+}
+
+// hand client's batch to its writer thread, waiting for a free job if the writer is backed up
+// record of record_sz bytes is rewritten in the manifest once outfile is synced, record NULL for a plain write
+// task runs on the writer after the batch, NULL for none, a delta's batch then applies the stream as far as the prefix has reached
+// return 0 on success, -1 on error
+int submit_write_batch(struct client_info *client, void *record, size_t record_sz, int (*task)(struct write_job *job)) {
+	struct write_batch *wb = &client->write_batch;
+
+	struct write_job *job = take_write_job(client);
+	if (job == NULL) {
+		fprintf(stderr, "myserver ~ submit_write_batch(): encountered error getting a write job for client %u.\n", client->id);
 		return -1;
-	} else if (pyld_sz == 0 && pkt_sn == client->expected_sn) {
-		client->ack_sent = false;
-		client->terminating = true;
-		pkt->written = true;
+	}
 
-		// ack final pkt to finish terminating client
-		fprintf(stderr, "myserver ~ Payload size of 0 encountered. Terminating connection with client %u.\n", client_id);
-		if (send_client_ack_sn(server, client, pkt_sn) < 0) {
-			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error sending final ack to client.\n");
-			return -1;
-		}
+	job->fd = client->pyld_fd;
+	job->off = wb->off;
+	job->count = wb->count;
+	job->bytes = wb->bytes;
+	memcpy(job->iovs, wb->iovs, wb->count * sizeof(struct iovec));
+	memcpy(job->bufs, wb->bufs, wb->count * sizeof(struct pkt_buf *));
 
-		return 0;
+	// copies stay where they are until written, the batch takes a new stage if it needs one meanwhile
+	job->stage = wb->stage_used > 0 ? wb->stage : NULL;
+	if (job->stage != NULL) wb->stage = NULL;
+
+	job->record_fd = record != NULL ? client->manifest_fd : -1;
+	job->record_sz = record != NULL ? record_sz : 0;
+	job->seal = record != NULL ? seal_manifest : NULL;
+	if (record != NULL) memcpy(job->record, record, record_sz);
+
+	job->task = task != NULL ? task : (client->delta ? apply_spool_job : NULL);
+	job->task_arg = (u_int64_t)client->stream_idx;
+
+	if (hand_write_job(client) < 0) {
+		fprintf(stderr, "myserver ~ submit_write_batch(): encountered error handing batch of client %u to its writer.\n", client->id);
+		return -1;
 	}
 
-	// if we've made it to here, everything is valid and client is writing data to file
+	if (wb->count > 0) client->write_calls ++;
 
-	if (pkt_sn == client->expected_sn) { // normal, write bytes to outfile
-		client->ack_sent = false;
+	wb->count = 0;
+	wb->bytes = 0;
+	wb->stage_used = 0;
+
+	return 0;
+}
 
-		if (pkt->written) {
-			lseek(client->outfd, pkt->file_idx, SEEK_SET);
-		} else {
-			pkt->file_idx = lseek(client->outfd, 0, SEEK_END);
+// next free job of client's writer, waiting for one if the writer is backed up, filled in as a job that does nothing
+// return job ptr, NULL on error
+struct write_job *take_write_job(struct client_info *client) {
+	struct writer_pool *pool = client->writer->pool;
+
+	struct write_job *job;
+	while ((job = writer_job_slot(client->writer)) == NULL) {
+		if (writer_pool_reap(pool) == 0 && writer_pool_wait(pool) < 0) {
+			fprintf(stderr, "myserver ~ take_write_job(): encountered error waiting for a free write job.\n");
+			return NULL;
 		}
+	}
+
+	job->client = client;
+	job->fd = -1;
+	job->count = 0;
+	job->bytes = 0;
+	job->stage = NULL;
+	job->record_fd = -1;
+	job->record_sz = 0;
+	job->seal = NULL;
+	job->task = NULL;
+	job->task_arg = 0;
+
+	return job;
+}
+
+// hand the job from take_write_job() to client's writer
+// return 0 on success, -1 on error
+int hand_write_job(struct client_info *client) {
+	if (writer_submit(client->writer) < 0) {
+		fprintf(stderr, "myserver ~ hand_write_job(): encountered error waking writer of client %u.\n", client->id);
+		return -1;
+	}
+
+	client->writes_inflight ++;
 
-		if (write_n_bytes(client->outfd, pkt_buf + DATA_HEADER_SIZE, pyld_sz) < 0) {
-			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error writing bytes to outfile: %s.\n", strerror(errno));
+	return 0;
+}
+
+// wait until every batch client handed to its writer is written and reaped
+// return 0 on success, -1 on error
+int wait_client_writes(struct client_info *client) {
+	while (client->writes_inflight > 0) {
+		if (writer_pool_reap(client->writer->pool) == 0 && writer_pool_wait(client->writer->pool) < 0) {
+			fprintf(stderr, "myserver ~ wait_client_writes(): encountered error waiting for writes of client %u.\n", client->id);
 			return -1;
 		}
+	}
+
+	return 0;
+}
 
-		pkt->written = true;
+// worker side of a completed write job, unpin its buffers, send the pkt its task built and queue the client's deferred ACK once nothing is in flight
+void reap_write_job(struct write_job *job, void *server_arg) {
+	struct server *server = server_arg;
+	struct client_info *client = job->client;
 
-		client->expected_sn = (pkt_sn + 1) % client->pkt_count;
+	for (int i = 0; i < job->count; i++) {
+		if (job->bufs[i] != NULL) pkt_pool_put(server->pool, job->bufs[i]);
+	}
+
+	if (client->write_batch.stage == NULL) {
+		client->write_batch.stage = job->stage;
 	} else {
-		// ACK last received valid pkt (whatever was before expected sn)
-		u_int32_t ack_sn = (client->expected_sn + client->pkt_count - 1) % client->pkt_count;
-		if (send_client_ack_sn(server, client, ack_sn) < 0) {
-			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error sending ack to client.\n");
-			return -1;
+		free(job->stage);
+	}
+
+	client->writes_inflight --;
+
+	// a SIG read from old outfile, the client asks again if it's lost
+	if (job->reply_sz > 0 && client->is_active && send_pkt(server, client, job->reply, job->reply_sz) < 0) {
+		fprintf(stderr, "myserver ~ reap_write_job(): encountered error sending reply built by writer to client %u.\n", client->id);
+	}
+
+	// same as a failed write on this thread, the worker gives up
+	if (job->res < 0) {
+		fprintf(stderr, "myserver ~ reap_write_job(): writer failed to write %zu bytes to %s.\n", job->bytes, client->outfile_path);
+		server->write_failed = true;
+	}
+
+	// outfile was left half finished, same as a failed finish on this thread
+	if (job->task_res < 0) {
+		fprintf(stderr, "myserver ~ reap_write_job(): writer failed to finish client %u.\n", client->id);
+		server->write_failed = true;
+	}
+
+	// a failed checkpoint only costs a later resume some progress, the transfer itself is fine
+	if (job->sync_res < 0) {
+		fprintf(stderr, "myserver ~ reap_write_job(): writer failed to checkpoint client %u, continuing without.\n", client->id);
+	}
+
+	// sent from the run loop, this may be reaped in the middle of handing the client another batch
+	if (client->writes_inflight > 0 || !client->ack_deferred || client->ack_ready) return;
+
+	if (server->acks_ready_count == server->acks_ready_cap) {
+		u_int32_t cap = server->acks_ready_cap == 0 ? 16 : server->acks_ready_cap * 2;
+		struct client_info **acks_ready = realloc(server->acks_ready, cap * sizeof(struct client_info *));
+		if (acks_ready == NULL) {
+			// ack timer or the client's resend still gets an ACK out
+			fprintf(stderr, "myserver ~ reap_write_job(): failed to grow deferred ack list, client %u waits for its timer.\n", client->id);
+			return;
 		}
 
-		return 0;
+		server->acks_ready = acks_ready;
+		server->acks_ready_cap = cap;
 	}
 
-	// check if last pkt for fast ACK, instead of waiting for timeout
-	if (pkt_sn == (client->expected_start_sn + client->winsz - 1) % client->pkt_count) {		
-		if (send_client_ack_sn(server, client, pkt_sn) < 0) {
-			fprintf(stderr, "myserver ~ process_data_pkt(): encountered error sending ack to client.\n");
+	client->ack_ready = true;
+	server->acks_ready[server->acks_ready_count++] = client;
+}
+
+// send the deferred ACK of every client whose writes were reaped
+// return 0 on success, -1 on error
+int send_ready_acks(struct server *server) {
+	// an ACK that hands over yet another batch may reap more, so the list can grow while it's walked
+	for (u_int32_t i = 0; i < server->acks_ready_count; i++) {
+		struct client_info *client = server->acks_ready[i];
+
+		// terminated, and maybe reused, since it was queued
+		if (!client->ack_ready) continue;
+
+		client->ack_ready = false;
+		client->ack_deferred = false;
+
+		if (client->is_active && send_client_ack(server, client) < 0) {
+			fprintf(stderr, "myserver ~ send_ready_acks(): encountered error sending deferred ack to client %u.\n", client->id);
 			return -1;
 		}
 	}
 
+	server->acks_ready_count = 0;
+
 	return 0;
 }
 
@@ -762,17 +2464,15 @@ int process_ack_pkt(struct server *server, char *pkt_buf) {
 		return -1;
 	}
 
-	if (client_id < 1 || client_id > server->max_client_count) {
-		fprintf(stderr, "myserver ~ process_ack_pkt(): invalid client id contained in ACK: %u.\n", client_id);
-		return -1;
-	}
-
-	struct client_info *client = &server->clients[client_id - 1];
+	// don't process ack, but don't exit server
+	struct client_info *client = get_client(server, client_id);
 	if (client == NULL) {
-		fprintf(stderr, "myserver ~ process_ack_pkt(): cannot process ack for NULL client %u.\n", client_id);
-		return -1;
+		fprintf(stderr, "myserver ~ process_ack_pkt(): invalid client id contained in ACK: %u, skipping packet.\n", client_id);
+		return 0;
 	}
 
+	client->last_recv_ms = server->now_ms;
+
 	if (client->is_active && client->terminating) {
 		if (terminate_client(server, client_id) < 0) {
 			fprintf(stderr, "myserver ~ process_ack_pkt(): encountered an error terminating connection with client %u.\n", client_id);
@@ -795,6 +2495,11 @@ int process_ack_pkt(struct server *server, char *pkt_buf) {
 // returns 1 if true, 0 if false
 // int drops = 0;
 int drop_pkt(struct server *server, char *pkt_buf, int *pkt_count, int droppc) {
+	if (droppc == 0) {
+		(*pkt_count) ++;
+
+		return 0;
+	}
 
 	int every = 100 / droppc;
 
@@ -810,8 +2515,10 @@ int drop_pkt(struct server *server, char *pkt_buf, int *pkt_count, int droppc) {
 
 	// printf("DROP RATE %f\n", (float)drops/(float)(*pkt_count));
 
+	// every worker logs its drops, so neither the time nor the address can go through a shared static buffer
 	time_t t = time(NULL);
-	struct tm *tm = gmtime(&t);
+	struct tm tm_buf;
+	struct tm *tm = gmtime_r(&t, &tm_buf);
 
 	u_int32_t opcode = get_pkt_opcode(pkt_buf);
 	if (opcode == 0) {
@@ -819,14 +2526,16 @@ int drop_pkt(struct server *server, char *pkt_buf, int *pkt_count, int droppc) {
 		return -1;
 	}
 
-	if (opcode < OP_WR || opcode > OP_DATA) {
+	if (opcode < OP_WR || opcode > OP_HAVE) {
 		fprintf(stderr, "myserver ~ drop_pkt(): opcode %u is not supported by server.\n", opcode);
 		return -1;
 	}
 
-	char *opstring = opcode == OP_ACK ? "DROP ACK" : (opcode == OP_WR ? "DROP CTRL" : "DROP DATA");
+	bool is_ack = opcode == OP_ACK || opcode == OP_SACK;
+
+	char *opstring = is_ack ? "DROP ACK" : (opcode == OP_DATA ? "DROP DATA" : "DROP CTRL");
 
-	u_int32_t sn = opcode == OP_WR ? 0 : (opcode == OP_ACK ? get_ack_sn(pkt_buf) : get_data_sn(pkt_buf));
+	u_int32_t sn = is_ack ? get_ack_sn(pkt_buf) : (opcode == OP_DATA ? get_data_sn(pkt_buf) : (opcode == OP_SIG || opcode == OP_HAVE ? get_sig_idx(pkt_buf) : 0));
 	if (sn == 0 && errno == 1) {
 		fprintf(stderr, "myserver ~ drop_pkt(): encountered an error getting pkt sn from pkt.\n");
 		return -1;
@@ -843,7 +2552,8 @@ int drop_pkt(struct server *server, char *pkt_buf, int *pkt_count, int droppc) {
 		return -1;
 	}
 
-	char *rip = inet_ntoa(((struct sockaddr_in *)&server->clientaddr)->sin_addr);
+	char rip[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &((struct sockaddr_in *)&server->clientaddr)->sin_addr, rip, sizeof(rip));
 	int rport = htons(((struct sockaddr_in *)&server->clientaddr)->sin_port);
 
 	printf("%d-%02d-%02dT%02d:%02d:%02dZ, %d, %s, %d, %s, %u\n", tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec, lport, rip, rport, opstring, sn);
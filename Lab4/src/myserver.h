@@ -1,10 +1,79 @@
 #ifndef MYSERVER_INCLUDE
 #define MYSERVER_INCLUDE
 
-#define START_CLIENTS 10
-#define CLIENT_CAP_INCREASE 5
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "timer_wheel.h"
+
+#define BUFFER_SIZE 65535
+#define RECV_BATCH_SIZE 32											// max pkts drained from socket per recvmmsg() call
+#define RECV_POOL_BUFS 256											// receive buffers per worker, those not in the recv batch hold batched payloads
+#define RECV_ZERO_TAIL (WR_RANGE_SIZE + WR_INFILE_ID_SIZE + 1)		// bytes cleared past each datagram, optional trailers like the WR range read as absent from them
+#define SEND_BATCH_SIZE 64											// max pkts queued before sendmmsg() flush
+#define SEND_ARENA_SIZE 65536										// bytes of queued outgoing pkt data
+#define ACK_DELAY_MS 40											// ack new data this long after the last pkt if the client never asked for it, well under the client's min rto
+#define CLIENT_IDLE_SECS TIMEOUT_SECS								// silent clients are reaped, clients give up after this long without a reply
+#define RESUME_SYNC_BYTES (8 << 20)									// outfile is synced and its manifest updated each time this many more bytes are written
+#define RESUME_TAIL_BYTES 4096										// bytes just before a manifest's end whose crc it keeps, preallocation keeps the size check from noticing a changed outfile
+#define DELTA_APPLY_BYTES (64 << 10)								// bytes of a spooled delta stream read back at a time to be applied
+#define RESUME_MAGIC 0x53524652u
 
 struct client_info;
+struct s_pkt_info;
+struct client_table;
+struct path_table;
+struct path_entry;
+struct chunk_store;
+struct pkt_pool;
+struct pkt_buf;
+struct writer_pool;
+struct write_job;
+
+// progress of one range of a partly written outfile, kept in <outfile>.resume-<range_off>
+// bytes of the range from range_off on were durably on disk when it was written, the last tail_len of them had crc tail_crc
+// the infile they came from is named by its size, mtime and the crc of its first bytes, a resume from any other starts over
+struct resume_manifest {
+	u_int32_t magic;
+	u_int32_t tail_len;
+	u_int64_t range_off;
+	u_int64_t bytes;
+	u_int32_t tail_crc;
+	u_int32_t in_crc;
+	u_int64_t in_size;
+	u_int64_t in_mtime;
+};
+
+// datagrams received by one recvmmsg() call, each into a pooled buffer
+// a DATA header is scattered into the end of the buffer's headroom and its payload onto the page aligned data right after it
+struct recv_batch {
+	struct mmsghdr msgs[RECV_BATCH_SIZE];
+	struct iovec iovs[RECV_BATCH_SIZE][2];							// header, then payload, contiguous so any pkt parses in place
+	struct sockaddr addrs[RECV_BATCH_SIZE];
+	char ctrls[RECV_BATCH_SIZE][CMSG_SPACE(sizeof(int))];			// UDP_GRO segment size of each datagram, when the kernel coalesced it
+	struct pkt_buf *bufs[RECV_BATCH_SIZE];
+};
+
+// outgoing pkts waiting for the next sendmmsg() call
+struct send_batch {
+	struct mmsghdr msgs[SEND_BATCH_SIZE];
+	struct iovec iovs[SEND_BATCH_SIZE];
+	struct sockaddr addrs[SEND_BATCH_SIZE];
+	char *arena;													// pkt bytes are copied here until flushed
+	size_t arena_used;
+	unsigned int count;
+};
+
+// waiting clients of this worker that another worker's terminate_client() handed a path to
+// only the worker that owns a client may touch it, so their handshake ACKs are sent from here
+struct promote_inbox {
+	pthread_mutex_t lock;
+	u_int32_t *ids;
+	u_int32_t count;
+	u_int32_t cap;
+	int wake_fd;													// eventfd kicked after every push, polled next to the socket
+	bool pending;													// wake_fd was seen readable, ids are taken on the next pass of the run loop
+};
 
 struct server {
 	int sockfd;
@@ -13,19 +82,49 @@ struct server {
 	int droppc;
 	int pkts_recvd;
 	int pkts_sent;
-	struct client_info *clients;
-	u_int32_t max_client_count;
+	bool gro;														// -g, kernel may hand over a run of one client's pkts as one datagram
+	struct client_table *clients;
 	const char *root_folder_path;
+	int shard;														// this worker's index, stored in the low bits of its client ids
+	int shard_count;
+	struct path_table *paths;										// shared by all workers
+	struct chunk_store *store;										// shared by all workers, NULL without -k
+	struct pkt_pool *pool;											// buffers recv_batch receives into, batched payloads keep theirs
+	struct pkt_buf *recv_buf;										// buffer of the datagram being processed
+	struct writer_pool *writers;									// -d, NULL if outfiles are written on this thread
+	struct client_info **acks_ready;								// clients whose deferred ACK can go out, their writes are done
+	u_int32_t acks_ready_count;
+	u_int32_t acks_ready_cap;
+	bool write_failed;												// a writer thread failed to write a batch
+	struct server **peers;											// every worker indexed by shard, so a freed path can be handed to another worker's client
+	struct promote_inbox inbox;
+	struct recv_batch recv_batch;
+	struct send_batch send_batch;
+	struct timer_wheel timers;										// ack delay and silence timers of this worker's clients
+	u_int64_t now_ms;												// monotonic time of the current batch
 };
 
 // initialize server info with port and droppc, init socket and clients
+// shard is this worker's index out of shard_count workers sharing port, paths and store
+// gro asks the kernel to coalesce pkts with UDP_GRO, the server receives them one at a time if it can't
+// disk_writers threads take the worker's outfile writes, 0 writes them on the worker itself
 // returns pointer to server struct on success, NULL on failure
-struct server *init_server(int port, int droppc, const char *root_folder_path);
+struct server *init_server(int port, int droppc, const char *root_folder_path, int shard, int shard_count, struct path_table *paths, struct chunk_store *store, bool gro, int disk_writers);
+
+// run server worker on its own thread, exiting process if the worker fails
+void *run_worker(void *server);
 
 // free allocated memory for server, terminate clients, and close socket
 void close_server(struct server **server);
 
-struct client_info *check_existing_client(struct server *server, char *outfile_path);
+// look up the path table entry for outfile_path, the entry added by the current client address is preferred over the owner
+// copy of entry is put in *entry
+// return true if entry was found, false otherwise
+bool check_existing_client(struct server *server, char *outfile_path, struct path_entry *entry);
+
+// find client in this worker's shard from client id
+// return client_info ptr, NULL if client id is invalid or belongs to another worker
+struct client_info *get_client(struct server *server, u_int32_t client_id);
 
 // accept new client with id client_id writing to file outfile_path
 // open outfile and add client to clients with outfd
@@ -34,8 +133,26 @@ struct client_info *find_new_client(struct server *server, char *outfile_path, u
 
 int accept_client(struct client_info *client);
 
+// reserve the whole advertised file in outfile before any payload lands, so it's laid out in few extents and writes never extend it
+// sets the size instead when the filesystem can't preallocate, outfile is never shrunk
+// return 0 on success, -1 on error
+int preallocate_outfile(struct client_info *client);
+
+// client owns its outfile path, pick up where its manifest says if it asked to resume and send the handshake ACK
+// shared by clients accepted right away and waiting clients promoted once their path frees up
+// return 0 on success, -1 on error
+int send_handshake_ack(struct server *server, struct client_info *client);
+
+// hand the path a terminated client released to waiting client client_id, on whichever worker owns it
+// return 0 on success, -1 on error
+int promote_waiting_client(struct server *server, u_int32_t client_id);
+
+// send the handshake ACK of every waiting client other workers promoted since the last call
+// return 0 on success, -1 on error
+int take_promoted_clients(struct server *server);
+
 // terminate connection with client with id client_id and free necessary memory
-// close outfile and set client inactive
+// works for clients at any stage, close outfile if it was opened, stop timers, release path and slot
 // return 0 on success, -1 on error
 int terminate_client(struct server *server, u_int32_t client_id);
 
@@ -43,43 +160,214 @@ int terminate_client(struct server *server, u_int32_t client_id);
 // this function will run forever once called, or until there is an error (returns -1)
 int run(struct server *server);
 
-// send pkt to client
+// dispatch expired client timer to its handler, arg is the server
+// return 0 on success, -1 on error
+int fire_client_timer(struct timer *timer, void *arg);
+
+// ack delay expired, ack whatever arrived since the last ack even though the client never asked for it
+// return 0 on success, -1 on error
+int client_ack_timeout(struct server *server, struct client_info *client);
+
+// client has been silent, resend its ack every LOSS_TIMEOUT_SECS and reap it after CLIENT_IDLE_SECS
+// return 0 on success, -1 on error
+int client_silence_timeout(struct server *server, struct client_info *client);
+
+// queue pkt to client, it is sent on the next flush_send_batch()
 // return 0 on success, -1 on error
 int send_pkt(struct server *server, struct client_info *client, char *pkt_buf, size_t pkt_size);
 
+// queue pkt to sockaddr, it is sent on the next flush_send_batch()
+// return 0 on success, -1 on error
+int send_pkt_to(struct server *server, struct sockaddr *sockaddr, socklen_t sockaddr_size, char *pkt_buf, size_t pkt_size);
+
+// queue bare ACK with sn to sockaddr, without touching any client state
+// return 0 on success, -1 on error
+int send_ack_to(struct server *server, struct sockaddr *sockaddr, socklen_t sockaddr_size, u_int32_t ack_sn);
+
+// send all queued pkts with sendmmsg()
+// return 0 on success, -1 on error
+int flush_send_batch(struct server *server);
+
 // send ack to client based on what packets were received
 // return 0 on success, -1 on error
 int send_client_ack(struct server *server, struct client_info *client);
 
-// send ack to client with given sn
+// send ack to client with given sn, as a SACK if pkts past it were received
 // return 0 on success, -1 on error
 int send_client_ack_sn(struct server *server, struct client_info *client, u_int32_t ack_sn);
 
-// update ack and written status of pkts when ack is sent
+// set bit i of bitmap for every received pkt ack_sn + 1 + i in the receive window
+// return bitmap size in bytes, trimmed after the last received pkt, 0 if nothing past ack_sn was received
+u_int32_t fill_sack_bitmap(struct client_info *client, u_int32_t ack_sn, u_int8_t *bitmap);
+
+// slide receive window past ack_sn, clearing the pkt info of every acked pkt so its slot can be reused
+// received pkts past ack_sn are kept
 // return 0 on success, -1 on failure
-int update_pkt_info(struct client_info *client);
+int update_pkt_info(struct client_info *client, u_int32_t ack_sn);
 
-// finds sn for client ack based on first unwritten pkt
+// finds sn for client ack, the last pkt of the contiguous written prefix
 u_int32_t get_client_ack_sn(struct client_info *client);
 
-// recv pkt from socket into pkt_buf
-// pkt will potentially be dropped
-// return 1 on success, 2 on select timeout, 0 on drop, and -1 on error
-int recv_pkt(struct server *server, char *pkt_buf);
+// recv up to RECV_BATCH_SIZE pkts from socket into server->recv_batch
+// return number of pkts received, 0 on poll timeout, and -1 on error
+int recv_pkt_batch(struct server *server);
+
+// point recv slot i at buf, header iov ending where buf's data begins
+void set_recv_buf(struct recv_batch *rb, int i, struct pkt_buf *buf);
 
-// process pkt from pkt_buf based on opcode
+// size of the pkts GRO coalesced into the datagram msg_hdr received, 0 if it holds a single pkt
+size_t get_gro_seg_sz(struct msghdr *msg_hdr);
+
+// process every pkt in the pkt_size byte datagram at pkt_buf, GRO may have coalesced a run of seg_sz byte pkts from one client into it
+// seg_sz is 0 for a single pkt
+// return 0 on success, -1 on error
+int process_pkt(struct server *server, char *pkt_buf, size_t pkt_size, size_t seg_sz);
+
+// process one pkt_len byte pkt from pkt_buf based on opcode
 // return 0 on success, -1 on error
-int process_pkt(struct server *server, char *pkt_buf);
+int dispatch_pkt(struct server *server, char *pkt_buf, size_t pkt_len);
 
 // initialize client connection with outfile and next client_id, send response to client with client_id
 // return 0 on success, -1 on error
-int process_write_req(struct server *server, char *pkt_buf);
+int process_write_req(struct server *server, char *pkt_buf, size_t pkt_len);
 
 // perform writing actions from a data pkt sent by known client
+// every pkt is written at its offset as it arrives, pkts past a hole only wait for it to be taken into the prefix
 // if payload size == 0, terminate client connection
+// if payload runs past the pkt_len bytes received, drop it
 // if client unrecognized, don't do anything
 // return 0 on success, -1 on error
-int process_data_pkt(struct server *server, char *pkt_buf);
+int process_data_pkt(struct server *server, char *pkt_buf, size_t pkt_len);
+
+// take every received pkt from expected_sn on into the contiguous prefix, until the next hole
+// return 0 on success, -1 on error
+int advance_prefix(struct client_info *client);
+
+// contiguous prefix reached pkt, whose payload is already batched at its offset, payload size 0 marks client as terminating
+// digest, delta, checkpoints and termination all follow the prefix, so they see the stream in order
+// return 0 on success, -1 on error
+int extend_prefix(struct client_info *client, struct s_pkt_info *pkt);
+
+// client's range is complete and every batch written, bring outfile to its final state and check it against the client's digest
+// truncate past the last range, drop the manifest, digest the range and rebuild a delta, then ingest a whole outfile that matched
+// runs on the client's writer when it has one, the worker leaves the client's files alone until it's reaped
+// return 0 on success, -1 on error
+int finish_client(struct client_info *client);
+
+// set client's digest to the crc32c of len bytes of fd from the start of its range, fd -1 for a file that isn't there
+// a digest other than the client's marks the mismatch, every pkt passed its crc so outfile didn't end up as infile
+// return 0 on success, -1 on error
+int check_digest(struct client_info *client, int fd, off_t len);
+
+// finish_client() as the task of the client's last write job
+// return 0 on success, -1 on error
+int finish_client_job(struct write_job *job);
+
+// path of the manifest for client's range of outfile, written into buf
+void manifest_path(struct client_info *client, char *buf, size_t buf_sz);
+
+// find how much of client's range an earlier transfer left durably written
+// return bytes to resume after, 0 if there is no usable manifest
+off_t load_manifest(struct client_info *client);
+
+// sync outfile and record write_idx in client's manifest, so a later transfer can resume after it
+// return 0 on success, -1 on error
+int checkpoint_client(struct client_info *client);
+
+// read back the tail of the range manifest record claims from synced outfd and record its crc
+// runs on whichever thread synced outfd
+// return 0 on success, -1 on error
+int seal_manifest(int outfd, char *record);
+
+// range is complete, its manifest is no longer needed
+void remove_manifest(struct client_info *client);
+
+// open old outfile as the basis of client's delta, and the temp file outfile is rebuilt in
+// return 0 on success, -1 on error
+int open_delta(struct client_info *client);
+
+// path of the temp file client's outfile is rebuilt in, written into buf
+void delta_path(struct client_info *client, char *buf, size_t buf_sz);
+
+// apply delta stream bytes from pyld to client's temp file, ops can span pkts so the parse state is kept in client
+// return 0 on success, -1 on error
+int apply_delta(struct client_info *client, char *pyld, u_int32_t pyld_sz);
+
+// apply client's delta stream from its spool up to end, the prefix has to have reached end and every byte before it be in the spool
+// return 0 on success, -1 on error
+int apply_spool(struct client_info *client, off_t end);
+
+// apply_spool() as the task of a write job, up to where the prefix was when the job was handed over
+// return 0 on success, -1 on error
+int apply_spool_job(struct write_job *job);
+
+// copy count blocks of the old outfile from first on to the end of client's temp file
+// return 0 on success, -1 on error
+int copy_basis_blocks(struct client_info *client, u_int32_t first, u_int32_t count);
+
+// add the chunks of client's finished outfile the chunk store doesn't hold yet, a failure only costs later transfers the dedup
+void store_outfile(struct client_info *client);
+
+// copy len byte chunk with hash from the chunk store to the end of client's temp file
+// a chunk the store doesn't hold breaks the stream, the old outfile is then kept
+void copy_store_chunk(struct client_info *client, u_int8_t *hash, u_int32_t len);
+
+// delta stream ended, replace outfile with the temp file unless the stream was broken
+// return 0 on success, -1 on error
+int finish_delta(struct client_info *client);
+
+// process SIG request from a delta client, answering with the signatures of one run of old outfile blocks
+// with disk writers the blocks are read on the client's writer and the answer goes out once its job is reaped
+// return 0 on success, -1 on error
+int process_sig_req(struct server *server, char *pkt_buf);
+
+// process HAVE request from a dedup client, answering with a bitmap of the chunk hashes in it the chunk store holds
+// return 0 on success, -1 on error
+int process_have_req(struct server *server, char *pkt_buf, size_t pkt_len);
+
+// fill SIG response idx for client into pkt_buf, header followed by the signatures of the blocks it covers
+// return pkt size, -1 on error
+int fill_sig_pkt(struct client_info *client, u_int32_t idx, char *pkt_buf);
+
+// fill_sig_pkt() as the task of a write job, the SIG is its reply
+// return 0 on success, -1 on error
+int fill_sig_job(struct write_job *job);
+
+// add payload at pos of pyld_fd to client's write batch, writing the batch first if it has no room left or pos doesn't follow on from it
+// a payload still in receive buffer buf pins it, anything else is copied to the batch's stage
+// return 0 on success, -1 on error
+int batch_pkt_pyld(struct client_info *client, struct pkt_buf *buf, char *pyld, u_int32_t pyld_sz, off_t pos);
+
+// write client's batched payloads to outfile with one pwritev() and unpin their receive buffers
+// a client with a writer thread hands the batch to it instead, the buffers are unpinned once it is reaped
+// batch is emptied even if the write fails
+// return 0 on success, -1 on error
+int flush_write_batch(struct client_info *client);
+
+// hand client's batch to its writer thread, waiting for a free job if the writer is backed up
+// record of record_sz bytes is rewritten in the manifest once outfile is synced, record NULL for a plain write
+// task runs on the writer after the batch, NULL for none, a delta's batch then applies the stream as far as the prefix has reached
+// return 0 on success, -1 on error
+int submit_write_batch(struct client_info *client, void *record, size_t record_sz, int (*task)(struct write_job *job));
+
+// next free job of client's writer, waiting for one if the writer is backed up, filled in as a job that does nothing
+// return job ptr, NULL on error
+struct write_job *take_write_job(struct client_info *client);
+
+// hand the job from take_write_job() to client's writer
+// return 0 on success, -1 on error
+int hand_write_job(struct client_info *client);
+
+// wait until every batch client handed to its writer is written and reaped
+// return 0 on success, -1 on error
+int wait_client_writes(struct client_info *client);
+
+// worker side of a completed write job, unpin its buffers, send the pkt its task built and queue the client's deferred ACK once nothing is in flight
+void reap_write_job(struct write_job *job, void *server);
+
+// send the deferred ACK of every client whose writes were reaped
+// return 0 on success, -1 on error
+int send_ready_acks(struct server *server);
 
 // process ack pkt from client, for initializing or terminating connection
 // return 0 on success, -1 on error
@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <pthread.h>
+
+#include "path_table.h"
+#include "utils.h"
+
+// FNV-1a hash of path
+u_int32_t hash_path(const char *path) {
+	u_int32_t hash = 2166136261u;
+
+	for (const unsigned char *c = (const unsigned char *)path; *c; c++) {
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// find node for path in its bucket
+// return node ptr, NULL if path is not in the table
+struct path_node *find_node(struct path_table *table, const char *path, u_int32_t hash) {
+	struct path_node *node = table->buckets[hash & (table->bucket_count - 1)];
+
+	while (node != NULL && (node->hash != hash || strcmp(node->path, path))) {
+		node = node->next;
+	}
+
+	return node;
+}
+
+// double bucket count and rehash nodes, keeps chains short as paths are added
+// return 0 on success, -1 on error
+int grow_buckets(struct path_table *table) {
+	u_int32_t new_count = table->bucket_count * 2;
+
+	struct path_node **buckets = calloc(new_count, sizeof(struct path_node *));
+	if (buckets == NULL) {
+		fprintf(stderr, "myserver ~ grow_buckets(): failed to allocate %u path buckets.\n", new_count);
+		return -1;
+	}
+
+	for (u_int32_t i = 0; i < table->bucket_count; i++) {
+		struct path_node *node = table->buckets[i], *next;
+		while (node != NULL) {
+			next = node->next;
+			node->next = buckets[node->hash & (new_count - 1)];
+			buckets[node->hash & (new_count - 1)] = node;
+			node = next;
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->bucket_count = new_count;
+
+	return 0;
+}
+
+// unlink node from its bucket and free it, node must have no owner or waiting clients
+void remove_node(struct path_table *table, struct path_node *node) {
+	struct path_node **link = &table->buckets[node->hash & (table->bucket_count - 1)];
+
+	while (*link != node) {
+		link = &(*link)->next;
+	}
+
+	*link = node->next;
+	table->node_count --;
+
+	free(node->path);
+	free(node);
+}
+
+// push holder onto the owner list of its node, table lock must be held
+void add_owner(struct path_node *node, struct path_holder *holder) {
+	holder->owns = true;
+	holder->prev = NULL;
+	holder->next = node->owners;
+
+	if (node->owners != NULL) {
+		node->owners->prev = holder;
+	}
+	node->owners = holder;
+}
+
+// take holder off the owner list or waiting FIFO of its node, table lock must be held
+void unlink_holder(struct path_node *node, struct path_holder *holder) {
+	if (holder->prev != NULL) {
+		holder->prev->next = holder->next;
+	} else if (holder->owns) {
+		node->owners = holder->next;
+	} else {
+		node->wait_head = holder->next;
+	}
+
+	if (holder->next != NULL) {
+		holder->next->prev = holder->prev;
+	} else if (!holder->owns) {
+		node->wait_tail = holder->prev;
+	}
+
+	holder->prev = holder->next = NULL;
+}
+
+// allocate empty path table
+// return pointer to path table on success, NULL on error
+struct path_table *init_path_table(void) {
+	struct path_table *table = malloc(sizeof(struct path_table));
+	if (table == NULL) {
+		fprintf(stderr, "myserver ~ init_path_table(): failed to allocate memory for path table.\n");
+		return NULL;
+	}
+
+	table->buckets = calloc(START_PATH_BUCKETS, sizeof(struct path_node *));
+	if (table->buckets == NULL) {
+		fprintf(stderr, "myserver ~ init_path_table(): failed to allocate memory for path buckets.\n");
+		free(table);
+		return NULL;
+	}
+
+	table->bucket_count = START_PATH_BUCKETS;
+	table->node_count = 0;
+
+	pthread_mutex_init(&table->lock, NULL);
+
+	return table;
+}
+
+// free all nodes and holders and the table itself
+void free_path_table(struct path_table **table) {
+	for (u_int32_t i = 0; i < (*table)->bucket_count; i++) {
+		struct path_node *node = (*table)->buckets[i], *next_node;
+		while (node != NULL) {
+			next_node = node->next;
+
+			struct path_holder *lists[2] = { node->owners, node->wait_head };
+			for (int l = 0; l < 2; l++) {
+				struct path_holder *holder = lists[l], *next_holder;
+				while (holder != NULL) {
+					next_holder = holder->next;
+					free(holder);
+					holder = next_holder;
+				}
+			}
+
+			free(node->path);
+			free(node);
+
+			node = next_node;
+		}
+	}
+
+	free((*table)->buckets);
+
+	pthread_mutex_destroy(&(*table)->lock);
+
+	free(*table);
+
+	*table = NULL;
+}
+
+// find entry for path, preferring the holder added by sockaddr over the first path owner
+// copy of entry is put in *entry
+// return true if an entry was found, false otherwise
+bool path_table_find(struct path_table *table, const char *path, struct sockaddr sockaddr, struct path_entry *entry) {
+	u_int32_t hash = hash_path(path);
+
+	pthread_mutex_lock(&table->lock);
+
+	struct path_node *node = find_node(table, path, hash);
+	if (node == NULL) {
+		pthread_mutex_unlock(&table->lock);
+		return false;
+	}
+
+	// only clients holding this one path are checked for a retransmitted WR
+	struct path_holder *holder;
+	for (holder = node->wait_head; holder != NULL; holder = holder->next) {
+		if (sockaddrs_eq(holder->sockaddr, sockaddr)) break;
+	}
+
+	entry->waiting = holder != NULL;
+
+	// several streams of one transfer may own the path, each from its own address
+	if (holder == NULL) {
+		for (holder = node->owners; holder != NULL; holder = holder->next) {
+			if (sockaddrs_eq(holder->sockaddr, sockaddr)) break;
+		}
+
+		if (holder == NULL) holder = node->owners;
+	}
+
+	entry->client_id = holder->client_id;
+	entry->sockaddr = holder->sockaddr;
+
+	pthread_mutex_unlock(&table->lock);
+
+	return true;
+}
+
+// add client to path, as owner if path is free or already owned by other streams of transfer tag, to the back of the waiting FIFO otherwise
+// tag 0 always needs the path to itself
+// holder for the client is put in *holder, it stays valid until released
+// return 0 if client owns path, 1 if client is waiting, -1 on error
+int path_table_claim(struct path_table *table, const char *path, u_int32_t client_id, struct sockaddr sockaddr, u_int32_t tag, struct path_holder **holder) {
+	struct path_holder *new_holder = calloc(1, sizeof(struct path_holder));
+	if (new_holder == NULL) {
+		fprintf(stderr, "myserver ~ path_table_claim(): failed to allocate path holder for client %u.\n", client_id);
+		return -1;
+	}
+
+	new_holder->client_id = client_id;
+	new_holder->sockaddr = sockaddr;
+	new_holder->tag = tag;
+
+	u_int32_t hash = hash_path(path);
+
+	pthread_mutex_lock(&table->lock);
+
+	struct path_node *node = find_node(table, path, hash);
+	if (node == NULL) {
+		if (table->node_count >= table->bucket_count - table->bucket_count / 4 && grow_buckets(table) < 0) {
+			pthread_mutex_unlock(&table->lock);
+			free(new_holder);
+			return -1;
+		}
+
+		node = calloc(1, sizeof(struct path_node));
+		if (node == NULL || (node->path = strdup(path)) == NULL) {
+			fprintf(stderr, "myserver ~ path_table_claim(): failed to allocate memory for path %s.\n", path);
+			pthread_mutex_unlock(&table->lock);
+			free(node);
+			free(new_holder);
+			return -1;
+		}
+
+		node->hash = hash;
+		node->next = table->buckets[hash & (table->bucket_count - 1)];
+		table->buckets[hash & (table->bucket_count - 1)] = node;
+		table->node_count ++;
+	}
+
+	new_holder->node = node;
+
+	int res = 0;
+	if (node->owners == NULL || (tag != 0 && node->owners->tag == tag)) {
+		add_owner(node, new_holder);
+	} else {
+		new_holder->prev = node->wait_tail;
+		if (node->wait_tail != NULL) {
+			node->wait_tail->next = new_holder;
+		} else {
+			node->wait_head = new_holder;
+		}
+		node->wait_tail = new_holder;
+
+		res = 1;
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	*holder = new_holder;
+
+	return res;
+}
+
+// remove holder from its path, once the last owner is gone the first waiting client and any waiting streams of its transfer become owners
+// copies of up to max_next new owner entries are put in next, holder is freed
+// return number of waiting clients that became owners, -1 on error
+int path_table_release(struct path_table *table, struct path_holder *holder, struct path_entry *next, int max_next) {
+	if (holder == NULL) {
+		fprintf(stderr, "myserver ~ path_table_release(): cannot release NULL path holder.\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(&table->lock);
+
+	struct path_node *node = holder->node;
+	int res = 0;
+
+	bool owned = holder->owns;
+	unlink_holder(node, holder);
+
+	if (owned && node->owners == NULL && node->wait_head != NULL) {
+		// pop front of waiting FIFO into owner, streams of its transfer further back come along with it
+		u_int32_t tag = node->wait_head->tag;
+		struct path_holder *waiting = node->wait_head, *next_waiting;
+
+		while (waiting != NULL && res < max_next) {
+			next_waiting = waiting->next;
+
+			if (waiting == node->wait_head || (tag != 0 && waiting->tag == tag)) {
+				unlink_holder(node, waiting);
+				add_owner(node, waiting);
+
+				next[res].client_id = waiting->client_id;
+				next[res].sockaddr = waiting->sockaddr;
+				next[res].waiting = false;
+
+				res ++;
+			}
+
+			waiting = next_waiting;
+		}
+	}
+
+	if (node->owners == NULL && node->wait_head == NULL) {
+		remove_node(table, node);
+	}
+
+	pthread_mutex_unlock(&table->lock);
+
+	free(holder);
+
+	return res;
+}
@@ -0,0 +1,89 @@
+#ifndef PATH_TABLE_INCLUDE
+#define PATH_TABLE_INCLUDE
+
+#include <pthread.h>
+
+#define START_PATH_BUCKETS 64
+
+struct path_node;
+
+// one client holding (or waiting on) an outfile path
+struct path_holder {
+	u_int32_t client_id;
+	struct sockaddr sockaddr;
+	u_int32_t tag;						// range tag of the client's transfer, 0 if it writes the whole file
+	bool owns;
+	struct path_node *node;
+	struct path_holder *prev, *next;	// owner list or waiting FIFO links
+};
+
+// outfile path with its owners and FIFO of clients waiting for it
+// a path has one owner, or one per stream when every owner writes a range of the same transfer
+struct path_node {
+	char *path;
+	u_int32_t hash;
+	struct path_holder *owners;
+	struct path_holder *wait_head, *wait_tail;
+	struct path_node *next;				// hash bucket chain
+};
+
+// copy of a path holder, safe to use after the table lock is released
+struct path_entry {
+	u_int32_t client_id;
+	struct sockaddr sockaddr;
+	bool waiting;
+};
+
+// outfile paths in use by any server worker, shared between worker threads
+// paths are relative to the server root folder, so lookups never rebuild the full path
+struct path_table {
+	pthread_mutex_t lock;
+	struct path_node **buckets;
+	u_int32_t bucket_count;
+	u_int32_t node_count;
+};
+
+// FNV-1a hash of path
+u_int32_t hash_path(const char *path);
+
+// find node for path in its bucket, table lock must be held
+// return node ptr, NULL if path is not in the table
+struct path_node *find_node(struct path_table *table, const char *path, u_int32_t hash);
+
+// double bucket count and rehash nodes, table lock must be held
+// return 0 on success, -1 on error
+int grow_buckets(struct path_table *table);
+
+// unlink node from its bucket and free it, node must have no owner or waiting clients
+void remove_node(struct path_table *table, struct path_node *node);
+
+// push holder onto the owner list of its node, table lock must be held
+void add_owner(struct path_node *node, struct path_holder *holder);
+
+// take holder off the owner list or waiting FIFO of its node, table lock must be held
+void unlink_holder(struct path_node *node, struct path_holder *holder);
+
+// allocate empty path table
+// return pointer to path table on success, NULL on error
+struct path_table *init_path_table(void);
+
+// free all nodes and holders and the table itself
+void free_path_table(struct path_table **table);
+
+// find entry for path, preferring the holder added by sockaddr over the first path owner
+// copy of entry is put in *entry
+// return true if an entry was found, false otherwise
+bool path_table_find(struct path_table *table, const char *path, struct sockaddr sockaddr, struct path_entry *entry);
+
+// add client to path, as owner if path is free or already owned by other streams of transfer tag, to the back of the waiting FIFO otherwise
+// tag 0 always needs the path to itself
+// holder for the client is put in *holder, it stays valid until released
+// return 0 if client owns path, 1 if client is waiting, -1 on error
+int path_table_claim(struct path_table *table, const char *path, u_int32_t client_id, struct sockaddr sockaddr, u_int32_t tag, struct path_holder **holder);
+
+// remove holder from its path, once the last owner is gone the first waiting client and any waiting streams of its transfer become owners
+// copies of up to max_next new owner entries are put in next, holder is freed
+// return number of waiting clients that became owners, -1 on error
+int path_table_release(struct path_table *table, struct path_holder *holder, struct path_entry *next, int max_next);
+
+#endif
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "pkt_pool.h"
+
+// map count buffers and put them all on the free list
+// return pointer to pkt pool on success, NULL on error
+struct pkt_pool *init_pkt_pool(u_int32_t count) {
+	if (count == 0) {
+		fprintf(stderr, "myserver ~ init_pkt_pool(): cannot create pool of 0 buffers.\n");
+		return NULL;
+	}
+
+	struct pkt_pool *pool = malloc(sizeof(struct pkt_pool));
+	if (pool == NULL) {
+		fprintf(stderr, "myserver ~ init_pkt_pool(): failed to allocate pkt pool.\n");
+		return NULL;
+	}
+
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+	pool->stride = page + (PKT_POOL_DATA_SIZE + page - 1) / page * page;
+	pool->mem_sz = pool->stride * count;
+	pool->count = count;
+
+	// anonymous mapping is page aligned and zero filled, and only takes memory as buffers are written
+	pool->mem = mmap(NULL, pool->mem_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pool->mem == MAP_FAILED) {
+		fprintf(stderr, "myserver ~ init_pkt_pool(): failed to map %u buffers: %s\n", count, strerror(errno));
+		free(pool);
+		return NULL;
+	}
+
+	pool->bufs = malloc(count * sizeof(struct pkt_buf));
+	if (pool->bufs == NULL) {
+		fprintf(stderr, "myserver ~ init_pkt_pool(): failed to allocate %u buffer descriptors.\n", count);
+		munmap(pool->mem, pool->mem_sz);
+		free(pool);
+		return NULL;
+	}
+
+	// lowest buffers are handed out first, so a lightly loaded worker keeps touching the same few
+	pool->free_head = NULL;
+	for (u_int32_t i = count; i > 0; i--) {
+		struct pkt_buf *buf = &pool->bufs[i - 1];
+
+		buf->data = pool->mem + (size_t)(i - 1) * pool->stride + page;
+		buf->refs = 0;
+		buf->next_free = pool->free_head;
+		pool->free_head = buf;
+	}
+
+	pool->free_count = count;
+
+	return pool;
+}
+
+// unmap every buffer and free the pool itself
+void free_pkt_pool(struct pkt_pool **pool) {
+	munmap((*pool)->mem, (*pool)->mem_sz);
+	free((*pool)->bufs);
+	free(*pool);
+
+	*pool = NULL;
+}
+
+// take buffer off the free list with one ref
+// return buffer ptr, NULL if every buffer is in use
+struct pkt_buf *pkt_pool_get(struct pkt_pool *pool) {
+	struct pkt_buf *buf = pool->free_head;
+	if (buf == NULL) return NULL;
+
+	pool->free_head = buf->next_free;
+	pool->free_count --;
+
+	buf->next_free = NULL;
+	buf->refs = 1;
+
+	return buf;
+}
+
+// take another ref to buf for a payload kept in it, only while a free buffer is left to replace it in its recv slot
+// return true if the ref was taken, false if the payload has to be copied out instead
+bool pkt_pool_pin(struct pkt_pool *pool, struct pkt_buf *buf) {
+	// a buffer already pinned has its replacement spoken for
+	if (buf->refs == 1 && pool->free_count == 0) return false;
+
+	buf->refs ++;
+
+	return true;
+}
+
+// drop one ref to buf, it goes back on the free list once nothing refers to it
+void pkt_pool_put(struct pkt_pool *pool, struct pkt_buf *buf) {
+	if (--buf->refs > 0) return;
+
+	buf->next_free = pool->free_head;
+	pool->free_head = buf;
+	pool->free_count ++;
+}
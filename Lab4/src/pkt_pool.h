@@ -0,0 +1,47 @@
+#ifndef PKT_POOL_INCLUDE
+#define PKT_POOL_INCLUDE
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+#define PKT_POOL_DATA_SIZE 65536									// bytes after each buffer's data ptr, fits any datagram past its header
+
+// one pooled receive buffer, a page of headroom before data takes the header of the pkt received into it
+// refs counts its recv slot and every batched pkt whose payload still points into it
+struct pkt_buf {
+	char *data;				// page aligned
+	u_int32_t refs;
+	struct pkt_buf *next_free;
+};
+
+// fixed set of page aligned receive buffers owned by one server worker, mapped once and recycled
+// pages are only backed once touched, so a buffer pinned by one small payload costs a couple of pages
+struct pkt_pool {
+	char *mem;
+	size_t mem_sz;
+	size_t stride;			// headroom page plus PKT_POOL_DATA_SIZE rounded up to whole pages
+	struct pkt_buf *bufs;
+	struct pkt_buf *free_head;
+	u_int32_t count;
+	u_int32_t free_count;
+};
+
+// map count buffers and put them all on the free list
+// return pointer to pkt pool on success, NULL on error
+struct pkt_pool *init_pkt_pool(u_int32_t count);
+
+// unmap every buffer and free the pool itself
+void free_pkt_pool(struct pkt_pool **pool);
+
+// take buffer off the free list with one ref
+// return buffer ptr, NULL if every buffer is in use
+struct pkt_buf *pkt_pool_get(struct pkt_pool *pool);
+
+// take another ref to buf for a payload kept in it, only while a free buffer is left to replace it in its recv slot
+// return true if the ref was taken, false if the payload has to be copied out instead
+bool pkt_pool_pin(struct pkt_pool *pool, struct pkt_buf *buf);
+
+// drop one ref to buf, it goes back on the free list once nothing refers to it
+void pkt_pool_put(struct pkt_pool *pool, struct pkt_buf *buf);
+
+#endif
@@ -10,16 +10,57 @@
 #define SN_BYTES 4													// num bytes for sequence number
 #define CID_BYTES 4													// num bytes for client ID
 #define PYLD_SZ_BYTES 4												// num bytes for payload size
+#define FLAGS_BYTES 1												// num bytes for data packet flags
+#define DATA_OFF_BYTES 8											// num bytes for the offset of a data packet's payload in the client's stream
+#define CRC_BYTES 4													// num bytes for the crc32c of a data packet, covering its header and payload
+#define DIGEST_BYTES 4												// num bytes for the crc32c of a client's range of infile, and of that range of the finished outfile, exchanged at termination
 #define WINSZ_BYTES 4												// num bytes for window size
-#define DATA_HEADER_SIZE OPCODE_BYTES + CID_BYTES + SN_BYTES + PYLD_SZ_BYTES	// header size for data packet
-#define WR_HEADER_SIZE OPCODE_BYTES + WINSZ_BYTES
-#define ACK_HEADER_SIZE OPCODE_BYTES + SN_BYTES
+#define DATA_CRC_OFFSET (OPCODE_BYTES + CID_BYTES + SN_BYTES + PYLD_SZ_BYTES + FLAGS_BYTES + DATA_OFF_BYTES)	// crc is the last field of the data header, it covers every byte before and after it
+#define DATA_HEADER_SIZE (DATA_CRC_OFFSET + CRC_BYTES)				// header size for data packet
+#define WR_HEADER_SIZE (OPCODE_BYTES + WINSZ_BYTES)
+#define RANGE_TAG_BYTES 4											// num bytes for the tag shared by every stream of one transfer
+#define RANGE_OFF_BYTES 8											// num bytes for the outfile offset of a stream's range
+#define RANGE_FLAGS_BYTES 1											// num bytes for range flags
+#define FILE_SIZE_BYTES 8											// num bytes for the size of the whole file, 0 if the client didn't say
+#define WR_RANGE_SIZE (RANGE_TAG_BYTES + RANGE_OFF_BYTES + RANGE_FLAGS_BYTES + FILE_SIZE_BYTES)	// optional WR extension, follows the null terminated outfile path
+#define INFILE_MTIME_BYTES 8										// num bytes for infile's modification time in ns
+#define INFILE_CRC_BYTES 4											// num bytes for the crc32c of the first INFILE_PREFIX_BYTES of infile
+#define INFILE_PREFIX_BYTES 65536									// bytes at the start of infile whose crc identifies it, with its size and mtime
+#define WR_INFILE_ID_SIZE (INFILE_MTIME_BYTES + INFILE_CRC_BYTES)	// follows the range extension of a WR asking to resume, a manifest left by another infile isn't resumed
+#define RESUME_OFF_BYTES 8											// num bytes for the resume offset following a handshake ACK
+#define ACCEPTED_FLAGS_BYTES 1										// num bytes for the range flags the server honors, following the resume offset
+#define ACK_HEADER_SIZE (OPCODE_BYTES + SN_BYTES)
+#define SIG_IDX_BYTES 4												// num bytes for the index of a SIG pkt
+#define BASIS_SIZE_BYTES 8											// num bytes for the size of the server's old outfile
+#define BLOCK_SZ_BYTES 4											// num bytes for the signature block size
+#define SIG_REQ_SIZE (OPCODE_BYTES + CID_BYTES + SIG_IDX_BYTES)		// SIG request from the client
+#define SIG_HEADER_SIZE (SIG_REQ_SIZE + BASIS_SIZE_BYTES + BLOCK_SZ_BYTES)	// SIG response from the server, followed by block signatures
+#define SIG_ENTRY_SIZE 12											// weak checksum(4) and strong checksum(8) of one block
+#define HAVE_COUNT_BYTES 2											// num bytes for the number of chunk hashes a HAVE pkt asks about
+#define HAVE_HEADER_SIZE (SIG_REQ_SIZE + HAVE_COUNT_BYTES)			// HAVE pkt, shares the SIG request header, followed by chunk hashes from the client or a bitmap from the server
 #define MAX_HEADER_SIZE DATA_HEADER_SIZE
-#define MAX_SRVR_RES_SIZE OPCODE_BYTES + CID_BYTES								// max length of a packet sent from the server
+#define SACK_BITMAP_MAX_BYTES 1024									// SACK bitmap covers at most this many * 8 pkts past the ACK sn
+#define MAX_SRVR_RES_SIZE (ACK_HEADER_SIZE + SACK_BITMAP_MAX_BYTES)				// max length of a packet sent from the server
+#define SIG_MAX_ENTRIES ((MAX_SRVR_RES_SIZE - SIG_HEADER_SIZE) / SIG_ENTRY_SIZE)	// block signatures per SIG pkt
+#define HAVE_MAX_HASHES ((MAX_SRVR_RES_SIZE - HAVE_HEADER_SIZE) * 8)	// chunk hashes per HAVE pkt, so the answering bitmap fits a server response
+
+#define DATA_FLAG_ACK_REQ 0x01										// last pkt of a burst, server acks as soon as it arrives
+#define DATA_FLAG_COMPRESSED 0x02									// payload is an LZ4 block, payload size is its compressed size
+#define DATA_FLAG_DIGEST 0x04										// last pkt, the client's digest of its range of infile follows the header
+
+#define RANGE_FLAG_LAST 0x01										// range ends at the end of the file, server truncates the outfile there
+#define RANGE_FLAG_RESUME 0x02										// pick up after the bytes of the range the server already has on disk
+#define RANGE_FLAG_DELTA 0x04										// DATA carries a delta against the server's old outfile instead of the file itself
+#define RANGE_FLAG_COMPRESS 0x08									// client may compress DATA payloads, only used once the handshake ACK accepts it
+#define RANGE_FLAG_DEDUP 0x10										// DATA carries a delta against the server's chunk store, asked about with HAVE pkts
+#define MAX_RANGE_STREAMS 16										// max concurrent streams of one transfer
 
 enum OPCODES {
 				OP_WR = 1,		// write request
 				OP_ACK = 2,		// acknowledgment
 				OP_DATA = 3,	// data included
-				OP_BUSY = 4	// error
+				OP_BUSY = 4,	// error
+				OP_SACK = 5,	// selective ack, ACK followed by bitmap, bit i (byte i / 8, mask 1 << i % 8) set if pkt sn + 1 + i was received
+				OP_SIG = 6,		// block signatures of the server's old outfile, requested by index during a delta handshake
+				OP_HAVE = 7		// which of a run of chunk hashes the server's chunk store holds, asked during a dedup handshake
 			};
@@ -0,0 +1,90 @@
+#include <string.h>
+
+#include "sha256.h"
+
+// first 32 bits of the fractional parts of the cube roots of the first 64 primes
+const u_int32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// rotate x right by r bits
+u_int32_t rotr32(u_int32_t x, int r) {
+	return (x >> r) | (x << (32 - r));
+}
+
+// run the compression function over one 64 byte block, updating state
+void sha256_block(u_int32_t *state, const u_int8_t *block) {
+	u_int32_t w[64];
+
+	// words are big endian whatever the host's byte order
+	for (int i = 0; i < 16; i++) {
+		w[i] = ((u_int32_t)block[4 * i] << 24) | ((u_int32_t)block[4 * i + 1] << 16) | ((u_int32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+	}
+
+	for (int i = 16; i < 64; i++) {
+		u_int32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		u_int32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	u_int32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	u_int32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for (int i = 0; i < 64; i++) {
+		u_int32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		u_int32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+// SHA-256 of len bytes at buf, put in digest
+void sha256(const void *buf, size_t len, u_int8_t *digest) {
+	// first 32 bits of the fractional parts of the square roots of the first 8 primes
+	u_int32_t state[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	const u_int8_t *in = buf;
+	size_t left = len;
+
+	for (; left >= SHA256_BLOCK; left -= SHA256_BLOCK, in += SHA256_BLOCK) sha256_block(state, in);
+
+	// a 1 bit after the message, then zeros up to the bit length in the last 8 bytes, which can spill into a second block
+	u_int8_t tail[2 * SHA256_BLOCK] = { 0 };
+	memcpy(tail, in, left);
+	tail[left] = 0x80;
+
+	size_t tail_len = left + 9 <= SHA256_BLOCK ? SHA256_BLOCK : 2 * SHA256_BLOCK;
+	u_int64_t bits = (u_int64_t)len * 8;
+	for (int i = 0; i < 8; i++) tail[tail_len - 1 - i] = (u_int8_t)(bits >> (8 * i));
+
+	for (size_t off = 0; off < tail_len; off += SHA256_BLOCK) sha256_block(state, tail + off);
+
+	for (int i = 0; i < 8; i++) {
+		digest[4 * i] = (u_int8_t)(state[i] >> 24);
+		digest[4 * i + 1] = (u_int8_t)(state[i] >> 16);
+		digest[4 * i + 2] = (u_int8_t)(state[i] >> 8);
+		digest[4 * i + 3] = (u_int8_t)state[i];
+	}
+}
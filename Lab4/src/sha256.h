@@ -0,0 +1,19 @@
+#ifndef SHA256_INCLUDE
+#define SHA256_INCLUDE
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#define SHA256_SIZE 32												// bytes of a digest
+#define SHA256_BLOCK 64												// bytes the compression function takes at a time
+
+// rotate x right by r bits
+u_int32_t rotr32(u_int32_t x, int r);
+
+// run the compression function over one 64 byte block, updating state
+void sha256_block(u_int32_t *state, const u_int8_t *block);
+
+// SHA-256 of len bytes at buf, put in digest
+void sha256(const void *buf, size_t len, u_int8_t *digest);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "timer_wheel.h"
+
+// initialize empty wheel starting at now_ms
+void init_timer_wheel(struct timer_wheel *wheel, u_int64_t now_ms) {
+	memset(wheel, 0, sizeof(struct timer_wheel));
+
+	wheel->tick = now_ms / TIMER_TICK_MS;
+}
+
+// initialize timer that isn't pending, owned by data
+void init_timer(struct timer *timer, void *data) {
+	timer->expires = 0;
+	timer->prev = timer->next = NULL;
+	timer->level = timer->slot = 0;
+	timer->pending = false;
+	timer->data = data;
+}
+
+// head of the list timer is on
+struct timer **timer_list(struct timer_wheel *wheel, struct timer *timer) {
+	return timer->level == WHEEL_LEVELS ? &wheel->expiring : &wheel->slots[timer->level][timer->slot];
+}
+
+// push timer onto the front of slot at level
+void link_timer(struct timer_wheel *wheel, struct timer *timer, u_int32_t level, u_int32_t slot) {
+	timer->level = level;
+	timer->slot = slot;
+
+	struct timer **head = timer_list(wheel, timer);
+
+	timer->prev = NULL;
+	timer->next = *head;
+	if (*head != NULL) {
+		(*head)->prev = timer;
+	}
+	*head = timer;
+
+	if (level < WHEEL_LEVELS) {
+		wheel->occupied[level] |= 1ull << slot;
+	}
+}
+
+// take timer off whatever list it is on
+void unlink_timer(struct timer_wheel *wheel, struct timer *timer) {
+	struct timer **head = timer_list(wheel, timer);
+
+	if (timer->prev != NULL) {
+		timer->prev->next = timer->next;
+	} else {
+		*head = timer->next;
+	}
+
+	if (timer->next != NULL) {
+		timer->next->prev = timer->prev;
+	}
+
+	if (*head == NULL && timer->level < WHEEL_LEVELS) {
+		wheel->occupied[timer->level] &= ~(1ull << timer->slot);
+	}
+
+	timer->prev = timer->next = NULL;
+}
+
+// put timer in the level whose span covers its distance from the current tick
+void place_timer(struct timer_wheel *wheel, struct timer *timer) {
+	u_int64_t max_delta = (1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+	if (timer->expires < wheel->tick) {
+		timer->expires = wheel->tick;
+	} else if (timer->expires - wheel->tick > max_delta) {
+		timer->expires = wheel->tick + max_delta;
+	}
+
+	u_int64_t delta = timer->expires - wheel->tick;
+
+	u_int32_t level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= (1ull << (WHEEL_BITS * (level + 1)))) {
+		level ++;
+	}
+
+	link_timer(wheel, timer, level, (timer->expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+}
+
+// (re)arm timer to fire once now_ms >= expires_ms, timers in the past fire on the next tick
+void timer_add(struct timer_wheel *wheel, struct timer *timer, u_int64_t expires_ms) {
+	timer_del(wheel, timer);
+
+	// round up so a timer never fires early
+	timer->expires = (expires_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+	timer->pending = true;
+
+	place_timer(wheel, timer);
+
+	wheel->count ++;
+}
+
+// disarm timer, does nothing if it isn't pending
+void timer_del(struct timer_wheel *wheel, struct timer *timer) {
+	if (!timer->pending) return;
+
+	unlink_timer(wheel, timer);
+	timer->pending = false;
+
+	wheel->count --;
+}
+
+// move every timer in slot at level down to the levels below, now that the wheel has reached it
+void cascade_slot(struct timer_wheel *wheel, u_int32_t level, u_int32_t slot) {
+	struct timer *timer = wheel->slots[level][slot], *next;
+
+	wheel->slots[level][slot] = NULL;
+	wheel->occupied[level] &= ~(1ull << slot);
+
+	while (timer != NULL) {
+		next = timer->next;
+		place_timer(wheel, timer);
+		timer = next;
+	}
+}
+
+// fire every timer that expired by now_ms, in tick order
+// return 0 on success, -1 if fire returned an error
+int timer_wheel_advance(struct timer_wheel *wheel, u_int64_t now_ms, timer_fn fire, void *arg) {
+	u_int64_t target = now_ms / TIMER_TICK_MS;
+
+	while (wheel->tick <= target) {
+		// nothing left to fire, skip the empty ticks
+		if (wheel->count == 0) {
+			wheel->tick = target + 1;
+			break;
+		}
+
+		u_int64_t tick = wheel->tick;
+
+		// cascade each level whose slot boundary this tick crosses
+		for (u_int32_t level = 1; level < WHEEL_LEVELS; level++) {
+			if ((tick & ((1ull << (WHEEL_BITS * level)) - 1)) != 0) break;
+
+			cascade_slot(wheel, level, (tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+		}
+
+		// set this tick's timers aside first, so timers re-added while firing land on a later tick
+		u_int32_t slot = tick & (WHEEL_SLOTS - 1);
+		struct timer *timer = wheel->slots[0][slot];
+
+		wheel->slots[0][slot] = NULL;
+		wheel->occupied[0] &= ~(1ull << slot);
+
+		wheel->expiring = timer;
+		for (; timer != NULL; timer = timer->next) {
+			timer->level = WHEEL_LEVELS;
+		}
+
+		wheel->tick = tick + 1;
+
+		// fire may del any timer, including ones still on the expiring list
+		while ((timer = wheel->expiring) != NULL) {
+			timer_del(wheel, timer);
+
+			if (fire(timer, arg) < 0) {
+				fprintf(stderr, "myserver ~ timer_wheel_advance(): encountered error firing timer.\n");
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// ms from now_ms until the wheel next needs to be advanced, for use as a poll() timeout
+// return -1 if no timers are pending
+int timer_wheel_next_timeout(struct timer_wheel *wheel, u_int64_t now_ms) {
+	if (wheel->count == 0) return -1;
+
+	u_int32_t idx = wheel->tick & (WHEEL_SLOTS - 1);
+	u_int64_t ticks = ULLONG_MAX;
+
+	// higher levels need the wheel turned at the next level 0 wrap to cascade
+	for (u_int32_t level = 1; level < WHEEL_LEVELS; level++) {
+		if (wheel->occupied[level]) {
+			ticks = idx == 0 ? 0 : WHEEL_SLOTS - idx;
+			break;
+		}
+	}
+
+	// first occupied level 0 slot, counting from the current tick
+	u_int64_t occupied = wheel->occupied[0];
+	if (occupied) {
+		u_int64_t rotated = idx == 0 ? occupied : (occupied >> idx) | (occupied << (WHEEL_SLOTS - idx));
+		u_int64_t first = __builtin_ctzll(rotated);
+
+		if (first < ticks) ticks = first;
+	}
+
+	if (ticks == ULLONG_MAX) return -1;
+
+	u_int64_t expires_ms = (wheel->tick + ticks) * TIMER_TICK_MS;
+	if (expires_ms <= now_ms) return 0;
+
+	return expires_ms - now_ms > INT_MAX ? INT_MAX : (int)(expires_ms - now_ms);
+}
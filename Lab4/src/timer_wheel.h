@@ -0,0 +1,56 @@
+#ifndef TIMER_WHEEL_INCLUDE
+#define TIMER_WHEEL_INCLUDE
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+#define TIMER_TICK_MS 10											// resolution of every timer
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)								// slots per level, one bit each in the level's occupied mask
+#define WHEEL_LEVELS 4												// level n slot spans WHEEL_SLOTS^n ticks, ~46 hours in total
+
+// timer embedded in its owner, never allocated by the wheel
+struct timer {
+	u_int64_t expires;		// tick the timer fires on
+	struct timer *prev, *next;
+	u_int32_t level;		// WHEEL_LEVELS while on the expiring list
+	u_int32_t slot;
+	bool pending;
+	void *data;				// owner, handed back when the timer fires
+};
+
+// hierarchical timer wheel, add/del are O(1) and each tick only touches the timers due on it
+// level 0 slots hold the next WHEEL_SLOTS ticks, higher levels are cascaded down as the wheel turns
+struct timer_wheel {
+	u_int64_t tick;											// next tick to be processed
+	struct timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	u_int64_t occupied[WHEEL_LEVELS];						// bit per non empty slot
+	struct timer *expiring;									// timers of the tick being processed
+	u_int32_t count;
+};
+
+// called for each expired timer, the timer is no longer pending and may be re-added
+// return 0 on success, -1 on error
+typedef int (*timer_fn)(struct timer *timer, void *arg);
+
+// initialize empty wheel starting at now_ms
+void init_timer_wheel(struct timer_wheel *wheel, u_int64_t now_ms);
+
+// initialize timer that isn't pending, owned by data
+void init_timer(struct timer *timer, void *data);
+
+// (re)arm timer to fire once now_ms >= expires_ms, timers in the past fire on the next tick
+void timer_add(struct timer_wheel *wheel, struct timer *timer, u_int64_t expires_ms);
+
+// disarm timer, does nothing if it isn't pending
+void timer_del(struct timer_wheel *wheel, struct timer *timer);
+
+// fire every timer that expired by now_ms, in tick order
+// return 0 on success, -1 if fire returned an error
+int timer_wheel_advance(struct timer_wheel *wheel, u_int64_t now_ms, timer_fn fire, void *arg);
+
+// ms from now_ms until the wheel next needs to be advanced, for use as a poll() timeout
+// return -1 if no timers are pending
+int timer_wheel_next_timeout(struct timer_wheel *wheel, u_int64_t now_ms);
+
+#endif
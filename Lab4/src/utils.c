@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -6,13 +8,16 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <regex.h>
+#include <time.h>
 
 #include "utils.h"
 #include "protocol.h"
+#include "crc32c.h"
 
 void logerr(const char *err) {
 	fprintf(stderr, "%s\n", err);
@@ -34,7 +39,7 @@ u_int8_t *split_bytes(u_int32_t val) {
 // reuinite uint8_t[4] into uin32_t
 u_int32_t reunite_bytes(u_int8_t *bytes) {
 	u_int32_t res;
-	res = (u_int32_t) ((bytes[0] << 24) & 0xff000000) | (u_int32_t) ((bytes[1] << 16) & 0x00ff0000) | (u_int32_t) ((bytes[2] << 8) & 0x0000ff00) | (u_int32_t) (bytes[3] & 0x000000ff);
+	res = (u_int32_t) (((u_int32_t)bytes[0] << 24) & 0xff000000) | (u_int32_t) ((bytes[1] << 16) & 0x00ff0000) | (u_int32_t) ((bytes[2] << 8) & 0x0000ff00) | (u_int32_t) (bytes[3] & 0x000000ff);
 	return res; 
 }
 
@@ -63,7 +68,7 @@ int write_n_bytes(int sockfd, char *buf, int n) {
 	int bytes_written = 0;
 	int offset = 0;
 
-	while (offset < n && (bytes_written = write(sockfd, buf, n - offset)) > 0) {
+	while (offset < n && (bytes_written = write(sockfd, buf + offset, n - offset)) > 0) {
 		offset += bytes_written;
 	}
 
@@ -80,6 +85,115 @@ int write_n_bytes(int sockfd, char *buf, int n) {
 	return offset;
 }
 
+// read n bytes of fd at offset into buf, leaving the file offset alone, fewer only if the file ends first
+// returns bytes read on success, -1 on error
+int pread_n_bytes(int fd, char *buf, int n, off_t offset) {
+	int bytes_read = 0;
+	int done = 0;
+
+	while (done < n && (bytes_read = pread(fd, buf + done, n - done, offset + done)) > 0) {
+		done += bytes_read;
+	}
+
+	if (bytes_read < 0) {
+		fprintf(stderr, "pread_n_bytes(): pread() failed\n");
+		return -1;
+	}
+
+	return done;
+}
+
+// write n bytes from buf into fd at offset, leaving the file offset alone
+// returns bytes written on success, -1 on error
+int pwrite_n_bytes(int fd, char *buf, int n, off_t offset) {
+	int bytes_written = 0;
+	int written = 0;
+
+	while (written < n && (bytes_written = pwrite(fd, buf + written, n - written, offset + written)) > 0) {
+		written += bytes_written;
+	}
+
+	if (bytes_written < 0) {
+		fprintf(stderr, "pwrite_n_bytes(): pwrite() failed\n");
+		return -1;
+	}
+
+	if (written != n) {
+		fprintf(stderr, "pwrite_n_bytes(): bytes written does not equal n\n");
+		return -1;
+	}
+
+	return written;
+}
+
+// write iovcnt buffers of iov back to back into fd at offset, leaving the file offset alone
+// iov is advanced past whatever a short write took, so it can't be reused afterwards
+// returns bytes written on success, -1 on error
+ssize_t pwritev_n_bytes(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+	ssize_t written = 0;
+
+	while (iovcnt > 0) {
+		ssize_t bytes_written = pwritev(fd, iov, iovcnt, offset + written);
+		if (bytes_written < 0 && errno == EINTR) continue;
+
+		if (bytes_written <= 0) {
+			fprintf(stderr, "pwritev_n_bytes(): pwritev() failed\n");
+			return -1;
+		}
+
+		written += bytes_written;
+
+		// skip the buffers written in full, then trim the one the write stopped in
+		while (iovcnt > 0 && (size_t)bytes_written >= iov->iov_len) {
+			bytes_written -= iov->iov_len;
+			iov ++;
+			iovcnt --;
+		}
+
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + bytes_written;
+			iov->iov_len -= bytes_written;
+		}
+	}
+
+	return written;
+}
+
+// copy len bytes at in_off of in_fd to out_off of out_fd, in kernel where the filesystems allow it
+// return 0 on success, -1 on error
+int copy_fd_range(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len) {
+	loff_t in_pos = in_off;
+	loff_t out_pos = out_off;
+
+	// in kernel, or shared extents on filesystems that can reflink
+	while (len > 0) {
+		ssize_t copied = copy_file_range(in_fd, &in_pos, out_fd, &out_pos, len, 0);
+		if (copied <= 0) break;
+
+		len -= copied;
+	}
+
+	if (len == 0) return 0;
+
+	// filesystems that can't copy in kernel get a plain read and write
+	char buf[65536];
+
+	while (len > 0) {
+		size_t n = len < sizeof(buf) ? len : sizeof(buf);
+
+		if (pread(in_fd, buf, n, in_pos) != (ssize_t)n || pwrite_n_bytes(out_fd, buf, n, out_pos) < 0) {
+			fprintf(stderr, "utils ~ copy_fd_range(): encountered error copying %zu bytes: %s\n", n, strerror(errno));
+			return -1;
+		}
+
+		in_pos += n;
+		out_pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
 // continually read bytes from infd and write them to outfd, until n bytes have been passed
 // return 0 on success, -1 for error
 int pass_n_bytes(int infd, int outfd, int n) {
@@ -116,32 +230,6 @@ int pass_n_bytes(int infd, int outfd, int n) {
 	return 0;
 }
 
-int shift_file_contents(int fd, off_t start_idx, int amount) {
-	off_t prev_seek = lseek(fd, 0, SEEK_CUR);
-	
-	off_t begin = lseek(fd, 0, SEEK_END);
-
-	char buf[amount];
-
-	while (begin > start_idx) {
-		begin = lseek(fd, begin - amount, SEEK_SET);
-
-		if (read_n_bytes(fd, buf, amount) < 0) {
-			fprintf(stderr, "shift_file_contents(): read_n_bytes() failed.\n");
-			return -1;
-		}
-
-		if (write_n_bytes(fd, buf, amount) < 0) {
-			fprintf(stderr, "shift_file_contents(): write_n_bytes failed.\n");
-			return -1;
-		}
-	}
-
-	lseek(fd, prev_seek, SEEK_SET);
-
-	return 0;
-}
-
 // initialize socket with ip address and port, and return the file descriptor for the socket
 // returns -1 on failure
 int init_socket(struct sockaddr_in *sockaddr, const char *ip_addr, int port, int domain, int type, int protocol, bool do_bind) {
@@ -219,6 +307,90 @@ int assign_wr_winsz(char *pkt_buf, u_int32_t winsz) {
 	return 0;
 }
 
+// assign client id and index to header bytes of SIG pkt_buf, the whole of a SIG request
+// return 0 on success, -1 on error
+int assign_sig_req(char *pkt_buf, u_int32_t client_id, u_int32_t idx) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_sig_req(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	// client id goes right after opcode (1), index after client id (5)
+	u_int32_t vals[2] = { client_id, idx };
+	for (int i = 0; i < 2; i++) {
+		u_int8_t *bytes = split_bytes(vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_sig_req(): something went wrong when splitting bytes of SIG header.\n");
+			return -1;
+		}
+
+		memcpy(pkt_buf + OPCODE_BYTES + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	return 0;
+}
+
+// assign old outfile size and signature block size to header bytes of SIG response pkt_buf
+// return 0 on success, -1 on error
+int assign_sig_basis(char *pkt_buf, u_int64_t basis_size, u_int32_t block_sz) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_sig_basis(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	// basis size and block size follow the request part of the header
+	u_int32_t vals[3] = { (u_int32_t)(basis_size >> 32), (u_int32_t)basis_size, block_sz };
+	for (int i = 0; i < 3; i++) {
+		u_int8_t *bytes = split_bytes(vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_sig_basis(): something went wrong when splitting bytes of SIG header.\n");
+			return -1;
+		}
+
+		memcpy(pkt_buf + SIG_REQ_SIZE + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	return 0;
+}
+
+// assign client id, index and hash count to header bytes of HAVE pkt_buf
+// return 0 on success, -1 on error
+int assign_have_req(char *pkt_buf, u_int32_t client_id, u_int32_t idx, u_int32_t count) {
+	if (assign_sig_req(pkt_buf, client_id, idx) < 0) {
+		fprintf(stderr, "utils ~ assign_have_req(): encountered error assigning request part of HAVE header.\n");
+		return -1;
+	}
+
+	// count follows the request part of the header
+	pkt_buf[SIG_REQ_SIZE] = (char)(count >> 8);
+	pkt_buf[SIG_REQ_SIZE + 1] = (char)count;
+
+	return 0;
+}
+
+// assign signature entry i after the header of SIG response pkt_buf
+// return 0 on success, -1 on error
+int assign_sig_entry(char *pkt_buf, u_int32_t i, u_int32_t weak, u_int64_t strong) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_sig_entry(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	u_int8_t *entry = (u_int8_t *)pkt_buf + SIG_HEADER_SIZE + i * SIG_ENTRY_SIZE;
+
+	u_int32_t vals[3] = { weak, (u_int32_t)(strong >> 32), (u_int32_t)strong };
+	for (int j = 0; j < 3; j++) {
+		entry[4 * j] = (u_int8_t)(vals[j] >> 24);
+		entry[4 * j + 1] = (u_int8_t)(vals[j] >> 16);
+		entry[4 * j + 2] = (u_int8_t)(vals[j] >> 8);
+		entry[4 * j + 3] = (u_int8_t)vals[j];
+	}
+
+	return 0;
+}
+
 // assign client_id to header bytes of pkt_buf
 // return 0 on success, -1 on error
 int assign_pkt_client_id(char *pkt_buf, u_int32_t client_id) {
@@ -323,6 +495,67 @@ int assign_pkt_pyld_sz(char *pkt_buf, u_int32_t pyld_sz) {
 	return 0;
 }
 
+// assign flags to header byte of pkt_buf
+// return 0 on success, -1 on error
+int assign_data_flags(char *pkt_buf, u_int8_t flags) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_data_flags(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	// flags go right after pyld_sz (13)
+	pkt_buf[13] = flags;
+
+	return 0;
+}
+
+// assign offset of the payload in the client's stream to header bytes of DATA pkt_buf
+// return 0 on success, -1 on error
+int assign_data_off(char *pkt_buf, u_int64_t off) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_data_off(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	// offset goes right after flags (14)
+	for (int i = 0; i < DATA_OFF_BYTES; i++) pkt_buf[14 + i] = (char)(off >> (56 - 8 * i));
+
+	return 0;
+}
+
+// assign crc to header bytes of DATA pkt_buf
+// return 0 on success, -1 on error
+int assign_data_crc(char *pkt_buf, u_int32_t crc) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_data_crc(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	// crc goes right after offset (22)
+	for (int i = 0; i < CRC_BYTES; i++) pkt_buf[DATA_CRC_OFFSET + i] = (char)(crc >> (24 - 8 * i));
+
+	return 0;
+}
+
+// assign range digest after the header of final DATA pkt_buf, or of termination ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_digest(char *pkt_buf, size_t header_sz, u_int32_t digest) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_digest(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	for (int i = 0; i < DIGEST_BYTES; i++) pkt_buf[header_sz + i] = (char)(digest >> (24 - 8 * i));
+
+	return 0;
+}
+
+// returns crc32c of DATA pkt_buf, the bytes following the header, whose crc32c is body_crc, then every header byte but the crc itself
+// body goes first so a payload's own crc, which resends reuse, is only computed once
+u_int32_t data_pkt_crc(char *pkt_buf, u_int32_t body_crc) {
+	return crc32c(body_crc, pkt_buf, DATA_CRC_OFFSET);
+}
+
 // returns opcode of pkt_buf, -1 on error
 int get_pkt_opcode(char *pkt_buf) {
 	if (pkt_buf == NULL) {
@@ -356,6 +589,156 @@ u_int32_t get_write_req_winsz(char *pkt_buf) {
 	}
 }
 
+// assign range extension after the null terminated outfile path of WR pkt_buf
+// tag 0 is a transfer that isn't split, its extension only says how big the file is
+// return 0 on success, -1 on error
+int assign_wr_range(char *pkt_buf, u_int32_t tag, u_int64_t offset, u_int8_t flags, u_int64_t file_size) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_wr_range(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	if (tag == 0 && (offset != 0 || flags != 0)) {
+		fprintf(stderr, "utils ~ assign_wr_range(): a WR without a range tag cannot have a range offset or flags.\n");
+		return -1;
+	}
+
+	char *range = pkt_buf + WR_HEADER_SIZE + strlen(pkt_buf + WR_HEADER_SIZE) + 1;
+
+	u_int32_t vals[3] = { tag, (u_int32_t)(offset >> 32), (u_int32_t)offset };
+	for (int i = 0; i < 3; i++) {
+		u_int8_t *bytes = split_bytes(vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_wr_range(): something went wrong when splitting bytes of range.\n");
+			return -1;
+		}
+
+		memcpy(range + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	range[RANGE_TAG_BYTES + RANGE_OFF_BYTES] = flags;
+
+	u_int32_t size_vals[2] = { (u_int32_t)(file_size >> 32), (u_int32_t)file_size };
+	for (int i = 0; i < 2; i++) {
+		u_int8_t *bytes = split_bytes(size_vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_wr_range(): something went wrong when splitting bytes of file size.\n");
+			return -1;
+		}
+
+		memcpy(range + RANGE_TAG_BYTES + RANGE_OFF_BYTES + RANGE_FLAGS_BYTES + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	return 0;
+}
+
+// assign infile id after the range extension of WR pkt_buf, sent when the range asks to resume
+// return 0 on success, -1 on error
+int assign_wr_infile_id(char *pkt_buf, u_int64_t mtime, u_int32_t prefix_crc) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_wr_infile_id(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	char *id = pkt_buf + WR_HEADER_SIZE + strlen(pkt_buf + WR_HEADER_SIZE) + 1 + WR_RANGE_SIZE;
+
+	u_int32_t vals[3] = { (u_int32_t)(mtime >> 32), (u_int32_t)mtime, prefix_crc };
+	for (int i = 0; i < 3; i++) {
+		u_int8_t *bytes = split_bytes(vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_wr_infile_id(): something went wrong when splitting bytes of infile id.\n");
+			return -1;
+		}
+
+		memcpy(id + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	return 0;
+}
+
+// assign resume offset after the header of handshake ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_ack_resume_off(char *pkt_buf, u_int64_t offset) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_ack_resume_off(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	u_int32_t vals[2] = { (u_int32_t)(offset >> 32), (u_int32_t)offset };
+	for (int i = 0; i < 2; i++) {
+		u_int8_t *bytes = split_bytes(vals[i]);
+		if (bytes == NULL) {
+			fprintf(stderr, "utils ~ assign_ack_resume_off(): something went wrong when splitting bytes of resume offset.\n");
+			return -1;
+		}
+
+		memcpy(pkt_buf + ACK_HEADER_SIZE + 4 * i, bytes, 4);
+		free(bytes);
+	}
+
+	return 0;
+}
+
+// assign range flags the server accepted after the resume offset of handshake ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_ack_accepted(char *pkt_buf, u_int8_t flags) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ assign_ack_accepted(): cannot pass NULL ptr to pkt_buf.\n");
+		return -1;
+	}
+
+	pkt_buf[ACK_HEADER_SIZE + RESUME_OFF_BYTES] = flags;
+
+	return 0;
+}
+
+// returns resume offset following the header of handshake ACK pkt_buf
+u_int64_t get_ack_resume_off(char *pkt_buf) {
+	u_int8_t *off = (u_int8_t *)pkt_buf + ACK_HEADER_SIZE;
+
+	return ((u_int64_t)reunite_bytes(off) << 32) | reunite_bytes(off + 4);
+}
+
+// returns range flags the server accepted, following the resume offset of handshake ACK pkt_buf
+u_int8_t get_ack_accepted(char *pkt_buf) {
+	return (u_int8_t)pkt_buf[ACK_HEADER_SIZE + RESUME_OFF_BYTES];
+}
+
+// get range extension of WR pkt_buf, a WR without one reads as tag 0 since the rest of the recv buffer is zeroed
+// return true if pkt_buf has a range, false otherwise
+bool get_wr_range(char *pkt_buf, u_int32_t *tag, u_int64_t *offset, u_int8_t *flags) {
+	if (pkt_buf == NULL || (int)pkt_buf[0] != OP_WR) {
+		fprintf(stderr, "utils ~ get_wr_range(): pkt_buf is not a WR pkt.\n");
+		return false;
+	}
+
+	u_int8_t *range = (u_int8_t *)pkt_buf + WR_HEADER_SIZE + strlen(pkt_buf + WR_HEADER_SIZE) + 1;
+
+	*tag = reunite_bytes(range);
+	*offset = ((u_int64_t)reunite_bytes(range + 4) << 32) | reunite_bytes(range + 8);
+	*flags = range[RANGE_TAG_BYTES + RANGE_OFF_BYTES];
+
+	return *tag != 0;
+}
+
+// returns file size advertised in the range extension of WR pkt_buf, 0 if the client didn't send one
+u_int64_t get_wr_file_size(char *pkt_buf) {
+	u_int8_t *size = (u_int8_t *)pkt_buf + WR_HEADER_SIZE + strlen(pkt_buf + WR_HEADER_SIZE) + 1 + RANGE_TAG_BYTES + RANGE_OFF_BYTES + RANGE_FLAGS_BYTES;
+
+	return ((u_int64_t)reunite_bytes(size) << 32) | reunite_bytes(size + 4);
+}
+
+// get infile id following the range extension of WR pkt_buf, both read as 0 if the client didn't send one
+void get_wr_infile_id(char *pkt_buf, u_int64_t *mtime, u_int32_t *prefix_crc) {
+	u_int8_t *id = (u_int8_t *)pkt_buf + WR_HEADER_SIZE + strlen(pkt_buf + WR_HEADER_SIZE) + 1 + WR_RANGE_SIZE;
+
+	*mtime = ((u_int64_t)reunite_bytes(id) << 32) | reunite_bytes(id + 4);
+	*prefix_crc = reunite_bytes(id + INFILE_MTIME_BYTES);
+}
+
 // returns client id of pkt_buf, 0 on error
 u_int32_t get_data_client_id(char *pkt_buf) {
 	if (pkt_buf == NULL) {
@@ -452,6 +835,113 @@ u_int32_t get_data_pyld_sz(char *pkt_buf) {
 	}
 }
 
+// returns flags of pkt_buf if data pkt, 0 on error and sets errno to 1
+u_int8_t get_data_flags(char *pkt_buf) {
+	if (pkt_buf == NULL) {
+		fprintf(stderr, "utils ~ get_data_flags(): cannot pass NULL ptr to pkt_buf.\n");
+		errno = 1;
+		return 0;
+	}
+
+	if ((int)pkt_buf[0] == OP_DATA) {
+		return (u_int8_t)pkt_buf[13];
+	} else {
+		fprintf(stderr, "utils ~ get_data_flags(): pkt_buf does not contain valid opcode to get flags.\n");
+		errno = 1;
+		return 0;
+	}
+}
+
+// returns offset of the payload of DATA pkt_buf in the client's stream
+u_int64_t get_data_off(char *pkt_buf) {
+	u_int8_t *off = (u_int8_t *)pkt_buf + 14;
+
+	return ((u_int64_t)reunite_bytes(off) << 32) | reunite_bytes(off + 4);
+}
+
+// returns crc of DATA pkt_buf
+u_int32_t get_data_crc(char *pkt_buf) {
+	return reunite_bytes((u_int8_t *)pkt_buf + DATA_CRC_OFFSET);
+}
+
+// continue digest with the crc32c of len bytes of fd from off, a file shorter than that is digested as far as it goes
+// return 0 on success, -1 on error
+int file_digest(int fd, off_t off, off_t len, u_int32_t *digest) {
+	char *buf = malloc(DIGEST_READ_SIZE);
+	if (buf == NULL) {
+		fprintf(stderr, "utils ~ file_digest(): failed to allocate read buffer.\n");
+		return -1;
+	}
+
+	int res = 0;
+	while (len > 0) {
+		int bytes_read = pread_n_bytes(fd, buf, len < DIGEST_READ_SIZE ? (int)len : DIGEST_READ_SIZE, off);
+		if (bytes_read < 0) {
+			res = -1;
+			break;
+		}
+
+		if (bytes_read == 0) break;
+
+		*digest = crc32c(*digest, buf, bytes_read);
+		off += bytes_read;
+		len -= bytes_read;
+	}
+
+	free(buf);
+
+	return res;
+}
+
+// returns range digest following header_sz bytes of header in pkt_buf
+u_int32_t get_digest(char *pkt_buf, size_t header_sz) {
+	return reunite_bytes((u_int8_t *)pkt_buf + header_sz);
+}
+
+// returns client id of SIG or HAVE pkt_buf, 0 on error
+u_int32_t get_sig_client_id(char *pkt_buf) {
+	if (pkt_buf == NULL || ((int)pkt_buf[0] != OP_SIG && (int)pkt_buf[0] != OP_HAVE)) {
+		fprintf(stderr, "utils ~ get_sig_client_id(): pkt_buf is not a SIG or HAVE pkt.\n");
+		return 0;
+	}
+
+	return reunite_bytes((u_int8_t *)pkt_buf + OPCODE_BYTES);
+}
+
+// returns index of SIG or HAVE pkt_buf, 0 on error and sets errno to 1
+u_int32_t get_sig_idx(char *pkt_buf) {
+	if (pkt_buf == NULL || ((int)pkt_buf[0] != OP_SIG && (int)pkt_buf[0] != OP_HAVE)) {
+		fprintf(stderr, "utils ~ get_sig_idx(): pkt_buf is not a SIG or HAVE pkt.\n");
+		errno = 1;
+		return 0;
+	}
+
+	return reunite_bytes((u_int8_t *)pkt_buf + OPCODE_BYTES + CID_BYTES);
+}
+
+// returns number of chunk hashes HAVE pkt_buf asks about
+u_int32_t get_have_count(char *pkt_buf) {
+	u_int8_t *count = (u_int8_t *)pkt_buf + SIG_REQ_SIZE;
+
+	return (count[0] << 8) | count[1];
+}
+
+// get old outfile size and signature block size from SIG response pkt_buf
+void get_sig_basis(char *pkt_buf, u_int64_t *basis_size, u_int32_t *block_sz) {
+	u_int8_t *basis = (u_int8_t *)pkt_buf + SIG_REQ_SIZE;
+
+	*basis_size = ((u_int64_t)reunite_bytes(basis) << 32) | reunite_bytes(basis + 4);
+	*block_sz = reunite_bytes(basis + BASIS_SIZE_BYTES);
+}
+
+// get signature entry i following the header of SIG response pkt_buf
+void get_sig_entry(char *pkt_buf, u_int32_t i, u_int32_t *weak, u_int64_t *strong) {
+	u_int8_t *entry = (u_int8_t *)pkt_buf + SIG_HEADER_SIZE + i * SIG_ENTRY_SIZE;
+
+	*weak = reunite_bytes(entry);
+	*strong = ((u_int64_t)reunite_bytes(entry + 4) << 32) | reunite_bytes(entry + 8);
+}
+
 // returns pkt sn of pkt_buf, 0 on error
 // can be used to get client ID from server, server assigns pkt_sn field to client ID when accepting handshake
 u_int32_t get_ack_sn(char *pkt_buf) {
@@ -462,7 +952,7 @@ u_int32_t get_ack_sn(char *pkt_buf) {
 
 	// pkt_sn occurs right after opcode for ack, not at all for error
 	// check opcode for ack, otherwise return 0
-	if ((int)pkt_buf[0] == OP_ACK) {
+	if ((int)pkt_buf[0] == OP_ACK || (int)pkt_buf[0] == OP_SACK) {
 		u_int8_t bytes[4];
 		bytes[0] = pkt_buf[1];
 		bytes[1] = pkt_buf[2];
@@ -534,3 +1024,16 @@ bool sockaddrs_eq(struct sockaddr sockaddr1, struct sockaddr sockaddr2) {
 
 	return true;
 }
+
+// milliseconds on the monotonic clock, for timers
+u_int64_t monotonic_ms(void) {
+	return monotonic_us() / 1000;
+}
+
+// microseconds on the monotonic clock, for rtt samples
+u_int64_t monotonic_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
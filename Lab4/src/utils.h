@@ -3,7 +3,10 @@
 
 #include <stdbool.h>
 
+#define DIGEST_READ_SIZE (1 << 20)									// bytes file_digest() reads at a time
+
 struct sockaddr_in;
+struct iovec;
 
 void logerr(const char *);
 
@@ -22,12 +25,27 @@ int read_n_bytes(int fd, char *buf, int n);
 // returns bytes written on success, -1 on error
 int write_n_bytes(int sockfd, char *buf, int n);
 
+// read n bytes of fd at offset into buf, leaving the file offset alone, fewer only if the file ends first
+// returns bytes read on success, -1 on error
+int pread_n_bytes(int fd, char *buf, int n, off_t offset);
+
+// write n bytes from buf into fd at offset, leaving the file offset alone
+// returns bytes written on success, -1 on error
+int pwrite_n_bytes(int fd, char *buf, int n, off_t offset);
+
+// write iovcnt buffers of iov back to back into fd at offset, leaving the file offset alone
+// iov is advanced past whatever a short write took, so it can't be reused afterwards
+// returns bytes written on success, -1 on error
+ssize_t pwritev_n_bytes(int fd, struct iovec *iov, int iovcnt, off_t offset);
+
+// copy len bytes at in_off of in_fd to out_off of out_fd, in kernel where the filesystems allow it
+// return 0 on success, -1 on error
+int copy_fd_range(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len);
+
 // continually read bytes from infd and write them to outfd, until n bytes have been passed
 // return 0 on success, -1 for error
 int pass_n_bytes(int infd, int outfd, int n);
 
-int shift_file_contents(int fd, off_t start_idx, int amount);
-
 // initialize socket with ip address and port, and return the file descriptor for the socket
 // returns -1 on failure
 int init_socket(struct sockaddr_in *sockaddr, const char *ip_addr, int port, int domain, int type, int protocol, bool do_bind);
@@ -42,6 +60,39 @@ int assign_pkt_opcode(char *pkt_buf, int opcode);
 // return 0 on success, -1 on error
 int assign_wr_winsz(char *pkt_buf, u_int32_t winsz);
 
+// assign range extension after the null terminated outfile path of WR pkt_buf
+// tag 0 is a transfer that isn't split, its extension only says how big the file is
+// return 0 on success, -1 on error
+int assign_wr_range(char *pkt_buf, u_int32_t tag, u_int64_t offset, u_int8_t flags, u_int64_t file_size);
+
+// assign infile id after the range extension of WR pkt_buf, sent when the range asks to resume
+// return 0 on success, -1 on error
+int assign_wr_infile_id(char *pkt_buf, u_int64_t mtime, u_int32_t prefix_crc);
+
+// assign resume offset after the header of handshake ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_ack_resume_off(char *pkt_buf, u_int64_t offset);
+
+// assign range flags the server accepted after the resume offset of handshake ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_ack_accepted(char *pkt_buf, u_int8_t flags);
+
+// assign client id and index to header bytes of SIG pkt_buf, the whole of a SIG request
+// return 0 on success, -1 on error
+int assign_sig_req(char *pkt_buf, u_int32_t client_id, u_int32_t idx);
+
+// assign old outfile size and signature block size to header bytes of SIG response pkt_buf
+// return 0 on success, -1 on error
+int assign_sig_basis(char *pkt_buf, u_int64_t basis_size, u_int32_t block_sz);
+
+// assign signature entry i after the header of SIG response pkt_buf
+// return 0 on success, -1 on error
+int assign_sig_entry(char *pkt_buf, u_int32_t i, u_int32_t weak, u_int64_t strong);
+
+// assign client id, index and hash count to header bytes of HAVE pkt_buf
+// return 0 on success, -1 on error
+int assign_have_req(char *pkt_buf, u_int32_t client_id, u_int32_t idx, u_int32_t count);
+
 // assign client_id to header bytes of pkt_buf
 // return 0 on success, -1 on error
 int assign_pkt_client_id(char *pkt_buf, u_int32_t client_id);
@@ -58,12 +109,42 @@ int assign_pkt_sn(char *pkt_buf, u_int32_t pkt_sn);
 // return 0 on success, -1 on error
 int assign_pkt_pyld_sz(char *pkt_buf, u_int32_t pyld_sz);
 
+// assign flags to header byte of pkt_buf
+// return 0 on success, -1 on error
+int assign_data_flags(char *pkt_buf, u_int8_t flags);
+
+// assign offset of the payload in the client's stream to header bytes of DATA pkt_buf
+// return 0 on success, -1 on error
+int assign_data_off(char *pkt_buf, u_int64_t off);
+
+// assign crc to header bytes of DATA pkt_buf
+// return 0 on success, -1 on error
+int assign_data_crc(char *pkt_buf, u_int32_t crc);
+
+// assign range digest after the header of final DATA pkt_buf, or of termination ACK pkt_buf
+// return 0 on success, -1 on error
+int assign_digest(char *pkt_buf, size_t header_sz, u_int32_t digest);
+
+// returns crc32c of DATA pkt_buf, the bytes following the header, whose crc32c is body_crc, then every header byte but the crc itself
+// body goes first so a payload's own crc, which resends reuse, is only computed once
+u_int32_t data_pkt_crc(char *pkt_buf, u_int32_t body_crc);
+
 // returns opcode of pkt_buf, -1 on error
 int get_pkt_opcode(char *pkt_buf);
 
 // returns window size of pkt_buf, 0 on error
 u_int32_t get_write_req_winsz(char *pkt_buf);
 
+// get range extension of WR pkt_buf, a WR without one reads as tag 0 since the rest of the recv buffer is zeroed
+// return true if pkt_buf has a range, false otherwise
+bool get_wr_range(char *pkt_buf, u_int32_t *tag, u_int64_t *offset, u_int8_t *flags);
+
+// returns file size advertised in the range extension of WR pkt_buf, 0 if the client didn't send one
+u_int64_t get_wr_file_size(char *pkt_buf);
+
+// get infile id following the range extension of WR pkt_buf, both read as 0 if the client didn't send one
+void get_wr_infile_id(char *pkt_buf, u_int64_t *mtime, u_int32_t *prefix_crc);
+
 // returns sn of pkt_buf, 0 on error
 u_int32_t get_wr_sn(char *pkt_buf);
 
@@ -76,7 +157,44 @@ u_int32_t get_data_sn(char *pkt_buf);
 // returns payload size of pkt_buf if data pkt, 0xffffffff on error
 u_int32_t get_data_pyld_sz(char *pkt_buf);
 
-// returns pkt sn of pkt_buf if ack pkt, 0 on error and sets errno to 1
+// returns flags of pkt_buf if data pkt, 0 on error and sets errno to 1
+u_int8_t get_data_flags(char *pkt_buf);
+
+// returns resume offset following the header of handshake ACK pkt_buf
+u_int64_t get_ack_resume_off(char *pkt_buf);
+
+// returns range flags the server accepted, following the resume offset of handshake ACK pkt_buf
+u_int8_t get_ack_accepted(char *pkt_buf);
+
+// returns offset of the payload of DATA pkt_buf in the client's stream
+u_int64_t get_data_off(char *pkt_buf);
+
+// returns crc of DATA pkt_buf
+u_int32_t get_data_crc(char *pkt_buf);
+
+// continue digest with the crc32c of len bytes of fd from off, a file shorter than that is digested as far as it goes
+// return 0 on success, -1 on error
+int file_digest(int fd, off_t off, off_t len, u_int32_t *digest);
+
+// returns range digest following header_sz bytes of header in pkt_buf
+u_int32_t get_digest(char *pkt_buf, size_t header_sz);
+
+// returns client id of SIG or HAVE pkt_buf, 0 on error
+u_int32_t get_sig_client_id(char *pkt_buf);
+
+// returns index of SIG or HAVE pkt_buf, 0 on error and sets errno to 1
+u_int32_t get_sig_idx(char *pkt_buf);
+
+// returns number of chunk hashes HAVE pkt_buf asks about
+u_int32_t get_have_count(char *pkt_buf);
+
+// get old outfile size and signature block size from SIG response pkt_buf
+void get_sig_basis(char *pkt_buf, u_int64_t *basis_size, u_int32_t *block_sz);
+
+// get signature entry i following the header of SIG response pkt_buf
+void get_sig_entry(char *pkt_buf, u_int32_t i, u_int32_t *weak, u_int64_t *strong);
+
+// returns pkt sn of pkt_buf if ack or sack pkt, 0 on error and sets errno to 1
 // can be used to get client ID from server, server assigns pkt_sn field to client ID when accepting handshake
 u_int32_t get_ack_sn(char *pkt_buf);
 
@@ -86,6 +204,12 @@ int create_file_directory(const char *file_path);
 
 bool sockaddrs_eq(struct sockaddr sockaddr1, struct sockaddr sockaddr2);
 
+// milliseconds on the monotonic clock, for timers
+u_int64_t monotonic_ms(void);
+
+// microseconds on the monotonic clock, for rtt samples
+u_int64_t monotonic_us(void);
+
 
 
 #endif
@@ -0,0 +1,49 @@
+#!/usr/bin/env bash
+
+echo "
+!!! RUNNING BENCH_COMPRESS !!!
+"
+
+# sends a log-like text file and a random file with and without -z, then prints
+# the wall times next to the client's compression summary, whose last column is
+# the link speed below which compressing beats sending raw bytes
+
+size=${1:-20000000}
+mss=${2:-1400}
+winsz=${3:-64}
+port=9090
+
+mkdir -p out/bench
+
+for i in $(seq 1 $((size / 60 + 1))); do
+	echo "2026-10-18T02:19:$((i % 60))Z INFO worker[$((i % 8))] request $i served in $((i * 7 % 1000)) ms"
+done | head -c $size > out/bench/text.in
+head -c $size /dev/urandom > out/bench/random.in
+
+echo "127.0.0.1 $port" > out/bench/servaddr.conf
+
+./bin/myserver $port 0 out/bench/server/ > /dev/null 2>&1 &
+server_pid=$!
+sleep 0.3
+
+for file in text random; do
+	for flags in "" "-z"; do
+		start=$(date +%s%N)
+		./bin/myclient $flags 1 out/bench/servaddr.conf $mss $winsz out/bench/$file.in $file.out > /dev/null 2> out/bench/client.err
+		end=$(date +%s%N)
+
+		if ! cmp -s out/bench/$file.in out/bench/server/$file.out; then
+			echo "~~~~~~~~~~~~~~~~~~~~~~~
+	BENCH FAILURE: $file${flags:+ $flags} outfile differs
+~~~~~~~~~~~~~~~~~~~~~~~"
+		fi
+
+		printf "%-7s %-3s %6d ms\n" $file "$flags" $(((end - start) / 1000000))
+		grep "^Compression" out/bench/client.err
+	done
+done
+
+kill -9 $server_pid
+wait $server_pid &>/dev/null
+
+rm -rf out/bench
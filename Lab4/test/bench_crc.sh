@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+
+echo "
+!!! RUNNING BENCH_CRC !!!
+"
+
+# sends a file over loopback, where the link is as fast as it gets, and prints
+# the client's checksum summary: crc32c throughput and the share of the
+# transfer's wall time spent computing pkt crcs and the payload digest
+
+size=${1:-50000000}
+mss=${2:-1400}
+winsz=${3:-64}
+port=9091
+
+mkdir -p out/bench
+head -c $size /dev/urandom > out/bench/crc.in
+
+echo "127.0.0.1 $port" > out/bench/servaddr.conf
+
+./bin/myserver $port 0 out/bench/server/ > /dev/null 2>&1 &
+server_pid=$!
+sleep 0.3
+
+for flags in "" "-m"; do
+	./bin/myclient $flags 1 out/bench/servaddr.conf $mss $winsz out/bench/crc.in crc.out > /dev/null 2> out/bench/client.err
+
+	if ! cmp -s out/bench/crc.in out/bench/server/crc.out; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	BENCH FAILURE: crc${flags:+ $flags} outfile differs
+~~~~~~~~~~~~~~~~~~~~~~~"
+	fi
+
+	printf "%-3s " "$flags"
+	grep "^Checksum" out/bench/client.err
+done
+
+kill -9 $server_pid
+wait $server_pid &>/dev/null
+
+rm -rf out/bench
@@ -15,3 +15,6 @@ make
 ./test/test_high_drops.sh
 ./test/test_multiple_clients.sh
 ./test/test_server_crash.sh
+./test/test_retransmit.sh
+./test/test_resume.sh
+./test/test_roundtrip.sh
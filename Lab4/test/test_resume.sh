@@ -0,0 +1,111 @@
+#!/usr/bin/env bash
+
+echo "
+!!! RUNNING TEST_RESUME !!!
+"
+
+# kills the server once it has checkpointed part of a -r transfer, then
+# restarts it and reruns the client, which should pick up after the checkpoint
+# unless something changed in between
+#   none     nothing changed, the transfer resumes
+#   outfile  outfile is overwritten with as many other bytes, the transfer starts over
+#   infile   infile is overwritten with as many other bytes and keeps its mtime, the transfer starts over
+
+port=9090
+dir=out/resume
+
+failed=0
+
+for change in none outfile infile; do
+	mkdir -p $dir
+
+	head -c 64000000 /dev/urandom > $dir/in.bin
+	echo "127.0.0.1 $port" > $dir/servaddr.conf
+
+	./bin/myserver $port 0 $dir/server/ > /dev/null 2>&1 &
+	server_pid=$!
+	sleep 0.3
+
+	./bin/myclient -r 1 $dir/servaddr.conf 1400 16 $dir/in.bin out.bin > /dev/null 2>&1 &
+	client_pid=$!
+
+	# manifest is written every 8 MB, give up after 30 s
+	# a writer thread fills it in some time after the worker creates it
+	for i in $(seq 1 3000); do
+		if [ -s $dir/server/out.bin.resume-0 ]; then
+			break
+		fi
+		sleep 0.01
+	done
+
+	# the client would only give up after several rtos, it's the server's checkpoint that matters
+	kill -9 $server_pid $client_pid
+	wait $server_pid &>/dev/null
+	wait $client_pid &>/dev/null
+
+	if ! ls $dir/server/out.bin.resume-* &>/dev/null; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $change, server never wrote a resume manifest
+~~~~~~~~~~~~~~~~~~~~~~~"
+		rm -rf $dir
+		failed=1
+		continue
+	fi
+
+	case $change in
+		outfile)
+			head -c $(stat -c %s $dir/server/out.bin) /dev/urandom > $dir/other.bin
+			cp $dir/other.bin $dir/server/out.bin
+			;;
+		infile)
+			head -c $(stat -c %s $dir/in.bin) /dev/urandom > $dir/other.bin
+			touch -r $dir/in.bin $dir/other.bin
+			mv $dir/other.bin $dir/in.bin
+			;;
+	esac
+
+	./bin/myserver $port 0 $dir/server/ > /dev/null 2> $dir/server.err &
+	server_pid=$!
+	sleep 0.3
+
+	./bin/myclient -r 1 $dir/servaddr.conf 1400 16 $dir/in.bin out.bin > /dev/null 2>&1
+	rc=$?
+
+	kill -9 $server_pid
+	wait $server_pid &>/dev/null
+
+	if [ $change == none ]; then
+		resumed="resuming after [1-9]"
+	else
+		resumed="resuming after 0 bytes"
+	fi
+
+	if [ $rc -ne 0 ]; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $change, resumed client exited with $rc
+~~~~~~~~~~~~~~~~~~~~~~~"
+		failed=1
+	elif ! grep -q "$resumed" $dir/server.err; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $change, server never said /$resumed/
+~~~~~~~~~~~~~~~~~~~~~~~"
+		failed=1
+	elif ! cmp -s $dir/in.bin $dir/server/out.bin; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $change, resumed outfile differs
+~~~~~~~~~~~~~~~~~~~~~~~"
+		failed=1
+	fi
+
+	rm -rf $dir
+
+	echo "$change done"
+done
+
+if [ $failed -ne 0 ]; then
+	exit 1
+fi
+
+echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST SUCCESS
+~~~~~~~~~~~~~~~~~~~~~~~"
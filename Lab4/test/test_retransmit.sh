@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+
+echo "
+!!! RUNNING TEST_RETRANSMIT !!!
+"
+
+# sends a 3 MB file through a server dropping 3% of pkts with each send path,
+# a transfer only gives up once the server stops acking, not on pkts that
+# happen to be lost a few times over
+
+port=9090
+
+mkdir -p out/retransmit
+
+head -c 3000000 /dev/urandom > out/retransmit/in.bin
+echo "127.0.0.1 $port" > out/retransmit/servaddr.conf
+
+./bin/myserver $port 3 out/retransmit/server/ > /dev/null 2>&1 &
+server_pid=$!
+sleep 0.3
+
+failed=0
+
+for flags in "" "-p burst" "-e"; do
+	rm -f out/retransmit/server/out.bin
+
+	./bin/myclient $flags 1 out/retransmit/servaddr.conf 1400 16 out/retransmit/in.bin out.bin > /dev/null 2> out/retransmit/client.err
+	rc=$?
+
+	if [ $rc -ne 0 ]; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: client${flags:+ $flags} exited with $rc
+~~~~~~~~~~~~~~~~~~~~~~~"
+		tail -n 3 out/retransmit/client.err
+		failed=1
+	elif ! cmp -s out/retransmit/in.bin out/retransmit/server/out.bin; then
+		echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: client${flags:+ $flags} outfile differs
+~~~~~~~~~~~~~~~~~~~~~~~"
+		failed=1
+	fi
+done
+
+kill -9 $server_pid
+wait $server_pid &>/dev/null
+
+rm -rf out/retransmit
+
+if [ $failed -ne 0 ]; then
+	exit 1
+fi
+
+echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST SUCCESS
+~~~~~~~~~~~~~~~~~~~~~~~"
@@ -0,0 +1,149 @@
+#!/usr/bin/env bash
+
+echo "
+!!! RUNNING TEST_ROUNDTRIP !!!
+"
+
+# sends files through every row of the matrix below and cmps what the server wrote
+# a row is: server flags | client flags | droppc | files | resends | expect | mss
+#   files    any of random (3 MB), text (3 MB of log lines) and empty
+#   resends  after the first send, each step edits the infile and sends it again to the same outfile
+#            same leaves it as is, overwrite rewrites 4 KB in place, insert adds 777 bytes in the middle,
+#            busy sends it from two clients at once so one waits on the path until the other is done
+#   expect   extended regex the client's stderr has to match after every resend, for busy both clients' stderr
+#   mss      defaults to 1400, small and jumbo pkts move where the server splits header from payload
+
+matrix=(
+	"||0|random text empty||"
+	"|-s 4|0|random text empty||"
+	"-w 4|-s 4|3|random||"
+	"-w 2|-e|3|random text||"
+	"-w 2|-z|3|text|busy busy|^Compression IP"
+	"-j 2|-z|3|random text empty|overwrite|"
+	"|-z -s 2|3|random text empty||"
+	"-j 2|-p burst|3|random text empty|overwrite|"
+	"-w 2 -j 3|-s 4|3|random||"
+	"-g|-g|3|random text empty||"
+	"-g -w 2 -j 2|-g -s 4|3|random||"
+	"||3|random empty|||300"
+	"-j 2||3|random text|||9000"
+	"-g|-g -s 2|3|random|||9000"
+	"-j 2|-d|3|random text|overwrite insert|literal bytes, [1-9][0-9]* bytes copied"
+	"-j 2|-r|3|random text empty|same|matched by server"
+	"-k -j 2|-k|0|random|overwrite|matched by server"
+	"-k|-k|3|random|same|^Server holds ([1-9][0-9]*) of \1 chunks"
+	"|-d|0|random text|insert|matched by server"
+)
+
+port=9090
+dir=out/roundtrip
+
+mkdir -p $dir
+
+# infile of the given kind at path
+function make_file()
+{
+	case $1 in
+		random)
+			head -c 3000000 /dev/urandom > $2
+			;;
+		text)
+			for i in $(seq 1 50001); do
+				echo "2026-10-18T02:19:$((i % 60))Z INFO worker[$((i % 8))] request $i served in $((i * 7 % 1000)) ms"
+			done | head -c 3000000 > $2
+			;;
+		empty)
+			: > $2
+			;;
+	esac
+}
+
+# edit infile at path in place for a resend step
+function edit_file()
+{
+	case $1 in
+		overwrite)
+			head -c 4096 /dev/urandom | dd of=$2 bs=1 seek=1000000 conv=notrunc status=none
+			;;
+		insert)
+			head -c 2000000 $2 > $2.edit
+			head -c 777 /dev/urandom >> $2.edit
+			tail -c +2000001 $2 >> $2.edit
+			mv $2.edit $2
+			;;
+	esac
+}
+
+echo "127.0.0.1 $port" > $dir/servaddr.conf
+
+failed=0
+
+for row in "${matrix[@]}"; do
+	IFS='|' read -r sflags cflags droppc files resends expect mss <<< "$row"
+	mss=${mss:-1400}
+	name="server [$sflags] client [$cflags] drop $droppc% mss $mss"
+
+	rm -rf $dir/server
+
+	./bin/myserver $sflags $port $droppc $dir/server/ > /dev/null 2> $dir/server.err &
+	server_pid=$!
+	sleep 0.3
+
+	for file in $files; do
+		make_file $file $dir/$file.in
+
+		for step in first $resends; do
+			edit_file $step $dir/$file.in
+
+			errs=$dir/client.err
+
+			if [ $step == busy ]; then
+				errs="$dir/client.err $dir/waiter.err"
+				timeout 120 ./bin/myclient $cflags 1 $dir/servaddr.conf $mss 32 $dir/$file.in $file.out > /dev/null 2> $dir/waiter.err &
+				waiter_pid=$!
+			fi
+
+			timeout 120 ./bin/myclient $cflags 1 $dir/servaddr.conf $mss 32 $dir/$file.in $file.out > /dev/null 2> $dir/client.err
+			rc=$?
+
+			if [ $step == busy ]; then
+				wait $waiter_pid
+				waiter_rc=$?
+				[ $rc -eq 0 ] && rc=$waiter_rc
+			fi
+
+			if [ $rc -ne 0 ]; then
+				echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $name, $file ($step) client exited with $rc
+~~~~~~~~~~~~~~~~~~~~~~~"
+				tail -n 3 $errs
+				failed=1
+			elif ! cmp -s $dir/$file.in $dir/server/$file.out; then
+				echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $name, $file ($step) outfile differs
+~~~~~~~~~~~~~~~~~~~~~~~"
+				failed=1
+			elif [ $step != first ] && [ -n "$expect" ] && [ $(grep -lE "$expect" $errs | wc -l) -ne $(echo $errs | wc -w) ]; then
+				echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST FAILURE: $name, $file ($step) client never said /$expect/
+~~~~~~~~~~~~~~~~~~~~~~~"
+				failed=1
+			fi
+		done
+	done
+
+	kill -9 $server_pid
+	wait $server_pid &>/dev/null
+
+	echo "$name done"
+done
+
+rm -rf $dir
+
+if [ $failed -ne 0 ]; then
+	exit 1
+fi
+
+echo "~~~~~~~~~~~~~~~~~~~~~~~
+	TEST SUCCESS
+~~~~~~~~~~~~~~~~~~~~~~~"